@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audioroutescheduler.h"
+#include "logging.h"
+
+#include <QDebug>
+
+#define DEFAULT_RESTORE_DELAY 2000
+
+AudioRouteScheduler::AudioRouteScheduler(QObject *parent)
+    : QObject(parent)
+{
+    mRestoreTimer.setSingleShot(true);
+    mRestoreTimer.setInterval(DEFAULT_RESTORE_DELAY);
+    QObject::connect(&mRestoreTimer, SIGNAL(timeout()), SLOT(onRestoreTimeout()));
+}
+
+int AudioRouteScheduler::restoreDelay() const
+{
+    return mRestoreTimer.interval();
+}
+
+void AudioRouteScheduler::setRestoreDelay(int msecs)
+{
+    mRestoreTimer.setInterval(msecs);
+}
+
+bool AudioRouteScheduler::isRestorePending() const
+{
+    return mRestoreTimer.isActive();
+}
+
+int AudioRouteScheduler::restoreRemainingTime() const
+{
+    return mRestoreTimer.remainingTime();
+}
+
+void AudioRouteScheduler::switchTo(AudioRouteScheduler::Route route)
+{
+    // a new route always wins over a restore scheduled for a previous call
+    cancelRestore();
+    Q_EMIT routeChanged(route);
+}
+
+void AudioRouteScheduler::scheduleRestore()
+{
+    // several calls ending in a row restore the route only once, when the
+    // first restore was scheduled
+    if (mRestoreTimer.isActive()) {
+        return;
+    }
+    mRestoreTimer.start();
+}
+
+void AudioRouteScheduler::cancelRestore()
+{
+    if (mRestoreTimer.isActive()) {
+        qCDebug(lcAudio) << "Cancelling pending audio route restore";
+        mRestoreTimer.stop();
+    }
+}
+
+void AudioRouteScheduler::onRestoreTimeout()
+{
+    Q_EMIT routeChanged(RouteNormal);
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOROUTESCHEDULER_H
+#define AUDIOROUTESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+
+// Owns the audio route transitions of a connection. Route changes are
+// applied right away, while going back to the normal route after the last
+// call ended is deferred, and cancelled if a new call shows up meanwhile.
+class AudioRouteScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Route {
+        RouteEarpiece,
+        RouteSpeaker,
+        RouteBluetooth,
+        RouteWiredOrEarpiece,
+        RouteRingtone,
+        RouteNormal
+    };
+
+    explicit AudioRouteScheduler(QObject *parent = 0);
+
+    int restoreDelay() const;
+    void setRestoreDelay(int msecs);
+    bool isRestorePending() const;
+    // milliseconds left before the pending restore, -1 if there is none
+    int restoreRemainingTime() const;
+
+public Q_SLOTS:
+    void switchTo(AudioRouteScheduler::Route route);
+    void scheduleRestore();
+    void cancelRestore();
+
+Q_SIGNALS:
+    void routeChanged(AudioRouteScheduler::Route route);
+
+private Q_SLOTS:
+    void onRestoreTimeout();
+
+private:
+    QTimer mRestoreTimer;
+};
+
+#endif
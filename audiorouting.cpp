@@ -0,0 +1,605 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file was taken from qt5 and modified by 
+** David Henningsson <david.henningsson@canonical.com> for usage in 
+** telepathy-ofono.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtCore/qdebug.h>
+#include <QtCore/qelapsedtimer.h>
+
+#include "audiorouting.h"
+#include "logging.h"
+
+#define PROFILE_HSP "headset_head_unit"
+#define PROFILE_A2DP "a2dp_sink"
+
+static const AudioPort *findPort(const QList<AudioPort> &ports, const char *name)
+{
+    for (int i = 0; i < ports.size(); i++) {
+        if (ports[i].name == name)
+            return &ports[i];
+    }
+    return NULL;
+}
+
+static bool portPlugged(const AudioPort *port)
+{
+    return port && (port->available != AudioPortAvailableNo) &&
+            (port->available != AudioPortAvailableUnknown);
+}
+
+VoiceCallCards AudioRoutingPolicy::findVoiceCallCards(const QList<AudioCard> &cards)
+{
+    VoiceCallCards result;
+
+    Q_FOREACH(const AudioCard &card, cards) {
+        const AudioProfile *voice_call = NULL, *highest = NULL;
+        const AudioProfile *hsp = NULL, *a2dp = NULL;
+
+        /* For now we only support one card with the voicecall feature */
+        for (int i = 0; i < card.profiles.size(); i++) {
+            const AudioProfile &profile = card.profiles[i];
+            if (!highest || profile.priority > highest->priority)
+                highest = &profile;
+            if (profile.name == "voicecall")
+                voice_call = &profile;
+            else if (profile.name == PROFILE_HSP && profile.available != 0)
+                hsp = &profile;
+            else if (profile.name == PROFILE_A2DP && profile.available != 0)
+                a2dp = &profile;
+        }
+
+        /* Record the card that supports voicecall (default one to be used) */
+        if (voice_call) {
+            qCDebug(lcAudio, "Found card that supports voicecall: '%s'", card.name.c_str());
+            result.voicecallcard = card.name;
+            result.voicecallhighest = highest->name;
+            result.voicecallprofile = voice_call->name;
+        }
+
+        /* Handle the use cases needed for bluetooth */
+        if (hsp && a2dp) {
+            qCDebug(lcAudio, "Found card that supports hsp and a2dp: '%s'", card.name.c_str());
+            result.bt_hsp_a2dp = card.name;
+        } else if (hsp && (a2dp == NULL)) {
+            /* This card only provides the hsp profile */
+            qCDebug(lcAudio, "Found card that supports only hsp: '%s'", card.name.c_str());
+            result.bt_hsp = card.name;
+        }
+    }
+
+    return result;
+}
+
+bool AudioRoutingPolicy::resolveSink(const AudioDevice &sink, CallStatus callstatus, AudioMode requested,
+                                     bool hasBluetooth, bool forceport, AudioMode &audiomode,
+                                     AudioModes &modes, std::string &port)
+{
+    const AudioPort *earpiece = findPort(sink.ports, "output-earpiece");
+    const AudioPort *speaker = findPort(sink.ports, "output-speaker");
+    const AudioPort *wired_headset = findPort(sink.ports, "output-wired_headset");
+    const AudioPort *wired_headphone = findPort(sink.ports, "output-wired_headphone");
+    const AudioPort *bluetooth_sco = findPort(sink.ports, "output-bluetooth_sco");
+    const AudioPort *speaker_and_wired_headphone = findPort(sink.ports, "output-speaker+wired_headphone");
+    const AudioPort *preferred = NULL;
+    AudioMode audiomodetoset = requested;
+    AudioModes available;
+
+    if (!portPlugged(wired_headset))
+        wired_headset = NULL;
+    if (!portPlugged(wired_headphone))
+        wired_headphone = NULL;
+
+    if (!earpiece || !speaker)
+        return false; /* Not the right sink */
+
+    /* Refresh list of available audio modes */
+    available.append(AudioModeEarpiece);
+    available.append(AudioModeSpeaker);
+    if (wired_headset || wired_headphone)
+        available.append(AudioModeWiredHeadset);
+    if (bluetooth_sco && hasBluetooth)
+        available.append(AudioModeBluetooth);
+
+    /* Check if the requested mode is available (earpiece*/
+    if (((requested == AudioModeWiredHeadset) && !available.contains(AudioModeWiredHeadset)) ||
+            ((requested == AudioModeBluetooth) && !available.contains(AudioModeBluetooth)))
+        return false;
+
+    /* Now to decide which output to be used, depending on the active mode */
+    qCDebug(lcAudio, "Deciding output...");
+    if (requested & AudioModeEarpiece) {
+        preferred = earpiece;
+        audiomodetoset = AudioModeEarpiece;
+        qCDebug(lcAudio, "Prefer AudioModeEarpiece");
+    }
+    if (requested & AudioModeSpeaker) {
+        preferred = speaker;
+        audiomodetoset = AudioModeSpeaker;
+        qCDebug(lcAudio, "Prefer AudioModeSpeaker");
+    }
+    if ((requested & AudioModeWiredHeadset) && (available.contains(AudioModeWiredHeadset))) {
+        preferred = wired_headset ? wired_headset : wired_headphone;
+        audiomodetoset = AudioModeWiredHeadset;
+        qCDebug(lcAudio, "Prefer AudioModeWiredHeadset");
+    }
+    if (callstatus == CallRinging && speaker_and_wired_headphone) {
+        preferred = speaker_and_wired_headphone;
+        audiomodetoset = AudioModeWiredOrSpeaker;
+        qCDebug(lcAudio, "Prefer AudioModeWiredOrSpeaker");
+    }
+    if ((requested & AudioModeBluetooth) && (available.contains(AudioModeBluetooth))) {
+        preferred = bluetooth_sco;
+        audiomodetoset = AudioModeBluetooth;
+        qCDebug(lcAudio, "Prefer AudioModeBluetooth");
+    }
+
+    audiomode = audiomodetoset;
+    modes = available;
+    port = "";
+    if (preferred && (forceport || sink.activePort != preferred->name))
+        port = preferred->name;
+    return true;
+}
+
+bool AudioRoutingPolicy::resolveSource(const AudioDevice &source, AudioMode audiomode,
+                                       const AudioModes &modes, bool forceport, std::string &port)
+{
+    const AudioPort *preferred = NULL;
+
+    if (source.isMonitor)
+        return false;  /* Not the right source */
+
+    const AudioPort *builtin_mic = findPort(source.ports, "input-builtin_mic");
+    const AudioPort *wired_headset = findPort(source.ports, "input-wired_headset");
+    const AudioPort *bluetooth_sco = findPort(source.ports, "input-bluetooth_sco_headset");
+
+    if (wired_headset && wired_headset->available == AudioPortAvailableNo)
+        wired_headset = NULL;
+
+    if (!builtin_mic)
+        return false; /* Not the right source */
+
+    /* Now to decide which output to be used, depending on the active mode */
+    if ((audiomode & AudioModeEarpiece) || (audiomode & AudioModeSpeaker))
+        preferred = builtin_mic;
+    if ((audiomode & AudioModeWiredHeadset) && (modes.contains(AudioModeWiredHeadset)))
+        preferred = wired_headset ? wired_headset : builtin_mic;
+    if ((audiomode & AudioModeBluetooth) && (modes.contains(AudioModeBluetooth)))
+        preferred = bluetooth_sco;
+
+    port = "";
+    if (preferred && (forceport || source.activePort != preferred->name))
+        port = preferred->name;
+    return true;
+}
+
+bool AudioRoutingPolicy::isBluetoothHeadset(const AudioCard &card)
+{
+    /* Check if it's indeed a BT device (with at least one hsp profile) */
+    Q_FOREACH(const AudioProfile &profile, card.profiles) {
+        if (profile.name == PROFILE_HSP)
+            return true;
+    }
+    return false;
+}
+
+bool AudioRoutingPolicy::hasWiredHeadset(const AudioCard &card)
+{
+    Q_FOREACH(const AudioPort &port, card.ports) {
+        if ((port.available == AudioPortAvailableYes) &&
+                (port.name == "output-wired_headset" || port.name == "output-wired_headphone"))
+            return true;
+    }
+    return false;
+}
+
+AudioRouter::AudioRouter(AudioBackend *backend, QObject *parent)
+    : QObject(parent)
+    , mBackend(backend)
+    , mCallStatus(CallEnded)
+    , mAudioMode(AudioModeSpeaker)
+    , mMicMute(false)
+    , mDefaultSink("sink.primary")
+    , mDefaultSource("source.primary")
+    , mPreparedRouteHits(0)
+{
+}
+
+void AudioRouter::setForcedDevices(const std::string &sink, const std::string &source)
+{
+    mForcedSink = sink;
+    mForcedSource = source;
+}
+
+CallStatus AudioRouter::callStatus() const
+{
+    return mCallStatus;
+}
+
+AudioMode AudioRouter::audioMode() const
+{
+    return mAudioMode;
+}
+
+AudioModes AudioRouter::availableAudioModes() const
+{
+    return mAvailableAudioModes;
+}
+
+bool AudioRouter::micMute() const
+{
+    return mMicMute;
+}
+
+int AudioRouter::preparedRouteHits() const
+{
+    return mPreparedRouteHits;
+}
+
+int AudioRouter::setupVoiceCall()
+{
+    qCDebug(lcAudio, "Setting up audio for voice call");
+
+    /* Record the default sink/source to be restored later */
+    mDefaultSink = mBackend->defaultSink();
+    mDefaultSource = mBackend->defaultSource();
+
+    qCDebug(lcAudio, "Recorded default sink: %s default source: %s",
+            mDefaultSink.c_str(), mDefaultSource.c_str());
+
+    /* Find the voice call capable card and identify if we have bluetooth
+     * capable devices (hsp and a2dp) */
+    mCards = AudioRoutingPolicy::findVoiceCallCards(mBackend->cards());
+
+    /* In case we have only one bt device that provides hsp and a2dp, we need
+     * to make sure we switch the default profile for that card (to hsp) */
+    if ((mCards.bt_hsp_a2dp != "") && (mCards.bt_hsp == "")) {
+        qCDebug(lcAudio, "Setting card '%s' profile '%s'", mCards.bt_hsp_a2dp.c_str(), PROFILE_HSP);
+        AudioOperations operations;
+        operations << AudioOperation(AudioOperation::SetCardProfile, mCards.bt_hsp_a2dp, PROFILE_HSP);
+        if (!mBackend->apply(operations))
+            return -1;
+    }
+
+    return 0;
+}
+
+void AudioRouter::restoreVoiceCall()
+{
+    AudioOperations operations;
+
+    qCDebug(lcAudio, "Restoring previous audio state");
+
+    /* See if we need to restore any HSP+AD2P device state */
+    if ((mCards.bt_hsp_a2dp != "") && (mCards.bt_hsp == "")) {
+        qCDebug(lcAudio, "Restoring card '%s' to profile '%s'", mCards.bt_hsp_a2dp.c_str(), PROFILE_A2DP);
+        operations << AudioOperation(AudioOperation::SetCardProfile, mCards.bt_hsp_a2dp, PROFILE_A2DP);
+    }
+
+    /* Restore default sink/source */
+    if (mDefaultSink != "") {
+        qCDebug(lcAudio, "Restoring default sink to '%s'", mDefaultSink.c_str());
+        operations << AudioOperation(AudioOperation::SetDefaultSink, mDefaultSink);
+    }
+    if (mDefaultSource != "") {
+        qCDebug(lcAudio, "Restoring default source to '%s'", mDefaultSource.c_str());
+        operations << AudioOperation(AudioOperation::SetDefaultSource, mDefaultSource);
+    }
+
+    mBackend->apply(operations);
+}
+
+void AudioRouter::resolveRoute(AudioRoute &route, bool forceport)
+{
+    bool hasBluetooth = (mCards.bt_hsp != "") || (mCards.bt_hsp_a2dp != "");
+
+    /* Read first, so changes made while resolving invalidate the route */
+    route.generation = mBackend->generation();
+
+    /* Find highest compatible sink/source elements from the voicecall
+       compatible card (on touch this means the pulse droid element) */
+    route.sink = route.sinkport = "";
+    Q_FOREACH(const AudioDevice &sink, mBackend->sinks()) {
+        std::string port;
+        if (AudioRoutingPolicy::resolveSink(sink, mCallStatus, mAudioMode, hasBluetooth, forceport,
+                                            mAudioMode, mAvailableAudioModes, port)) {
+            route.sink = mForcedSink != "" ? mForcedSink : sink.name;
+            route.sinkport = port;
+        }
+    }
+
+    /* Same for source */
+    route.source = route.sourceport = "";
+    Q_FOREACH(const AudioDevice &source, mBackend->sources()) {
+        std::string port;
+        if (AudioRoutingPolicy::resolveSource(source, mAudioMode, mAvailableAudioModes, forceport, port)) {
+            route.source = mForcedSource != "" ? mForcedSource : source.name;
+            route.sourceport = port;
+        }
+    }
+
+    route.audiomode = mAudioMode;
+    route.modes = mAvailableAudioModes;
+}
+
+void AudioRouter::setCallMode(CallStatus callstatus, AudioMode audiomode, bool micmute)
+{
+    mMicMute = micmute;
+    setCallMode(callstatus, audiomode);
+}
+
+void AudioRouter::setCallMode(CallStatus callstatus, AudioMode audiomode)
+{
+    QElapsedTimer timer;
+    timer.start();
+    CallStatus p_callstatus = mCallStatus;
+    AudioMode p_audiomode = mAudioMode;
+    AudioModes p_availableAudioModes = mAvailableAudioModes;
+    AudioOperations operations;
+    bool forceport = false;
+
+    /* Check if we need to save the current audio state (e.g. when starting a call) */
+    if ((callstatus != CallEnded) && (p_callstatus == CallEnded)) {
+        if (setupVoiceCall() < 0) {
+            qCCritical(lcAudio, "Failed to setup audio for Voice Call");
+            return;
+        }
+    }
+
+    /* If we have an active call, update internal state (used later when updating sink/source ports) */
+    mCallStatus = callstatus;
+    mAudioMode = audiomode;
+
+    /* Switch the virtual card mode when call is active and not active
+     * This needs to be done before sink/source gets updated, because after changing mode
+     * it will automatically move to input/output-parking, so the ports need to be set
+     * even if the model says they are already active */
+    if ((mCallStatus == CallActive) && (p_callstatus != CallActive) &&
+            (mCards.voicecallcard != "") && (mCards.voicecallprofile != "")) {
+        qCDebug(lcAudio, "Setting card '%s' profile '%s'",
+                mCards.voicecallcard.c_str(), mCards.voicecallprofile.c_str());
+        operations << AudioOperation(AudioOperation::SetCardProfile,
+                                     mCards.voicecallcard, mCards.voicecallprofile);
+        forceport = true;
+    } else if (((mCallStatus == CallEnded) || (p_callstatus == CallActive && mCallStatus != CallActive)) &&
+            (mCards.voicecallcard != "") && (mCards.voicecallhighest != "")) {
+        /* If using droid, make sure to restore to the profile that has the highest score.
+         * Leaving an active call without ending it happens when requests got collapsed */
+        qCDebug(lcAudio, "Restoring card '%s' to profile '%s'",
+                mCards.voicecallcard.c_str(), mCards.voicecallhighest.c_str());
+        operations << AudioOperation(AudioOperation::SetCardProfile,
+                                     mCards.voicecallcard, mCards.voicecallhighest);
+        forceport = true;
+    }
+
+    /* Use the route resolved while the call was ringing if nothing changed since then */
+    AudioRoute route;
+    bool activating = (mCallStatus == CallActive) && (p_callstatus != CallActive);
+    if (activating && mPrepared.valid && mPrepared.requested == audiomode &&
+            mPrepared.generation == mBackend->generation()) {
+        qCDebug(lcAudio, "Using the pre-warmed audio route");
+        route = mPrepared;
+        mPreparedRouteHits++;
+        mAudioMode = route.audiomode;
+        mAvailableAudioModes = route.modes;
+    } else {
+        resolveRoute(route, forceport);
+    }
+    mPrepared.valid = false;
+
+    if (route.sink != "" && (forceport || route.sink != mBackend->defaultSink())) {
+        qCDebug(lcAudio, "Setting default sink to '%s'", route.sink.c_str());
+        operations << AudioOperation(AudioOperation::SetDefaultSink, route.sink);
+    }
+    if (route.sinkport != "") {
+        qCDebug(lcAudio, "Setting sink '%s' port '%s'", route.sink.c_str(), route.sinkport.c_str());
+        operations << AudioOperation(AudioOperation::SetSinkPort, route.sink, route.sinkport);
+    }
+    if (route.source != "" && (forceport || route.source != mBackend->defaultSource())) {
+        qCDebug(lcAudio, "Setting default source to '%s'", route.source.c_str());
+        operations << AudioOperation(AudioOperation::SetDefaultSource, route.source);
+    }
+    if (route.sourceport != "") {
+        qCDebug(lcAudio, "Setting source '%s' port '%s'", route.source.c_str(), route.sourceport.c_str());
+        operations << AudioOperation(AudioOperation::SetSourcePort, route.source, route.sourceport);
+    }
+
+    /* In case the app had set mute when the call wasn't active, make sure we reflect it here */
+    if (mCallStatus != CallEnded && route.source != "") {
+        qCDebug(lcAudio, "Setting source '%s' muted '%d'", route.source.c_str(), mMicMute ? 1 : 0);
+        operations << AudioOperation(AudioOperation::SetSourceMute, route.source, std::string(), mMicMute);
+    }
+
+    if (!mBackend->apply(operations))
+        return;
+
+    /* Notify if the list of audio modes changed */
+    if (p_availableAudioModes != mAvailableAudioModes)
+        Q_EMIT availableAudioModesChanged(mAvailableAudioModes);
+
+    /* Notify if call mode changed */
+    if (p_audiomode != mAudioMode) {
+        Q_EMIT audioModeChanged(mAudioMode);
+    }
+
+    /* If no more active voicecall, restore previous saved audio state */
+    if (callstatus == CallEnded) {
+        restoreVoiceCall();
+    }
+
+    qint64 elapsed = timer.nsecsElapsed() / 1000;
+    qCDebug(lcAudio, "Audio route switched in %lld us (%d operations)", elapsed, operations.size());
+    Q_EMIT routeSwitched(elapsed);
+    if (activating)
+        Q_EMIT callAudioActivated();
+}
+
+void AudioRouter::setMicMute(bool muted)
+{
+    mMicMute = muted;
+
+    if (mCallStatus == CallEnded)
+        return;
+
+    std::string sourcename;
+    Q_FOREACH(const AudioDevice &source, mBackend->sources()) {
+        std::string port;
+        if (AudioRoutingPolicy::resolveSource(source, mAudioMode, mAvailableAudioModes, false, port))
+            sourcename = mForcedSource != "" ? mForcedSource : source.name;
+    }
+
+    if (sourcename != "") {
+        qCDebug(lcAudio, "Setting source '%s' muted '%d'", sourcename.c_str(), mMicMute ? 1 : 0);
+        AudioOperations operations;
+        operations << AudioOperation(AudioOperation::SetSourceMute, sourcename, std::string(), mMicMute);
+        mBackend->apply(operations);
+    }
+}
+
+void AudioRouter::prepareCall(AudioMode audiomode)
+{
+    /* Only makes sense while the call is not active yet */
+    if (mCallStatus == CallActive)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    /* Saved defaults and the voicecall card are resolved when ringing starts */
+    if (mCallStatus == CallEnded && setupVoiceCall() < 0)
+        return;
+
+    /* Resolve the route as setCallMode would when the call gets active,
+     * without touching the current state */
+    CallStatus callstatus = mCallStatus;
+    AudioMode currentaudiomode = mAudioMode;
+    AudioModes modes = mAvailableAudioModes;
+
+    mCallStatus = CallActive;
+    mAudioMode = audiomode;
+    resolveRoute(mPrepared, (mCards.voicecallcard != "") && (mCards.voicecallprofile != ""));
+    mPrepared.requested = audiomode;
+    mPrepared.valid = true;
+
+    mCallStatus = callstatus;
+    mAudioMode = currentaudiomode;
+    mAvailableAudioModes = modes;
+
+    qCDebug(lcAudio, "Audio route pre-warmed in %lld us: sink '%s' port '%s', source '%s' port '%s'",
+           timer.nsecsElapsed() / 1000, mPrepared.sink.c_str(), mPrepared.sinkport.c_str(),
+           mPrepared.source.c_str(), mPrepared.sourceport.c_str());
+}
+
+void AudioRouter::reapply()
+{
+    mPrepared.valid = false;
+    if (mCallStatus == CallEnded)
+        return;
+
+    CallStatus callstatus = mCallStatus;
+    mCallStatus = CallEnded;
+    setCallMode(callstatus, mAudioMode);
+}
+
+void AudioRouter::cardAdded(const AudioCard &card)
+{
+    qCDebug(lcAudio, "Notified about card (%s) add event", card.name.c_str());
+
+    /* We only care about BT (HSP) devices, and if one is not already available */
+    if ((mCallStatus == CallEnded) || ((mCards.bt_hsp != "") && (mCards.bt_hsp_a2dp != "")) ||
+            !AudioRoutingPolicy::isBluetoothHeadset(card))
+        return;
+
+    qCDebug(lcAudio, "Adding new BT-HSP capable device");
+    if (!mBackend->sync())
+        return;
+    /* In case A2DP is available, switch to HSP */
+    if (setupVoiceCall() < 0)
+        return;
+    /* Enable the HSP output port  */
+    setCallMode(mCallStatus, AudioModeBluetooth);
+}
+
+void AudioRouter::cardChanged(const AudioCard &card)
+{
+    bool handleevent = false;
+    AudioMode audiomode = mAudioMode;
+
+    qCDebug(lcAudio, "Notified about card (%s) changes event", card.name.c_str());
+
+    /* We only care if the card event for the voicecall capable card */
+    if ((mCallStatus != CallActive) || (card.name != mCards.voicecallcard))
+        return;
+
+    if (mAudioMode == AudioModeWiredHeadset) {
+        /* If previous mode is wired, it means it got unplugged */
+        handleevent = true;
+        audiomode = AudioModeBtOrWiredOrEarpiece;
+    } else if ((mAudioMode == AudioModeEarpiece) || (mAudioMode == AudioModeSpeaker)) {
+        /* Now only trigger the event in case wired headset/headphone is now available */
+        if (AudioRoutingPolicy::hasWiredHeadset(card)) {
+            handleevent = true;
+            audiomode = AudioModeWiredOrEarpiece;
+        }
+    } else if (mAudioMode == AudioModeBluetooth) {
+        /* Handle the event so we can update the audiomodes */
+        handleevent = true;
+        audiomode = AudioModeBluetooth;
+    }
+
+    if (!handleevent)
+        return;
+
+    /* In this case it means the handset state changed */
+    qCDebug(lcAudio, "Notifying card changes for the voicecall capable card");
+    if (!mBackend->sync())
+        return;
+    setCallMode(mCallStatus, audiomode);
+}
+
+void AudioRouter::cardRemoved()
+{
+    if (mCallStatus == CallEnded)
+        return;
+
+    /* Check if the main HSP card was removed */
+    bool removed = false;
+    QList<AudioCard> cards = mBackend->cards();
+    Q_FOREACH(const std::string &name, QList<std::string>() << mCards.bt_hsp << mCards.bt_hsp_a2dp) {
+        if (name == "")
+            continue;
+        bool found = false;
+        Q_FOREACH(const AudioCard &card, cards) {
+            if (card.name == name)
+                found = true;
+        }
+        if (!found)
+            removed = true;
+    }
+
+    if (!removed)
+        return;
+
+    qCDebug(lcAudio, "Notifying about BT-HSP card removal");
+    if (!mBackend->sync())
+        return;
+    /* Needed in order to save the default sink/source */
+    if (setupVoiceCall() < 0)
+        return;
+    /* Enable the default handset output port  */
+    setCallMode(mCallStatus, AudioModeWiredOrEarpiece);
+}
@@ -0,0 +1,220 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file was taken from qt5 and modified by 
+** David Henningsson <david.henningsson@canonical.com> for usage in 
+** telepathy-ofono.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef AUDIOROUTING_H
+#define AUDIOROUTING_H
+
+#include <QtCore/qobject.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qmetatype.h>
+#include <string>
+
+enum AudioMode {
+    AudioModeEarpiece = 0x0001,
+    AudioModeWiredHeadset = 0x0002,
+    AudioModeSpeaker = 0x0004,
+    AudioModeBluetooth = 0x0008,
+    AudioModeBtOrWiredOrEarpiece = AudioModeBluetooth | AudioModeWiredHeadset | AudioModeEarpiece,
+    AudioModeWiredOrEarpiece = AudioModeWiredHeadset | AudioModeEarpiece,
+    AudioModeWiredOrSpeaker = AudioModeWiredHeadset | AudioModeSpeaker
+};
+
+Q_DECLARE_METATYPE(AudioMode)
+
+typedef QList<AudioMode> AudioModes;
+Q_DECLARE_METATYPE(AudioModes)
+
+enum CallStatus {
+    CallRinging,
+    CallActive,
+    CallEnded
+};
+
+Q_DECLARE_METATYPE(CallStatus)
+
+/* Same values as pa_port_available_t */
+enum AudioPortAvailability {
+    AudioPortAvailableUnknown = 0,
+    AudioPortAvailableNo = 1,
+    AudioPortAvailableYes = 2
+};
+
+/* Copy of the audio objects relevant for call routing */
+struct AudioPort
+{
+    std::string name;
+    int available;
+};
+
+struct AudioDevice
+{
+    uint32_t index;
+    std::string name;
+    std::string activePort;
+    bool isMonitor;
+    QList<AudioPort> ports;
+};
+
+struct AudioProfile
+{
+    std::string name;
+    uint32_t priority;
+    int available;
+};
+
+struct AudioCard
+{
+    uint32_t index;
+    std::string name;
+    QList<AudioProfile> profiles;
+    QList<AudioPort> ports;
+};
+
+struct AudioOperation
+{
+    enum Type {
+        SetCardProfile,
+        SetDefaultSink,
+        SetDefaultSource,
+        SetSinkPort,
+        SetSourcePort,
+        SetSourceMute
+    };
+
+    AudioOperation(Type type, const std::string &object, const std::string &value = std::string(), bool mute = false)
+        : type(type), object(object), value(value), mute(mute) {}
+
+    Type type;
+    std::string object;
+    std::string value;
+    bool mute;
+};
+
+typedef QList<AudioOperation> AudioOperations;
+
+/* Sink/source and ports a call mode resolves to */
+struct AudioRoute
+{
+    AudioRoute() : valid(false), generation(0) {}
+    bool valid;
+    AudioMode requested, audiomode;
+    AudioModes modes;
+    std::string sink, sinkport, source, sourceport;
+    quint64 generation;
+};
+
+/* Cards relevant for voice calls */
+struct VoiceCallCards
+{
+    std::string voicecallcard, voicecallhighest, voicecallprofile;
+    std::string bt_hsp, bt_hsp_a2dp;
+};
+
+/* The audio system driven by AudioRouter */
+class AudioBackend
+{
+public:
+    virtual ~AudioBackend() {}
+
+    virtual QList<AudioCard> cards() = 0;
+    virtual QList<AudioDevice> sinks() = 0;
+    virtual QList<AudioDevice> sources() = 0;
+    virtual std::string defaultSink() = 0;
+    virtual std::string defaultSource() = 0;
+    /* Bumped on every change that can affect a routing decision */
+    virtual quint64 generation() = 0;
+    /* Makes sure the objects above reflect the current state of the audio system */
+    virtual bool sync() = 0;
+    /* Applies the operations in order, and returns once all of them are done */
+    virtual bool apply(const AudioOperations &operations) = 0;
+};
+
+/* Routing decisions, independent from the audio system */
+class AudioRoutingPolicy
+{
+public:
+    static VoiceCallCards findVoiceCallCards(const QList<AudioCard> &cards);
+    /* Returns false if the sink is not the voice call one, or if the requested mode is not available */
+    static bool resolveSink(const AudioDevice &sink, CallStatus callstatus, AudioMode requested,
+                            bool hasBluetooth, bool forceport, AudioMode &audiomode,
+                            AudioModes &modes, std::string &port);
+    /* Returns false if the source is not the voice call one */
+    static bool resolveSource(const AudioDevice &source, AudioMode audiomode,
+                              const AudioModes &modes, bool forceport, std::string &port);
+    static bool isBluetoothHeadset(const AudioCard &card);
+    static bool hasWiredHeadset(const AudioCard &card);
+};
+
+/* Call audio state machine: decides the route with AudioRoutingPolicy and
+ * applies it through an AudioBackend */
+class AudioRouter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AudioRouter(AudioBackend *backend, QObject *parent = 0);
+
+    /* Devices to use instead of the ones picked by the policy (device quirks) */
+    void setForcedDevices(const std::string &sink, const std::string &source);
+
+    CallStatus callStatus() const;
+    AudioMode audioMode() const;
+    AudioModes availableAudioModes() const;
+    bool micMute() const;
+
+    void setCallMode(CallStatus callstatus, AudioMode audiomode);
+    /* Same, also updating the mic mute state in the same pass */
+    void setCallMode(CallStatus callstatus, AudioMode audiomode, bool micmute);
+    void setMicMute(bool muted);
+    /* Resolves in advance the route of a call that is about to become active */
+    void prepareCall(AudioMode audiomode);
+    /* Number of times a call got activated with the route resolved by prepareCall() */
+    int preparedRouteHits() const;
+    /* Sets the route of an ongoing call up again, e.g. after the audio system restarted */
+    void reapply();
+
+    /* Card events */
+    void cardAdded(const AudioCard &card);
+    void cardChanged(const AudioCard &card);
+    void cardRemoved();
+
+Q_SIGNALS:
+    void audioModeChanged(const AudioMode mode);
+    void availableAudioModesChanged(const AudioModes modes);
+    void routeSwitched(qint64 elapsedUsecs);
+    void callAudioActivated();
+
+private:
+    int setupVoiceCall();
+    void restoreVoiceCall();
+    void resolveRoute(AudioRoute &route, bool forceport);
+
+    AudioBackend *mBackend;
+    CallStatus mCallStatus;
+    AudioMode mAudioMode;
+    AudioModes mAvailableAudioModes;
+    bool mMicMute;
+    std::string mForcedSink, mForcedSource;
+    std::string mDefaultSink, mDefaultSource;
+    VoiceCallCards mCards;
+    /* Route resolved while ringing, valid as long as the backend generation did not change */
+    AudioRoute mPrepared;
+    int mPreparedRouteHits;
+};
+
+#endif
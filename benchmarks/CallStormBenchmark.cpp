@@ -0,0 +1,334 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusInterface>
+#include <QDBusPendingCallWatcher>
+#include <QDBusReply>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <TelepathyQt/CallChannel>
+#include <TelepathyQt/Types>
+
+#include "benchmarkhelper.h"
+#include "telepathyhelper.h"
+#include "handler.h"
+#include "approvercall.h"
+#include "mock/mock_common.h"
+
+// time allowed for each step of the scenario (msecs)
+#define STEP_TIMEOUT 10000
+// interval between two probes of the connection main loop (msecs)
+#define PROBE_INTERVAL 20
+
+Q_DECLARE_METATYPE(Tp::CallChannelPtr);
+
+// Drives bursts of call signalling through the ofono mock: incoming, waiting,
+// hold/swap, multiparty merge/split and hangup. It measures the time from each
+// ofono signal to the matching Telepathy call state change, while probing how
+// long the connection main loop takes to answer D-Bus calls.
+class CallStormBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    CallStormBenchmark(int iterations, QObject *parent = 0);
+    bool run();
+    QJsonObject result() const;
+
+private Q_SLOTS:
+    void onNewCall();
+    void onCallChannelAvailable(Tp::CallChannelPtr channel);
+    void probeMainLoop();
+    void onProbeFinished(QDBusPendingCallWatcher *watcher);
+
+private:
+    bool runIteration(int iteration);
+    bool step(const QString &stage, qint64 start, const std::function<bool()> &condition);
+    qint64 now() const;
+
+    QString incomingCall(const QString &number);
+    void callMethod(const QString &path, const QString &method);
+    void setCallState(const QString &path, const QString &state);
+    Tp::CallChannelPtr channelFor(const QString &number) const;
+
+    int mIterations;
+    int mCompleted;
+    QString mFailedStage;
+    Handler *mHandler;
+    Approver *mApprover;
+    QElapsedTimer mClock;
+    int mNewCalls;
+    QList<Tp::CallChannelPtr> mChannels;
+    Tp::CallChannelPtr mConference;
+    QMap<QString, QList<qint64> > mLatencies;
+
+    QTimer mProbeTimer;
+    QDBusInterface *mProbeInterface;
+    qint64 mProbeStart;
+    QList<qint64> mProbeLatencies;
+};
+
+CallStormBenchmark::CallStormBenchmark(int iterations, QObject *parent)
+    : QObject(parent),
+      mIterations(iterations),
+      mCompleted(0),
+      mHandler(new Handler(this)),
+      mApprover(new Approver(this)),
+      mNewCalls(0),
+      mProbeInterface(0),
+      mProbeStart(-1)
+{
+    connect(mApprover, SIGNAL(newCall()), SLOT(onNewCall()));
+    connect(mHandler, SIGNAL(callChannelAvailable(Tp::CallChannelPtr)),
+            SLOT(onCallChannelAvailable(Tp::CallChannelPtr)));
+    mProbeTimer.setInterval(PROBE_INTERVAL);
+    connect(&mProbeTimer, SIGNAL(timeout()), SLOT(probeMainLoop()));
+}
+
+bool CallStormBenchmark::run()
+{
+    if (!BenchmarkHelper::setUpConnection(mHandler, "TpOfonoTestHandler", mApprover, "TpOfonoTestApprover")) {
+        return false;
+    }
+
+    Tp::ConnectionPtr connection = TelepathyHelper::instance()->account()->connection();
+    mProbeInterface = new QDBusInterface(connection->busName(), connection->objectPath(),
+                                         "org.freedesktop.DBus.Properties", QDBusConnection::sessionBus(), this);
+    mClock.start();
+    mProbeTimer.start();
+    for (int i = 0; i < mIterations; i++) {
+        if (!runIteration(i)) {
+            qWarning() << "Iteration" << i << "failed at" << mFailedStage;
+            break;
+        }
+        mCompleted++;
+    }
+    mProbeTimer.stop();
+    return true;
+}
+
+qint64 CallStormBenchmark::now() const
+{
+    return mClock.nsecsElapsed() / 1000;
+}
+
+bool CallStormBenchmark::step(const QString &stage, qint64 start, const std::function<bool()> &condition)
+{
+    if (!BenchmarkHelper::waitFor(condition, STEP_TIMEOUT)) {
+        mFailedStage = stage;
+        return false;
+    }
+    mLatencies[stage] << now() - start;
+    return true;
+}
+
+bool CallStormBenchmark::runIteration(int iteration)
+{
+    QString numberA = QString("666%1").arg(iteration * 2, 4, 10, QChar('0'));
+    QString numberB = QString("666%1").arg(iteration * 2 + 1, 4, 10, QChar('0'));
+    mChannels.clear();
+    mConference.reset();
+
+    // incoming call, until it reaches the approver
+    int newCalls = mNewCalls;
+    qint64 start = now();
+    QString pathA = incomingCall(numberA);
+    if (!step("incoming", start, [&]() { return mNewCalls > newCalls; })) {
+        return false;
+    }
+    mApprover->acceptCall();
+    if (!step("dispatch", start, [&]() { return !channelFor(numberA).isNull(); })) {
+        return false;
+    }
+    Tp::CallChannelPtr channelA = channelFor(numberA);
+
+    start = now();
+    callMethod(pathA, "Answer");
+    if (!step("answer", start, [&]() { return channelA->callState() == Tp::CallStateActive; })) {
+        return false;
+    }
+
+    // a second call while the first one is active
+    newCalls = mNewCalls;
+    start = now();
+    QString pathB = incomingCall(numberB);
+    setCallState(pathB, "waiting");
+    if (!step("waiting", start, [&]() { return mNewCalls > newCalls; })) {
+        return false;
+    }
+    mApprover->acceptCall();
+    if (!BenchmarkHelper::waitFor([&]() { return !channelFor(numberB).isNull(); }, STEP_TIMEOUT)) {
+        mFailedStage = "waiting dispatch";
+        return false;
+    }
+    Tp::CallChannelPtr channelB = channelFor(numberB);
+
+    // answering the waiting call holds the active one
+    start = now();
+    setCallState(pathA, "held");
+    setCallState(pathB, "active");
+    if (!step("hold", start, [&]() {
+            return channelA->localHoldState() == Tp::LocalHoldStateHeld &&
+                   channelB->callState() == Tp::CallStateActive;
+        })) {
+        return false;
+    }
+
+    start = now();
+    QDBusInterface("org.ofono", OFONO_MOCK_VOICECALL_MANAGER_OBJECT, "org.ofono.VoiceCallManager").call("SwapCalls");
+    if (!step("swap", start, [&]() {
+            return channelA->localHoldState() == Tp::LocalHoldStateUnheld &&
+                   channelB->localHoldState() == Tp::LocalHoldStateHeld;
+        })) {
+        return false;
+    }
+
+    // the merge and the split are requested by the client
+    start = now();
+    TelepathyHelper::instance()->account()->createConferenceCall(QList<Tp::ChannelPtr>() << channelA << channelB,
+                                                                 QStringList(), QDateTime::currentDateTime(),
+                                                                 TP_QT_IFACE_CLIENT + ".TpOfonoTestHandler");
+    if (!step("merge", start, [&]() { return !mConference.isNull(); })) {
+        return false;
+    }
+
+    start = now();
+    channelB->conferenceSplitChannel();
+    if (!step("split", start, [&]() { return mConference->callState() == Tp::CallStateEnded; })) {
+        return false;
+    }
+
+    start = now();
+    callMethod(pathA, "Hangup");
+    callMethod(pathB, "Hangup");
+    return step("hangup", start, [&]() {
+        return channelA->callState() == Tp::CallStateEnded &&
+               channelB->callState() == Tp::CallStateEnded;
+    });
+}
+
+QString CallStormBenchmark::incomingCall(const QString &number)
+{
+    QDBusInterface manager("org.ofono", OFONO_MOCK_VOICECALL_MANAGER_OBJECT, "org.ofono.VoiceCallManager");
+    QDBusReply<QDBusObjectPath> reply = manager.call("MockIncomingCall", number);
+    return reply.value().path();
+}
+
+void CallStormBenchmark::callMethod(const QString &path, const QString &method)
+{
+    QDBusInterface("org.ofono", path, "org.ofono.VoiceCall").call(method);
+}
+
+void CallStormBenchmark::setCallState(const QString &path, const QString &state)
+{
+    QDBusInterface("org.ofono", path, "org.ofono.VoiceCall").call("SetProperty", "State",
+                                                                   QVariant::fromValue(QDBusVariant(state)));
+}
+
+Tp::CallChannelPtr CallStormBenchmark::channelFor(const QString &number) const
+{
+    Q_FOREACH(const Tp::CallChannelPtr &channel, mChannels) {
+        if (channel->targetId().endsWith(number)) {
+            return channel;
+        }
+    }
+    return Tp::CallChannelPtr();
+}
+
+void CallStormBenchmark::onNewCall()
+{
+    mNewCalls++;
+}
+
+void CallStormBenchmark::onCallChannelAvailable(Tp::CallChannelPtr channel)
+{
+    if (channel->isConference()) {
+        mConference = channel;
+    } else {
+        mChannels << channel;
+    }
+}
+
+void CallStormBenchmark::probeMainLoop()
+{
+    // only one probe in flight, so a stall shows up as a single long probe
+    if (mProbeStart >= 0) {
+        return;
+    }
+    mProbeStart = now();
+    QDBusPendingCall call = mProbeInterface->asyncCall("Get", TP_QT_IFACE_CONNECTION, "Status");
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), SLOT(onProbeFinished(QDBusPendingCallWatcher*)));
+}
+
+void CallStormBenchmark::onProbeFinished(QDBusPendingCallWatcher *watcher)
+{
+    mProbeLatencies << now() - mProbeStart;
+    mProbeStart = -1;
+    watcher->deleteLater();
+}
+
+QJsonObject CallStormBenchmark::result() const
+{
+    QJsonObject parameters;
+    parameters["iterations"] = mIterations;
+
+    QJsonObject latencies;
+    QMap<QString, QList<qint64> >::const_iterator it;
+    for (it = mLatencies.constBegin(); it != mLatencies.constEnd(); ++it) {
+        latencies[it.key()] = BenchmarkHelper::latencyStatistics(it.value());
+    }
+
+    QJsonObject result;
+    result["benchmark"] = QString("call-storm");
+    result["parameters"] = parameters;
+    result["completed"] = mCompleted;
+    if (!mFailedStage.isEmpty()) {
+        result["failed_stage"] = mFailedStage;
+    }
+    result["latency_ms"] = latencies;
+    // the worst case is the max of the probes
+    result["mainloop_probe_ms"] = BenchmarkHelper::latencyStatistics(mProbeLatencies);
+    result["metrics"] = BenchmarkHelper::connectionMetrics();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    Tp::registerTypes();
+    qRegisterMetaType<Tp::CallChannelPtr>();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the call signalling latency under bursts of call events");
+    parser.addHelpOption();
+    QCommandLineOption iterationsOption("iterations", "Number of times the scenario is run.", "count", "20");
+    QCommandLineOption outputOption("output", "JSON output file, - for stdout.", "file", "-");
+    parser.addOption(iterationsOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    CallStormBenchmark benchmark(parser.value(iterationsOption).toInt());
+    if (!benchmark.run()) {
+        return 1;
+    }
+    return BenchmarkHelper::writeResult(benchmark.result(), parser.value(outputOption)) ? 0 : 1;
+}
+
+#include "CallStormBenchmark.moc"
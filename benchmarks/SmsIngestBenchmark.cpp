@@ -0,0 +1,207 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTimer>
+#include <climits>
+
+#include <TelepathyQt/ReceivedMessage>
+#include <TelepathyQt/TextChannel>
+#include <TelepathyQt/Types>
+
+#include "benchmarkhelper.h"
+#include "ofonomockcontroller.h"
+#include "handler.h"
+#include "approvertext.h"
+
+#define MESSAGE_PREFIX "sms-ingest "
+// time to wait for the last messages after all of them were injected (msecs)
+#define DRAIN_TIMEOUT 60000
+
+Q_DECLARE_METATYPE(Tp::TextChannelPtr);
+
+// Injects incoming SMS through the ofono mock and measures how long they take
+// to reach a Telepathy client
+class SmsIngestBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    SmsIngestBenchmark(int messages, int senders, int rate, QObject *parent = 0);
+    bool run();
+    QJsonObject result() const;
+
+private Q_SLOTS:
+    void onTextChannelAvailable(Tp::TextChannelPtr channel);
+    void onMessageReceived(const Tp::ReceivedMessage &message);
+    void injectNext();
+
+private:
+    void processMessage(Tp::TextChannel *channel, const Tp::ReceivedMessage &message);
+
+    int mMessages;
+    int mSenders;
+    int mRate;
+    Handler *mHandler;
+    Approver *mApprover;
+    QTimer mInjectTimer;
+    QElapsedTimer mClock;
+    int mSent;
+    // injection time of each message in usecs
+    QHash<int, qint64> mSentAt;
+    QList<qint64> mLatencies;
+    qint64 mFirstSent;
+    qint64 mLastReceived;
+};
+
+SmsIngestBenchmark::SmsIngestBenchmark(int messages, int senders, int rate, QObject *parent)
+    : QObject(parent),
+      mMessages(messages),
+      mSenders(qMax(senders, 1)),
+      mRate(rate),
+      mHandler(new Handler(this)),
+      mApprover(new Approver(this)),
+      mSent(0),
+      mFirstSent(-1),
+      mLastReceived(-1)
+{
+    // a rate of 0 injects the messages as fast as the connection accepts them
+    mInjectTimer.setInterval(mRate > 0 ? qMax(1000 / mRate, 1) : 0);
+    connect(&mInjectTimer, SIGNAL(timeout()), SLOT(injectNext()));
+    connect(mHandler, SIGNAL(textChannelAvailable(Tp::TextChannelPtr)),
+            SLOT(onTextChannelAvailable(Tp::TextChannelPtr)));
+}
+
+bool SmsIngestBenchmark::run()
+{
+    if (!BenchmarkHelper::setUpConnection(mHandler, "TpOfonoTestHandler", mApprover, "TpOfonoTestApprover")) {
+        return false;
+    }
+
+    mClock.start();
+    mInjectTimer.start();
+    BenchmarkHelper::waitFor([this]() { return mSent == mMessages; }, INT_MAX);
+    BenchmarkHelper::waitFor([this]() { return mLatencies.size() == mMessages; }, DRAIN_TIMEOUT);
+    if (mLatencies.size() != mMessages) {
+        qWarning() << "Only" << mLatencies.size() << "of" << mMessages << "messages were received";
+    }
+    return true;
+}
+
+void SmsIngestBenchmark::injectNext()
+{
+    if (mSent == mMessages) {
+        mInjectTimer.stop();
+        return;
+    }
+
+    int sequence = mSent++;
+    QString sender = QString("555%1").arg(sequence % mSenders, 4, 10, QChar('0'));
+    qint64 now = mClock.nsecsElapsed() / 1000;
+    if (mFirstSent < 0) {
+        mFirstSent = now;
+    }
+    mSentAt[sequence] = now;
+    OfonoMockController::instance()->MessageManagerSendMessage(sender, MESSAGE_PREFIX + QString::number(sequence));
+}
+
+void SmsIngestBenchmark::onTextChannelAvailable(Tp::TextChannelPtr channel)
+{
+    connect(channel.data(), SIGNAL(messageReceived(Tp::ReceivedMessage)),
+            SLOT(onMessageReceived(Tp::ReceivedMessage)));
+    // messages received before the channel got ready are already queued
+    Q_FOREACH(const Tp::ReceivedMessage &message, channel->messageQueue()) {
+        processMessage(channel.data(), message);
+    }
+}
+
+void SmsIngestBenchmark::onMessageReceived(const Tp::ReceivedMessage &message)
+{
+    processMessage(qobject_cast<Tp::TextChannel*>(sender()), message);
+}
+
+void SmsIngestBenchmark::processMessage(Tp::TextChannel *channel, const Tp::ReceivedMessage &message)
+{
+    qint64 now = mClock.nsecsElapsed() / 1000;
+    // keep the queue short, as a real client would
+    channel->acknowledge(QList<Tp::ReceivedMessage>() << message);
+
+    QString text = message.text();
+    if (!text.startsWith(MESSAGE_PREFIX)) {
+        return;
+    }
+    int sequence = text.mid(QString(MESSAGE_PREFIX).size()).toInt();
+    if (!mSentAt.contains(sequence)) {
+        return;
+    }
+    mLatencies << now - mSentAt.take(sequence);
+    mLastReceived = now;
+}
+
+QJsonObject SmsIngestBenchmark::result() const
+{
+    QJsonObject parameters;
+    parameters["messages"] = mMessages;
+    parameters["senders"] = mSenders;
+    parameters["rate"] = mRate;
+
+    QJsonObject result;
+    result["benchmark"] = QString("sms-ingest");
+    result["parameters"] = parameters;
+    result["sent"] = mSent;
+    result["received"] = mLatencies.size();
+    if (mLastReceived > mFirstSent && mFirstSent >= 0) {
+        qint64 duration = mLastReceived - mFirstSent;
+        result["duration_ms"] = duration / 1000.0;
+        result["throughput_per_sec"] = mLatencies.size() * 1000000.0 / duration;
+    }
+    result["latency_ms"] = BenchmarkHelper::latencyStatistics(mLatencies);
+    result["metrics"] = BenchmarkHelper::connectionMetrics();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    Tp::registerTypes();
+    qRegisterMetaType<Tp::TextChannelPtr>();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the latency and throughput of incoming SMS");
+    parser.addHelpOption();
+    QCommandLineOption messagesOption("messages", "Number of messages to inject.", "count", "500");
+    QCommandLineOption sendersOption("senders", "Number of distinct senders.", "count", "10");
+    QCommandLineOption rateOption("rate", "Messages per second, 0 for no limit.", "rate", "50");
+    QCommandLineOption outputOption("output", "JSON output file, - for stdout.", "file", "-");
+    parser.addOption(messagesOption);
+    parser.addOption(sendersOption);
+    parser.addOption(rateOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    SmsIngestBenchmark benchmark(parser.value(messagesOption).toInt(),
+                                 parser.value(sendersOption).toInt(),
+                                 parser.value(rateOption).toInt());
+    if (!benchmark.run()) {
+        return 1;
+    }
+    return BenchmarkHelper::writeResult(benchmark.result(), parser.value(outputOption)) ? 0 : 1;
+}
+
+#include "SmsIngestBenchmark.moc"
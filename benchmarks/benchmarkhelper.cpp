@@ -0,0 +1,175 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusInterface>
+#include <QDBusReply>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTest>
+#include <QtAlgorithms>
+
+#include <TelepathyQt/AbstractClient>
+#include <TelepathyQt/Connection>
+
+#include <stdio.h>
+
+#include "benchmarkhelper.h"
+#include "telepathyhelper.h"
+#include "ofonomockcontroller.h"
+
+#define METRICS_INTERFACE "com.canonical.Telephony.Metrics"
+// time given to mission-control to pick up the handler and approver (msecs)
+#define CLIENT_REGISTRATION_DELAY 10000
+#define CONNECTION_TIMEOUT 30000
+
+static double toMsecs(qint64 usecs)
+{
+    return usecs / 1000.0;
+}
+
+bool BenchmarkHelper::waitFor(const std::function<bool()> &condition, int timeoutMsecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!condition()) {
+        if (timer.elapsed() > timeoutMsecs) {
+            return false;
+        }
+        QTest::qWait(5);
+    }
+    return true;
+}
+
+bool BenchmarkHelper::setUpConnection(Tp::AbstractClient *handler, const QString &handlerName,
+                                      Tp::AbstractClient *approver, const QString &approverName)
+{
+    bool accountReady = false;
+    QObject::connect(TelepathyHelper::instance(), &TelepathyHelper::accountReady, [&accountReady]() {
+        accountReady = true;
+    });
+    if (!waitFor([&accountReady]() { return accountReady; }, CONNECTION_TIMEOUT)) {
+        qWarning() << "The account did not become ready";
+        return false;
+    }
+
+    OfonoMockController::instance()->SimManagerSetPresence(true);
+    OfonoMockController::instance()->SimManagerSetPinRequired("none");
+    OfonoMockController::instance()->ModemSetOnline();
+    OfonoMockController::instance()->NetworkRegistrationSetStatus("registered");
+    if (!waitFor([]() { return TelepathyHelper::instance()->connected(); }, CONNECTION_TIMEOUT)) {
+        qWarning() << "The account did not connect";
+        return false;
+    }
+
+    TelepathyHelper::instance()->registerClient(handler, handlerName);
+    TelepathyHelper::instance()->registerClient(approver, approverName);
+    QString approverService = TP_QT_IFACE_CLIENT + "." + approverName;
+    if (!waitFor([approverService]() {
+            return QDBusConnection::sessionBus().interface()->isServiceRegistered(approverService).value();
+        }, CONNECTION_TIMEOUT)) {
+        qWarning() << "The approver was not registered";
+        return false;
+    }
+
+    QTest::qWait(CLIENT_REGISTRATION_DELAY);
+    return true;
+}
+
+QJsonObject BenchmarkHelper::latencyStatistics(QList<qint64> latencies)
+{
+    QJsonObject statistics;
+    statistics["count"] = latencies.size();
+    if (latencies.isEmpty()) {
+        return statistics;
+    }
+
+    qSort(latencies);
+    qint64 sum = 0;
+    Q_FOREACH(qint64 latency, latencies) {
+        sum += latency;
+    }
+    // nearest rank percentiles
+    auto percentile = [&latencies](int p) {
+        int rank = qMax(1, (p * latencies.size() + 99) / 100);
+        return toMsecs(latencies[rank - 1]);
+    };
+
+    statistics["mean"] = toMsecs(sum / latencies.size());
+    statistics["min"] = toMsecs(latencies.first());
+    statistics["p50"] = percentile(50);
+    statistics["p90"] = percentile(90);
+    statistics["p99"] = percentile(99);
+    statistics["max"] = toMsecs(latencies.last());
+    return statistics;
+}
+
+QJsonObject BenchmarkHelper::connectionMetrics()
+{
+    QJsonObject metrics;
+    Tp::ConnectionPtr connection = TelepathyHelper::instance()->account()->connection();
+    if (connection.isNull()) {
+        return metrics;
+    }
+
+    QDBusInterface interface(connection->busName(), connection->objectPath(), METRICS_INTERFACE);
+    QDBusReply<QVariantMap> reply = interface.call("GetMetrics");
+    if (!reply.isValid()) {
+        qWarning() << "Failed to get the connection metrics:" << reply.error().message();
+        return metrics;
+    }
+
+    QVariantMap values = reply.value();
+    QVariantMap::const_iterator it;
+    for (it = values.constBegin(); it != values.constEnd(); ++it) {
+        if (it.value().userType() != qMetaTypeId<QDBusArgument>()) {
+            metrics[it.key()] = it.value().toDouble();
+            continue;
+        }
+        // histograms, the buckets are left out
+        QVariantMap histogram = qdbus_cast<QVariantMap>(it.value().value<QDBusArgument>());
+        QJsonObject summary;
+        summary["count"] = histogram["count"].toDouble();
+        summary["mean"] = histogram["count"].toDouble() > 0 ?
+                    toMsecs(histogram["sum"].toLongLong() / histogram["count"].toLongLong()) : 0;
+        summary["min"] = toMsecs(histogram["min"].toLongLong());
+        summary["max"] = toMsecs(histogram["max"].toLongLong());
+        metrics[it.key()] = summary;
+    }
+    return metrics;
+}
+
+bool BenchmarkHelper::writeResult(const QJsonObject &result, const QString &output)
+{
+    QByteArray json = QJsonDocument(result).toJson();
+    if (output.isEmpty() || output == "-") {
+        fprintf(stdout, "%s", json.constData());
+        return true;
+    }
+
+    QFile file(output);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to write the result to" << output;
+        return false;
+    }
+    file.write(json);
+    return true;
+}
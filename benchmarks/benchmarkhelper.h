@@ -0,0 +1,52 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCHMARKHELPER_H
+#define BENCHMARKHELPER_H
+
+#include <functional>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+namespace Tp {
+class AbstractClient;
+}
+
+// Shared setup and reporting of the benchmarks that drive telepathy-ofono
+// through the ofono mock. Latencies are given in usecs and reported in msecs.
+class BenchmarkHelper
+{
+public:
+    // processes events until the condition is true or the timeout expires
+    static bool waitFor(const std::function<bool()> &condition, int timeoutMsecs);
+
+    // brings the mock modem online, waits for the account to connect and
+    // registers the given handler and approver
+    static bool setUpConnection(Tp::AbstractClient *handler, const QString &handlerName,
+                                Tp::AbstractClient *approver, const QString &approverName);
+
+    // count, mean, min, max and the p50, p90, p99 percentiles
+    static QJsonObject latencyStatistics(QList<qint64> latencies);
+
+    // the counters and histogram summaries exported by the metrics interface
+    static QJsonObject connectionMetrics();
+
+    // "-" or an empty output means stdout
+    static bool writeResult(const QJsonObject &result, const QString &output);
+};
+
+#endif
@@ -41,41 +41,11 @@
 #include "sqlitedatabase.h"
 #include "pendingmessagesmanager.h"
 #include "dbustypes.h"
-
-static void enable_earpiece()
-{
-#ifdef USE_PULSEAUDIO
-    QPulseAudioEngine::instance()->setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
-#endif
-}
-
-static void enable_normal()
-{
-#ifdef USE_PULSEAUDIO
-    QTimer* timer = new QTimer();
-    timer->setSingleShot(true);
-    QObject::connect(timer, &QTimer::timeout, [=](){
-        QPulseAudioEngine::instance()->setMicMute(false);
-        QPulseAudioEngine::instance()->setCallMode(CallEnded, AudioModeWiredOrSpeaker);
-        timer->deleteLater();
-    });
-    timer->start(2000);
-#endif
-}
-
-static void enable_speaker()
-{
-#ifdef USE_PULSEAUDIO
-    QPulseAudioEngine::instance()->setCallMode(CallActive, AudioModeSpeaker);
-#endif
-}
-
-static void enable_ringtone()
-{
-#ifdef USE_PULSEAUDIO
-    QPulseAudioEngine::instance()->setCallMode(CallRinging, AudioModeWiredOrSpeaker);
-#endif
-}
+#include "startupprofiler.h"
+#include "metrics.h"
+#include "stallwatchdog.h"
+#include "tracing.h"
+#include "logging.h"
 
 oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
                             const QString &cmName,
@@ -86,8 +56,13 @@ oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
     mHandleCount(0),
     mGroupHandleCount(0),
     mMmsdManager(new MMSDManager(this)),
-    mConferenceCall(NULL)
+    mConferenceCall(NULL),
+    mStartupFinished(false),
+    mAudioRouteScheduler(new AudioRouteScheduler(this)),
+    mModemRequestScheduler(new ModemRequestScheduler(this))
 {
+    StallScope stallScope("connection.create");
+    mStartupBegin = StartupProfiler::instance()->elapsed();
     qRegisterMetaType<AudioOutputList>();
     qRegisterMetaType<AudioOutput>();
     OfonoModem::SelectionSetting setting = OfonoModem::AutomaticSelect;
@@ -95,14 +70,22 @@ oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
     if (!mModemPath.isEmpty()) {
         setting = OfonoModem::ManualSelect;
     }
-    mOfonoMessageManager = new OfonoMessageManager(setting, mModemPath);
+    mModemSetting = setting;
+
+    // only the interfaces needed to publish the connection and handle calls are
+    // created here, the others are created by finishStartup() once the connection
+    // is on the bus
+    mOfonoSimManager = new OfonoSimManager(setting, mModemPath);
+    mOfonoModem = mOfonoSimManager->modem();
+    markStartupStage("sim");
     mOfonoVoiceCallManager = new OfonoVoiceCallManager(setting, mModemPath);
+    markStartupStage("voicecalls");
     mOfonoCallVolume = new OfonoCallVolume(setting, mModemPath);
     mOfonoNetworkRegistration = new OfonoNetworkRegistration(setting, mModemPath);
-    mOfonoMessageWaiting = new OfonoMessageWaiting(setting, mModemPath);
-    mOfonoSupplementaryServices = new OfonoSupplementaryServices(setting, mModemPath);
-    mOfonoSimManager = new OfonoSimManager(setting, mModemPath);
-    mOfonoModem = mOfonoSimManager->modem();
+    markStartupStage("network");
+    mOfonoMessageManager = NULL;
+    mOfonoMessageWaiting = NULL;
+    mOfonoSupplementaryServices = NULL;
 
     if (mOfonoSimManager->subscriberNumbers().size() > 0) {
         setSelfHandle(newHandle(mOfonoSimManager->subscriberNumbers()[0]));
@@ -184,10 +167,16 @@ oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
     supplementaryServicesIface->setInitiateCallback(Tp::memFun(this,&oFonoConnection::USSDInitiate));
     supplementaryServicesIface->setRespondCallback(Tp::memFun(this,&oFonoConnection::USSDRespond));
     supplementaryServicesIface->setCancelCallback(Tp::memFun(this,&oFonoConnection::USSDCancel));
-    supplementaryServicesIface->StateChanged(mOfonoSupplementaryServices->state());
     supplementaryServicesIface->setSerial(mOfonoModem->serial());
     plugInterface(Tp::AbstractConnectionInterfacePtr::dynamicCast(supplementaryServicesIface));
 
+    // init custom metrics interface (not provided by telepathy)
+    metricsIface = BaseConnectionMetricsInterface::create();
+    metricsIface->setGetMetricsCallback(Tp::memFun(this,&oFonoConnection::metrics));
+    metricsIface->setFlushTraceCallback(Tp::memFun(this,&oFonoConnection::flushTrace));
+    plugInterface(Tp::AbstractConnectionInterfacePtr::dynamicCast(metricsIface));
+    QObject::connect(Metrics::instance(), SIGNAL(updated()), SLOT(onMetricsUpdated()));
+
     // Set Presence
     Tp::SimpleStatusSpec presenceOnline;
     presenceOnline.type = Tp::ConnectionPresenceTypeAvailable;
@@ -234,9 +223,6 @@ oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
     QObject::connect(mOfonoModem, SIGNAL(onlineChanged(bool)), SLOT(updateOnlineStatus()));
     QObject::connect(mOfonoModem, SIGNAL(serialChanged(QString)), supplementaryServicesIface.data(), SLOT(setSerial(QString)));
     QObject::connect(mOfonoModem, SIGNAL(interfacesChanged(QStringList)), SLOT(updateOnlineStatus()));
-    QObject::connect(mOfonoMessageManager, SIGNAL(incomingMessage(QString,QVariantMap)), this, SLOT(onOfonoIncomingMessage(QString,QVariantMap)));
-    QObject::connect(mOfonoMessageManager, SIGNAL(immediateMessage(QString,QVariantMap)), this, SLOT(onOfonoImmediateMessage(QString,QVariantMap)));
-    QObject::connect(mOfonoMessageManager, SIGNAL(statusReport(QString,QVariantMap)), this, SLOT(onDeliveryReportReceived(QString,QVariantMap)));
     QObject::connect(mOfonoVoiceCallManager, SIGNAL(callAdded(QString,QVariantMap)), SLOT(onOfonoCallAdded(QString, QVariantMap)));
     QObject::connect(mOfonoVoiceCallManager, SIGNAL(validityChanged(bool)), SLOT(onValidityChanged(bool)));
     QObject::connect(mOfonoSimManager, SIGNAL(validityChanged(bool)), SLOT(onValidityChanged(bool)));
@@ -247,9 +233,6 @@ oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
     QObject::connect(mOfonoNetworkRegistration, SIGNAL(nameChanged(QString)), SLOT(updateOnlineStatus()));
     QObject::connect(mOfonoNetworkRegistration, SIGNAL(mccChanged(QString)), SLOT(updateOnlineStatus(QString)));
     QObject::connect(mOfonoNetworkRegistration, SIGNAL(validityChanged(bool)), SLOT(onValidityChanged(bool)));
-    QObject::connect(mOfonoMessageWaiting, SIGNAL(voicemailMessageCountChanged(int)), voicemailIface.data(), SLOT(setVoicemailCount(int)));
-    QObject::connect(mOfonoMessageWaiting, SIGNAL(voicemailWaitingChanged(bool)), voicemailIface.data(), SLOT(setVoicemailIndicator(bool)));
-    QObject::connect(mOfonoMessageWaiting, SIGNAL(voicemailMailboxNumberChanged(QString)), voicemailIface.data(), SLOT(setVoicemailNumber(QString)));
 
     QObject::connect(mMmsdManager, SIGNAL(serviceAdded(const QString&)), SLOT(onMMSDServiceAdded(const QString&)));
     QObject::connect(mMmsdManager, SIGNAL(serviceRemoved(const QString&)), SLOT(onMMSDServiceRemoved(const QString&)));
@@ -259,6 +242,8 @@ oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
     QObject::connect(mOfonoVoiceCallManager, SIGNAL(callRemoved(QString)), SLOT(updateAudioRoute()));
 
 #ifdef USE_PULSEAUDIO
+    QObject::connect(mAudioRouteScheduler, SIGNAL(routeChanged(AudioRouteScheduler::Route)), SLOT(onAudioRouteChanged(AudioRouteScheduler::Route)));
+
     // update audio modes
     QObject::connect(QPulseAudioEngine::instance(), SIGNAL(audioModeChanged(AudioMode)), SLOT(onAudioModeChanged(AudioMode)));
     QObject::connect(QPulseAudioEngine::instance(), SIGNAL(availableAudioModesChanged(AudioModes)), SLOT(onAvailableAudioModesChanged(AudioModes)));
@@ -270,6 +255,36 @@ oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
         mHasPulseAudio = false;
 #endif
 
+    QObject::connect(this, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    // workaround: we can't add services here as tp-ofono interfaces are not exposed on dbus
+    // todo: use QDBusServiceWatcher
+    QTimer::singleShot(1000, this, SLOT(onCheckMMSServices()));
+
+    markStartupStage("interfaces");
+    QMetaObject::invokeMethod(this, "finishStartup", Qt::QueuedConnection);
+}
+
+void oFonoConnection::finishStartup()
+{
+    if (mStartupFinished) {
+        return;
+    }
+    mStartupFinished = true;
+    StallScope stallScope("connection.finishStartup");
+
+    mOfonoMessageManager = new OfonoMessageManager(mModemSetting, mModemPath);
+    QObject::connect(mOfonoMessageManager, SIGNAL(incomingMessage(QString,QVariantMap)), this, SLOT(onOfonoIncomingMessage(QString,QVariantMap)));
+    QObject::connect(mOfonoMessageManager, SIGNAL(immediateMessage(QString,QVariantMap)), this, SLOT(onOfonoImmediateMessage(QString,QVariantMap)));
+    QObject::connect(mOfonoMessageManager, SIGNAL(statusReport(QString,QVariantMap)), this, SLOT(onDeliveryReportReceived(QString,QVariantMap)));
+    markStartupStage("messages");
+
+    mOfonoMessageWaiting = new OfonoMessageWaiting(mModemSetting, mModemPath);
+    QObject::connect(mOfonoMessageWaiting, SIGNAL(voicemailMessageCountChanged(int)), voicemailIface.data(), SLOT(setVoicemailCount(int)));
+    QObject::connect(mOfonoMessageWaiting, SIGNAL(voicemailWaitingChanged(bool)), voicemailIface.data(), SLOT(setVoicemailIndicator(bool)));
+    QObject::connect(mOfonoMessageWaiting, SIGNAL(voicemailMailboxNumberChanged(QString)), voicemailIface.data(), SLOT(setVoicemailNumber(QString)));
+    markStartupStage("voicemail");
+
+    mOfonoSupplementaryServices = new OfonoSupplementaryServices(mModemSetting, mModemPath);
     QObject::connect(mOfonoSupplementaryServices, SIGNAL(notificationReceived(const QString &)), supplementaryServicesIface.data(), SLOT(NotificationReceived(const QString &)));
     QObject::connect(mOfonoSupplementaryServices, SIGNAL(requestReceived(const QString &)), supplementaryServicesIface.data(), SLOT(RequestReceived(const QString &)));
 
@@ -301,11 +316,28 @@ oFonoConnection::oFonoConnection(const QDBusConnection &dbusConnection,
     QObject::connect(mOfonoSupplementaryServices, SIGNAL(stateChanged(const QString&)), supplementaryServicesIface.data(), SLOT(StateChanged(const QString&)));
 
     QObject::connect(mOfonoSupplementaryServices, SIGNAL(respondComplete(bool, const QString &)), supplementaryServicesIface.data(), SLOT(RespondComplete(bool, const QString &)));
+    supplementaryServicesIface->StateChanged(mOfonoSupplementaryServices->state());
+    markStartupStage("ussd");
 
-    QObject::connect(this, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
-    // workaround: we can't add services here as tp-ofono interfaces are not exposed on dbus
-    // todo: use QDBusServiceWatcher
-    QTimer::singleShot(1000, this, SLOT(onCheckMMSServices()));
+    QStringList report;
+    Q_FOREACH(const StartupStage &stage, mStartupStages) {
+        report << QString("%1 %2ms").arg(stage.first).arg(stage.second / 1000.0);
+    }
+    qint64 total = StartupProfiler::instance()->elapsed() - mStartupBegin;
+    qCDebug(lcConnection) << "oFonoConnection startup took" << total / 1000.0 << "ms:" << qPrintable(report.join(", "));
+}
+
+void oFonoConnection::markStartupStage(const QString &stage)
+{
+    // stages are consecutive, each one lasts since the end of the previous one
+    StartupProfiler *profiler = StartupProfiler::instance();
+    qint64 start = mStartupBegin;
+    Q_FOREACH(const StartupStage &previousStage, mStartupStages) {
+        start += previousStage.second;
+    }
+    qint64 duration = profiler->elapsed() - start;
+    mStartupStages << StartupStage(stage, duration);
+    profiler->record("connection." + stage, start, duration);
 }
 
 void oFonoConnection::onDisconnected()
@@ -334,18 +366,21 @@ void oFonoConnection::updateMcc()
     } else if (!mOfonoSimManager->mobileCountryCode().isEmpty()) {
         mcc = mOfonoSimManager->mobileCountryCode();
     }
-    PhoneUtils::setMcc(mcc);
-    emergencyModeIface->setCountryCode(PhoneUtils::countryCodeForMCC(mcc));
+    mNumberingContext.setMcc(mcc);
+    emergencyModeIface->setCountryCode(mNumberingContext.countryCode());
 }
 
 void oFonoConnection::onMMSDServiceAdded(const QString &path)
 {
+    if (mMmsdServices.contains(path)) {
+        return;
+    }
     MMSDService *service = new MMSDService(path, this);
     if (service->modemObjectPath() != mModemPath) {
         service->deleteLater();
         return;
     }
-    qDebug() << "oFonoConnection::onMMSServiceAdded" << path;
+    qCDebug(lcMms) << "oFonoConnection::onMMSServiceAdded" << path;
     mMmsdServices[path] = service;
     QObject::connect(service, SIGNAL(messageAdded(const QString&, const QVariantMap&)), SLOT(onMMSAdded(const QString&, const QVariantMap&)));
     QObject::connect(service, SIGNAL(messageRemoved(const QString&)), SLOT(onMMSRemoved(const QString&)));
@@ -358,9 +393,10 @@ QDBusObjectPath oFonoConnection::sendMMS(const QStringList &numbers, const Outgo
 {
     // FIXME: dualsim: mms's for now will only be sent using the first modem
     if (mMmsdServices.count() > 0) {
+        Metrics::instance()->increment("mms.out");
         return mMmsdServices.first()->sendMessage(numbers, attachments);
     }
-    qDebug() << "No mms service available";
+    qCDebug(lcMms) << "No mms service available";
     return QDBusObjectPath();
 }
 
@@ -368,19 +404,19 @@ void oFonoConnection::onMMSDServiceRemoved(const QString &path)
 {
     MMSDService *service = mMmsdServices.take(path);
     if (!service) {
-        qWarning() << "oFonoConnection::onMMSServiceRemoved failed" << path;
+        qCWarning(lcMms) << "oFonoConnection::onMMSServiceRemoved failed" << path;
         return;
     }
 
     // remove all messages from this service
     Q_FOREACH(MMSDMessage *message, mServiceMMSList[service->path()]) {
-        qDebug() << "removing message " <<  message->path() << " from service " << service->path();
+        qCDebug(lcMms) << "removing message " <<  message->path() << " from service " << service->path();
         message->deleteLater();
         mServiceMMSList[service->path()].removeAll(message);
     }
     mServiceMMSList.remove(service->path());
     service->deleteLater();
-    qDebug() << "oFonoConnection::onMMSServiceRemoved" << path;
+    qCDebug(lcMms) << "oFonoConnection::onMMSServiceRemoved" << path;
 }
 
 oFonoTextChannel* oFonoConnection::textChannelForId(const QString &id)
@@ -395,6 +431,7 @@ oFonoTextChannel* oFonoConnection::textChannelForId(const QString &id)
 
 oFonoTextChannel* oFonoConnection::textChannelForMembers(const QStringList &members)
 {
+    TraceScope trace("text", "textChannelForMembers");
     Q_FOREACH(oFonoTextChannel* channel, mTextChannels) {
         int count = 0;
         Tp::DBusError error;
@@ -408,7 +445,7 @@ oFonoTextChannel* oFonoConnection::textChannelForMembers(const QStringList &memb
 
         Q_FOREACH(const QString &phoneNumberNew, members) {
             Q_FOREACH(const QString &phoneNumberOld, phoneNumbersOld) {
-                if (PhoneUtils::normalizePhoneNumber(phoneNumberOld) == PhoneUtils::normalizePhoneNumber(phoneNumberNew)) {
+                if (PhoneUtils::normalizePhoneNumber(phoneNumberOld, &mNumberingContext) == PhoneUtils::normalizePhoneNumber(phoneNumberNew, &mNumberingContext)) {
                     count++;
                 }
             }
@@ -422,12 +459,15 @@ oFonoTextChannel* oFonoConnection::textChannelForMembers(const QStringList &memb
 
 void oFonoConnection::addMMSToService(const QString &path, const QVariantMap &properties, const QString &servicePath)
 {
-    qDebug() << "addMMSToService " << path << properties << servicePath;
+    TraceScope trace("mms", "addMMSToService");
+    qCDebug(lcMms) << "addMMSToService " << path << properties << servicePath;
     bool isRoom = false;
     MMSDMessage *msg = new MMSDMessage(path, properties);
     mServiceMMSList[servicePath].append(msg);
     if (properties["Status"] == "received") {
-        QString senderNormalizedNumber = PhoneUtils::normalizePhoneNumber(properties["Sender"].toString());
+        Metrics::instance()->increment("mms.in");
+        Tracer::instance()->flow('s', "mms", "mms", path);
+        QString senderNormalizedNumber = PhoneUtils::normalizePhoneNumber(properties["Sender"].toString(), &mNumberingContext);
         QStringList recipientList = properties["Recipients"].toStringList();
         // we use QSet to avoid having duplicate entries
         QSet<QString> recipients;
@@ -436,18 +476,12 @@ void oFonoConnection::addMMSToService(const QString &path, const QVariantMap &pr
         recipientList.removeAll("");
         if (recipientList.size() > 1) {
             isRoom = true;
-            // remove ourselves from the recipient list 
-            Q_FOREACH(const QString &myNumber, mOfonoSimManager->subscriberNumbers()) {
-                Q_FOREACH(const QString &remoteNumber, recipientList) {
-                    if (PhoneUtils::comparePhoneNumbers(remoteNumber, myNumber)) {
-                        recipientList.removeAll(remoteNumber);
-                        break;
-                    }
-                }
-            }
-            Q_FOREACH(const QString &recipient, recipientList) {
-                recipients << PhoneUtils::normalizePhoneNumber(recipient);
-                initialInviteeHandles << ensureHandle(recipient);
+            // parse all recipients at once and remove ourselves from the recipient list
+            NormalizedPhoneNumbers recipientNumbers = PhoneUtils::normalizePhoneNumbers(recipientList, &mNumberingContext);
+            recipientNumbers = PhoneUtils::removePhoneNumbers(recipientNumbers, mOfonoSimManager->subscriberNumbers(), &mNumberingContext);
+            Q_FOREACH(const NormalizedPhoneNumber &recipient, recipientNumbers) {
+                recipients << recipient.normalized;
+                initialInviteeHandles << ensureNormalizedHandle(recipient.normalized);
             }
         } else if (senderNormalizedNumber.isEmpty() && recipientList.size() == 1) {
             // if this is a message coming from the server (no sender), clear the recipient list;
@@ -458,7 +492,7 @@ void oFonoConnection::addMMSToService(const QString &path, const QVariantMap &pr
         oFonoTextChannel *channel = NULL;
         MMSGroup group;
         if (isRoom) {
-            group = MMSGroupCache::existingGroup(QStringList() << senderNormalizedNumber << recipients.toList());
+            group = MMSGroupCache::existingGroup(QStringList() << senderNormalizedNumber << recipients.toList(), &mNumberingContext);
             if (!group.groupId.isEmpty()) {
                 // check if there is an open channel for this group and use it
                 channel = textChannelForId(group.groupId);
@@ -478,11 +512,12 @@ void oFonoConnection::addMMSToService(const QString &path, const QVariantMap &pr
         QVariantMap request;
 
         uint handle = ensureHandle(senderNormalizedNumber);
-        qDebug() << "ensure handle" << senderNormalizedNumber << handle;
+        qCDebug(lcMms) << "ensure handle" << senderNormalizedNumber << handle;
 
         request[TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType")] = TP_QT_IFACE_CHANNEL_TYPE_TEXT;
         request[TP_QT_IFACE_CHANNEL + QLatin1String(".InitiatorHandle")] = handle;
 
+        TraceScope ensureTrace("mms", "ensureChannel");
         if (isRoom) {
             initialInviteeHandles << handle;
             request[TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType")] = Tp::HandleTypeRoom;
@@ -499,7 +534,7 @@ void oFonoConnection::addMMSToService(const QString &path, const QVariantMap &pr
         }
 
         if (error.isValid()) {
-            qCritical() << "Error creating channel for incoming message " << error.name() << error.message();
+            qCCritical(lcMms) << "Error creating channel for incoming message " << error.name() << error.message();
             return;
         }
         if (isRoom) {
@@ -510,17 +545,17 @@ void oFonoConnection::addMMSToService(const QString &path, const QVariantMap &pr
         if (channel) {
             channel->mmsReceived(path, handle, properties);
         } else {
-            qCritical() << "Failed to create channel for incoming mms" << "isRoom" << isRoom << "groupId" << group.groupId;
+            qCCritical(lcMms) << "Failed to create channel for incoming mms" << "isRoom" << isRoom << "groupId" << group.groupId;
         }
     }
 }
 
 void oFonoConnection::onMMSAdded(const QString &path, const QVariantMap &properties)
 {
-    qDebug() << "oFonoConnection::onMMSAdded" << path << properties;
+    qCDebug(lcMms) << "oFonoConnection::onMMSAdded" << path << properties;
     MMSDService *service = qobject_cast<MMSDService*>(sender());
     if (!service) {
-        qWarning() << "oFonoConnection::onMMSAdded failed";
+        qCWarning(lcMms) << "oFonoConnection::onMMSAdded failed";
         return;
     }
 
@@ -529,10 +564,10 @@ void oFonoConnection::onMMSAdded(const QString &path, const QVariantMap &propert
 
 void oFonoConnection::onMMSRemoved(const QString &path)
 {
-    qDebug() << "oFonoConnection::onMMSRemoved" << path;
+    qCDebug(lcMms) << "oFonoConnection::onMMSRemoved" << path;
     MMSDService *service = qobject_cast<MMSDService*>(sender());
     if (!service) {
-        qWarning() << "oFonoConnection::onMMSRemoved failed";
+        qCWarning(lcMms) << "oFonoConnection::onMMSRemoved failed";
         return;
     }
 
@@ -551,12 +586,14 @@ oFonoConnection::~oFonoConnection() {
     dbusConnection().unregisterService(busName());
 
     mOfonoModemManager->deleteLater();
-    mOfonoMessageManager->deleteLater();
     mOfonoVoiceCallManager->deleteLater();
     mOfonoCallVolume->deleteLater();
-    mOfonoMessageWaiting->deleteLater();
     mOfonoNetworkRegistration->deleteLater();
-    mOfonoSupplementaryServices->deleteLater();
+    if (mStartupFinished) {
+        mOfonoMessageManager->deleteLater();
+        mOfonoMessageWaiting->deleteLater();
+        mOfonoSupplementaryServices->deleteLater();
+    }
     mOfonoSimManager->deleteLater();
     mMmsdManager->deleteLater();
  
@@ -582,7 +619,7 @@ bool oFonoConnection::isNetworkRegistered()
 
 uint oFonoConnection::setPresence(const QString& status, const QString& statusMessage, Tp::DBusError *error)
 {
-    qDebug() << "setPresence" << status;
+    qCDebug(lcConnection) << "setPresence" << status;
     // this prevents tp-qt to propagate the available status
     error->set(TP_QT_ERROR_NOT_AVAILABLE, "Can't change online status: Operation not supported");
     return selfHandle();
@@ -590,7 +627,7 @@ uint oFonoConnection::setPresence(const QString& status, const QString& statusMe
 
 Tp::ContactAttributesMap oFonoConnection::getContactAttributes(const Tp::UIntList &handles, const QStringList &ifaces, Tp::DBusError *error)
 {
-    qDebug() << "getContactAttributes" << handles << ifaces;
+    qCDebug(lcConnection) << "getContactAttributes" << handles << ifaces;
     Tp::ContactAttributesMap attributesMap;
     QVariantMap attributes;
     Q_FOREACH(uint handle, handles) {
@@ -684,7 +721,7 @@ QStringList oFonoConnection::inspectHandles(uint handleType, const Tp::UIntList&
 
     switch (handleType) {
     case Tp::HandleTypeContact:
-        qDebug() << "oFonoConnection::inspectHandles contact" << handles;
+        qCDebug(lcConnection) << "oFonoConnection::inspectHandles contact" << handles;
         Q_FOREACH(uint handle, handles) {
             if (mHandles.keys().contains(handle)) {
                 identifiers.append(mHandles.value(handle));
@@ -695,7 +732,7 @@ QStringList oFonoConnection::inspectHandles(uint handleType, const Tp::UIntList&
         }
         break;
     case Tp::HandleTypeRoom:
-        qDebug() << "oFonoConnection::inspectHandles group" << handles;
+        qCDebug(lcConnection) << "oFonoConnection::inspectHandles group" << handles;
         Q_FOREACH(uint handle, handles) {
             if (mGroupHandles.keys().contains(handle)) {
                 identifiers.append(mGroupHandles.value(handle));
@@ -709,18 +746,25 @@ QStringList oFonoConnection::inspectHandles(uint handleType, const Tp::UIntList&
         error->set(TP_QT_ERROR_INVALID_ARGUMENT,"Not supported");
         break;
     }
-    qDebug() << "oFonoConnection::inspectHandles " << identifiers;
+    qCDebug(lcConnection) << "oFonoConnection::inspectHandles " << identifiers;
     return identifiers;
 }
 
 void oFonoConnection::connect(Tp::DBusError *error) {
-    qDebug() << "oFonoConnection::connect";
+    qCDebug(lcConnection) << "oFonoConnection::connect";
     setStatus(Tp::ConnectionStatusConnected, Tp::ConnectionStatusReasonRequested);
+
+    // the startup ends when the first connection is connected
+    StartupProfiler *profiler = StartupProfiler::instance();
+    if (!profiler->isFinished()) {
+        profiler->record("connection", mStartupBegin, profiler->elapsed() - mStartupBegin);
+        profiler->finish();
+    }
 }
 
 Tp::UIntList oFonoConnection::requestHandles(uint handleType, const QStringList& identifiers, Tp::DBusError* error)
 {
-    qDebug() << "requestHandles";
+    qCDebug(lcConnection) << "requestHandles";
     Tp::UIntList handles;
 
     if( handleType != Tp::HandleTypeContact ) {
@@ -729,21 +773,22 @@ Tp::UIntList oFonoConnection::requestHandles(uint handleType, const QStringList&
     }
 
     Q_FOREACH( const QString& identifier, identifiers) {
-        const QString normalizedNumber = PhoneUtils::normalizePhoneNumber(identifier);
+        const QString normalizedNumber = PhoneUtils::normalizePhoneNumber(identifier, &mNumberingContext);
         if (mHandles.values().contains(normalizedNumber)) {
             handles.append(mHandles.key(normalizedNumber));
-        } else if (PhoneUtils::isPhoneNumber(normalizedNumber)) {
+        } else if (PhoneUtils::isPhoneNumber(normalizedNumber, &mNumberingContext)) {
             handles.append(newHandle(normalizedNumber));
         } else {
             handles.append(newHandle(identifier));
         }
     }
-    qDebug() << "requestHandles" << handles;
+    qCDebug(lcConnection) << "requestHandles" << handles;
     return handles;
 }
 
 Tp::BaseChannelPtr oFonoConnection::createTextChannel(const QVariantMap &request, Tp::DBusError *error)
 {
+    TraceScope trace("text", "createTextChannel");
     uint targetHandleType = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType")).toUInt();
     uint targetHandle = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")).toUInt();
     QString targetId = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID")).toString();
@@ -779,7 +824,7 @@ Tp::BaseChannelPtr oFonoConnection::createTextChannel(const QVariantMap &request
 
     // if the handle type is none and RoomName is present, we should try to find an existing MMS group
     if (targetHandleType == Tp::HandleTypeNone && isRoom) {
-        MMSGroup group = MMSGroupCache::existingGroup(phoneNumbers);
+        MMSGroup group = MMSGroupCache::existingGroup(phoneNumbers, &mNumberingContext);
         if (!group.groupId.isEmpty()) {
             targetId = group.groupId;
         }
@@ -868,6 +913,7 @@ void oFonoConnection::onConferenceCallChannelClosed()
 
 Tp::BaseChannelPtr oFonoConnection::createCallChannel(const QVariantMap &request, Tp::DBusError *error)
 {
+    TraceScope trace("call", "createCallChannel");
     uint targetHandle = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")).toUInt();
     uint initiatorHandle = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".InitiatorHandle")).toUInt();
     QString newPhoneNumber = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID")).toString();
@@ -900,7 +946,11 @@ Tp::BaseChannelPtr oFonoConnection::createCallChannel(const QVariantMap &request
             return Tp::BaseChannelPtr();
         }
 
-        QList<QDBusObjectPath> channels = mOfonoVoiceCallManager->createMultiparty();
+        QList<QDBusObjectPath> channels;
+        {
+            StallScope stallScope("ofono.CreateMultiparty");
+            channels = mOfonoVoiceCallManager->createMultiparty();
+        }
         if (!channels.isEmpty()) {
             mConferenceCall = new oFonoConferenceCallChannel(this);
             QObject::connect(mConferenceCall, SIGNAL(destroyed()), SLOT(onConferenceCallChannelClosed()));
@@ -914,10 +964,11 @@ Tp::BaseChannelPtr oFonoConnection::createCallChannel(const QVariantMap &request
     QDBusObjectPath objpath(request["ofonoObjPath"].toString());
 
     if (objpath.path().isEmpty()) {
+        StallScope stallScope("ofono.Dial");
         objpath = mOfonoVoiceCallManager->dial(newPhoneNumber, "", success);
     }
 
-    qDebug() << "success " << success;
+    qCDebug(lcConnection) << "success " << success;
     if (objpath.path().isEmpty() || !success) {
         if (!success) {
             error->set(TP_QT_ERROR_NOT_AVAILABLE, mOfonoVoiceCallManager->errorMessage());
@@ -927,6 +978,8 @@ Tp::BaseChannelPtr oFonoConnection::createCallChannel(const QVariantMap &request
         return Tp::BaseChannelPtr();
     }
 
+    StallScope stallScope("ofono.VoiceCall");
+    Tracer::instance()->flow('t', "call", "call", objpath.path());
     oFonoCallChannel *channel = new oFonoCallChannel(this, newPhoneNumber, targetHandle, objpath.path());
     channel->baseChannel()->setInitiatorHandle(initiatorHandle);
     mCallChannels[objpath.path()] = channel;
@@ -936,7 +989,7 @@ Tp::BaseChannelPtr oFonoConnection::createCallChannel(const QVariantMap &request
     QObject::connect(channel, SIGNAL(splitted()), SLOT(onCallChannelSplitted()));
     QObject::connect(channel, SIGNAL(multipartyCallHeld()), SLOT(onMultipartyCallHeld()));
     QObject::connect(channel, SIGNAL(multipartyCallActive()), SLOT(onMultipartyCallActive()));
-    qDebug() << channel;
+    qCDebug(lcConnection) << channel;
     return channel->baseChannel();
 }
 
@@ -994,6 +1047,7 @@ Tp::BaseChannelPtr oFonoConnection::createChannel(const QVariantMap &request, Tp
 
 OfonoMessageManager *oFonoConnection::messageManager()
 {
+    finishStartup();
     return mOfonoMessageManager;
 }
 
@@ -1002,6 +1056,11 @@ OfonoVoiceCallManager *oFonoConnection::voiceCallManager()
     return mOfonoVoiceCallManager;
 }
 
+ModemRequestScheduler *oFonoConnection::modemRequestScheduler()
+{
+    return mModemRequestScheduler;
+}
+
 OfonoCallVolume *oFonoConnection::callVolume()
 {
     return mOfonoCallVolume;
@@ -1013,7 +1072,8 @@ void oFonoConnection::onDeliveryReportReceived(const QString &messageId, const Q
     if (pendingMessageNumber.isEmpty()) {
         return;
     }
-    const QString normalizedNumber = PhoneUtils::normalizePhoneNumber(pendingMessageNumber);
+    Metrics::instance()->increment("sms.delivery_reports");
+    const QString normalizedNumber = PhoneUtils::normalizePhoneNumber(pendingMessageNumber, &mNumberingContext);
     PendingMessagesManager::instance()->removePendingMessage(messageId);
     // check if there is an open channel for this sender and use it
 
@@ -1036,7 +1096,7 @@ void oFonoConnection::onDeliveryReportReceived(const QString &messageId, const Q
     ensureChannel(request, yours, false, &error);
 
     if(error.isValid()) {
-        qWarning() << "Error creating channel for incoming message" << error.name() << error.message();
+        qCWarning(lcConnection) << "Error creating channel for incoming message" << error.name() << error.message();
         return;
     }
     channel = textChannelForMembers(QStringList() << normalizedNumber);
@@ -1058,7 +1118,12 @@ void oFonoConnection::onOfonoImmediateMessage(const QString &message, const QVar
 
 void oFonoConnection::ensureTextChannel(const QString &message, const QVariantMap &info, bool flash)
 {
-    QString normalizedNumber = PhoneUtils::normalizePhoneNumber(info["Sender"].toString()).trimmed();
+    Metrics::instance()->increment("sms.in");
+    TraceScope trace("text", "ensureTextChannel");
+    if (Tracer::instance()->isEnabled()) {
+        Tracer::instance()->flow('s', "text", "message", info["Sender"].toString() + info["SentTime"].toString());
+    }
+    QString normalizedNumber = PhoneUtils::normalizePhoneNumber(info["Sender"].toString(), &mNumberingContext).trimmed();
     if (normalizedNumber.isEmpty()) {
         normalizedNumber = "x-ofono-unknown";
     }
@@ -1079,9 +1144,12 @@ void oFonoConnection::ensureTextChannel(const QString &message, const QVariantMa
     request[TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")] = handle;
     request[TP_QT_IFACE_CHANNEL + QLatin1String(".InitiatorHandle")] = handle;
 
-    ensureChannel(request, yours, false, &error);
+    {
+        TraceScope ensureTrace("text", "ensureChannel");
+        ensureChannel(request, yours, false, &error);
+    }
     if(error.isValid()) {
-        qWarning() << "Error creating channel for incoming message" << error.name() << error.message();
+        qCWarning(lcConnection) << "Error creating channel for incoming message" << error.name() << error.message();
         return;
     }
 
@@ -1095,14 +1163,14 @@ void oFonoConnection::onTextChannelClosed()
 {
     oFonoTextChannel *channel = static_cast<oFonoTextChannel*>(sender());
     if (channel) {
-        qDebug() << "text channel closed";
+        qCDebug(lcConnection) << "text channel closed";
         mTextChannels.removeAll(channel);
     }
 }
 
 void oFonoConnection::onCallChannelClosed()
 {
-    qDebug() << "onCallChannelClosed()";
+    qCDebug(lcConnection) << "onCallChannelClosed()";
     oFonoCallChannel *channel = static_cast<oFonoCallChannel*>(sender());
     if (channel) {
         Q_EMIT channelHangup(QDBusObjectPath(channel->baseChannel()->objectPath()));
@@ -1112,19 +1180,22 @@ void oFonoConnection::onCallChannelClosed()
 
 void oFonoConnection::onCallChannelDestroyed()
 {
-    qDebug() << "onCallChannelDestroyed()";
+    qCDebug(lcConnection) << "onCallChannelDestroyed()";
     oFonoCallChannel *channel = static_cast<oFonoCallChannel*>(sender());
     if (channel) {
         QString key = mCallChannels.key(channel);
-        qDebug() << "call channel closed for number " << key;
+        qCDebug(lcConnection) << "call channel closed for number " << key;
         mCallChannels.remove(key);
     }
 }
 
 uint oFonoConnection::ensureHandle(const QString &phoneNumber)
 {
-    const QString normalizedNumber = PhoneUtils::normalizePhoneNumber(phoneNumber);
+    return ensureNormalizedHandle(PhoneUtils::normalizePhoneNumber(phoneNumber, &mNumberingContext));
+}
 
+uint oFonoConnection::ensureNormalizedHandle(const QString &normalizedNumber)
+{
     Q_FOREACH(const QString &phone, mHandles.values()) {
         if (normalizedNumber == phone) {
             // this user already exists
@@ -1165,7 +1236,9 @@ bool oFonoConnection::matchChannel(const Tp::BaseChannelPtr &channel, const QVar
 
 void oFonoConnection::onOfonoCallAdded(const QString &call, const QVariantMap &properties)
 {
-    qDebug() << "new call" << call << properties;
+    TraceScope trace("call", "callAdded");
+    Tracer::instance()->flow('s', "call", "call", call);
+    qCDebug(lcConnection) << "new call" << call << properties;
 
     bool yours;
     Tp::DBusError error;
@@ -1173,7 +1246,7 @@ void oFonoConnection::onOfonoCallAdded(const QString &call, const QVariantMap &p
 
     // check if there is an open channel for this call, if so, ignore it
     if (mCallChannels.keys().contains(call)) {
-        qWarning() << "call channel for this object path already exists: " << call;
+        qCWarning(lcConnection) << "call channel for this object path already exists: " << call;
         return;
     }
 
@@ -1188,7 +1261,7 @@ void oFonoConnection::onOfonoCallAdded(const QString &call, const QVariantMap &p
         lineIdentification = QString("x-ofono-private");
         normalizedNumber = lineIdentification;
     } else {
-        normalizedNumber = PhoneUtils::normalizePhoneNumber(lineIdentification);
+        normalizedNumber = PhoneUtils::normalizePhoneNumber(lineIdentification, &mNumberingContext);
     }
 
     uint handle = ensureHandle(normalizedNumber);
@@ -1199,8 +1272,8 @@ void oFonoConnection::onOfonoCallAdded(const QString &call, const QVariantMap &p
         initiatorHandle = selfHandle();
     }
 
-    qDebug() << "initiatorHandle " <<initiatorHandle;
-    qDebug() << "handle" << handle;
+    qCDebug(lcConnection) << "initiatorHandle " <<initiatorHandle;
+    qCDebug(lcConnection) << "handle" << handle;
 
     QVariantMap request;
     request[TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType")] = TP_QT_IFACE_CHANNEL_TYPE_CALL;
@@ -1209,26 +1282,67 @@ void oFonoConnection::onOfonoCallAdded(const QString &call, const QVariantMap &p
     request[TP_QT_IFACE_CHANNEL + QLatin1String(".InitiatorHandle")] = initiatorHandle;
     request["ofonoObjPath"] = call;
 
+    TraceScope ensureTrace("call", "ensureChannel");
     Tp::BaseChannelPtr channel = ensureChannel(request, yours, false, &error);
 
     if (error.isValid() || channel.isNull()) {
-        qWarning() << "error creating the channel " << error.name() << error.message();
+        qCWarning(lcConnection) << "error creating the channel " << error.name() << error.message();
         return;
     }
 }
 
+QVariantMap oFonoConnection::metrics(Tp::DBusError *error)
+{
+    QVariantMap metrics = Metrics::instance()->snapshot();
+    // gauges are per connection, so they are not kept in Metrics
+    metrics["channels.text"] = mTextChannels.size();
+    metrics["channels.call"] = mCallChannels.size() + (mConferenceCall ? 1 : 0);
+    metrics["handles"] = mHandles.size() + mGroupHandles.size();
+    const char *classes[] = { "modem.call_control", "modem.ussd", "modem.bulk_message" };
+    for (int i = 0; i < ModemRequestScheduler::PriorityCount; i++) {
+        ModemRequestScheduler::Statistics statistics =
+                mModemRequestScheduler->statistics(ModemRequestScheduler::Priority(i));
+        metrics[QString("%1.queued").arg(classes[i])] = statistics.queued;
+        metrics[QString("%1.max_queued").arg(classes[i])] = statistics.maxQueued;
+        metrics[QString("%1.max_wait_ms").arg(classes[i])] = statistics.maxWait;
+    }
+    return metrics;
+}
+
+QString oFonoConnection::flushTrace(Tp::DBusError *error)
+{
+    if (!Tracer::instance()->isEnabled()) {
+        error->set(TP_QT_ERROR_NOT_AVAILABLE, "Tracing is disabled, set TP_OFONO_TRACE to enable it");
+        return QString();
+    }
+    if (!Tracer::instance()->flush()) {
+        error->set(TP_QT_ERROR_NOT_AVAILABLE, "Failed to write the trace");
+        return QString();
+    }
+    return Tracer::instance()->output();
+}
+
+void oFonoConnection::onMetricsUpdated()
+{
+    Tp::DBusError error;
+    metricsIface->setMetrics(metrics(&error));
+}
+
 uint oFonoConnection::voicemailCount(Tp::DBusError *error)
 {
+    finishStartup();
     return mOfonoMessageWaiting->voicemailMessageCount();
 }
 
 QString oFonoConnection::voicemailNumber(Tp::DBusError *error)
 {
+    finishStartup();
     return mOfonoMessageWaiting->voicemailMailboxNumber();
 }
 
 bool oFonoConnection::voicemailIndicator(Tp::DBusError *error)
 {
+    finishStartup();
     return mOfonoMessageWaiting->voicemailWaiting();
 }
 
@@ -1253,25 +1367,53 @@ void oFonoConnection::setActiveAudioOutput(const QString &id)
     Q_EMIT activeAudioOutputChanged(id);
 }
 
+// switch to the output picked by the user, through the route scheduler so
+// that a pending restore does not undo it
+void oFonoConnection::selectAudioOutput(const QString &id)
+{
+#ifdef USE_PULSEAUDIO
+    if (!mHasPulseAudio)
+        return;
+#endif
+
+    // fallback to earpiece/headset
+    AudioRouteScheduler::Route route = AudioRouteScheduler::RouteWiredOrEarpiece;
+    if (id == "bluetooth") {
+        route = AudioRouteScheduler::RouteBluetooth;
+    } else if (id == "speaker") {
+        route = AudioRouteScheduler::RouteSpeaker;
+    }
+    mAudioRouteScheduler->switchTo(route);
+}
+
 void oFonoConnection::USSDInitiate(const QString &command, Tp::DBusError *error)
 {
-    mOfonoSupplementaryServices->initiate(command);
+    finishStartup();
+    mModemRequestScheduler->submit(ModemRequestScheduler::PriorityUssd, [this, command]() {
+        mOfonoSupplementaryServices->initiate(command);
+    });
 }
 
 void oFonoConnection::USSDRespond(const QString &reply, Tp::DBusError *error)
 {
-    mOfonoSupplementaryServices->respond(reply);
+    finishStartup();
+    mModemRequestScheduler->submit(ModemRequestScheduler::PriorityUssd, [this, reply]() {
+        mOfonoSupplementaryServices->respond(reply);
+    });
 }
 
 void oFonoConnection::USSDCancel(Tp::DBusError *error)
 {
-    mOfonoSupplementaryServices->cancel();
+    finishStartup();
+    mModemRequestScheduler->submit(ModemRequestScheduler::PriorityUssd, [this]() {
+        mOfonoSupplementaryServices->cancel();
+    });
 }
 
 #ifdef USE_PULSEAUDIO
 void oFonoConnection::onAudioModeChanged(AudioMode mode)
 {
-    qDebug("PulseAudio audio mode changed: 0x%x", mode);
+    qCDebug(lcAudio, "PulseAudio audio mode changed: 0x%x", mode);
 
     if (mode == AudioModeEarpiece && mActiveAudioOutput != "earpiece") {
         setActiveAudioOutput("earpiece");
@@ -1286,7 +1428,7 @@ void oFonoConnection::onAudioModeChanged(AudioMode mode)
 
 void oFonoConnection::onAvailableAudioModesChanged(AudioModes modes)
 {
-    qDebug("PulseAudio available audio modes changed");
+    qCDebug(lcAudio, "PulseAudio available audio modes changed");
     bool defaultFound = false;
     mAudioOutputs.clear();
     Q_FOREACH(const AudioMode &mode, modes) {
@@ -1315,6 +1457,33 @@ void oFonoConnection::onAvailableAudioModesChanged(AudioModes modes)
     }
     Q_EMIT audioOutputsChanged(mAudioOutputs);
 }
+
+void oFonoConnection::onAudioRouteChanged(AudioRouteScheduler::Route route)
+{
+    switch (route) {
+    case AudioRouteScheduler::RouteEarpiece:
+        QPulseAudioEngine::instance()->setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+        break;
+    case AudioRouteScheduler::RouteSpeaker:
+        QPulseAudioEngine::instance()->setCallMode(CallActive, AudioModeSpeaker);
+        break;
+    case AudioRouteScheduler::RouteBluetooth:
+        QPulseAudioEngine::instance()->setCallMode(CallActive, AudioModeBluetooth);
+        break;
+    case AudioRouteScheduler::RouteWiredOrEarpiece:
+        QPulseAudioEngine::instance()->setCallMode(CallActive, AudioModeWiredOrEarpiece);
+        break;
+    case AudioRouteScheduler::RouteRingtone:
+        QPulseAudioEngine::instance()->setCallMode(CallRinging, AudioModeWiredOrSpeaker);
+        // resolve the route used once the call gets answered (see updateAudioRouteToEarpiece)
+        QPulseAudioEngine::instance()->prepareCall(AudioModeBtOrWiredOrEarpiece);
+        break;
+    case AudioRouteScheduler::RouteNormal:
+        QPulseAudioEngine::instance()->setMicMute(false);
+        QPulseAudioEngine::instance()->setCallMode(CallEnded, AudioModeWiredOrSpeaker);
+        break;
+    }
+}
 #endif
 
 void oFonoConnection::updateAudioRoute()
@@ -1332,18 +1501,18 @@ void oFonoConnection::updateAudioRoute()
             OfonoVoiceCall *call = new OfonoVoiceCall(mOfonoVoiceCallManager->getCalls().first());
             if (call) {
                 if (call->state() == "incoming") {
-                    enable_ringtone();
+                    mAudioRouteScheduler->switchTo(AudioRouteScheduler::RouteRingtone);
                     call->deleteLater();
                     return;
                 }
                 if (call->state() == "disconnected") {
-                    enable_normal();
+                    mAudioRouteScheduler->scheduleRestore();
                     call->deleteLater();
                     return;
                 }
                 // if only one call and dialing, default to earpiece
                 if (call->state() == "dialing") {
-                    enable_earpiece();
+                    mAudioRouteScheduler->switchTo(AudioRouteScheduler::RouteEarpiece);
                     call->deleteLater();
                     return;
                 }
@@ -1355,7 +1524,7 @@ void oFonoConnection::updateAudioRoute()
             }
         }
     } else {
-        enable_normal();
+        mAudioRouteScheduler->scheduleRestore();
         Q_EMIT lastChannelClosed();
     }
 
@@ -1371,7 +1540,7 @@ void oFonoConnection::updateAudioRouteToEarpiece()
 #endif
 
     if (mOfonoVoiceCallManager->getCalls().size() == 1) {
-        enable_earpiece();
+        mAudioRouteScheduler->switchTo(AudioRouteScheduler::RouteEarpiece);
     }
 }
 
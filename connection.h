@@ -49,6 +49,10 @@
 #include "dbustypes.h"
 #include "audiooutputsiface.h"
 #include "ussdiface.h"
+#include "metricsiface.h"
+#include "phoneutils_p.h"
+#include "audioroutescheduler.h"
+#include "modemrequestscheduler.h"
 
 #ifdef USE_PULSEAUDIO
 #include "qpulseaudioengine.h"
@@ -78,6 +82,7 @@ public:
     void connect(Tp::DBusError *error);
     void setSpeakerMode(bool active);
     void setActiveAudioOutput(const QString &id);
+    void selectAudioOutput(const QString &id);
     AudioOutputList audioOutputs();
     QString activeAudioOutput();
     QStringList emergencyNumbers(Tp::DBusError *error);
@@ -87,6 +92,8 @@ public:
     void USSDInitiate(const QString &command, Tp::DBusError *error);
     void USSDRespond(const QString &reply, Tp::DBusError *error);
     void USSDCancel(Tp::DBusError *error);
+    QVariantMap metrics(Tp::DBusError *error);
+    QString flushTrace(Tp::DBusError *error);
 
     Tp::BaseConnectionRequestsInterfacePtr requestsIface;
     Tp::BaseConnectionSimplePresenceInterfacePtr simplePresenceIface;
@@ -94,12 +101,14 @@ public:
     BaseConnectionEmergencyModeInterfacePtr emergencyModeIface;
     BaseConnectionVoicemailInterfacePtr voicemailIface;
     BaseConnectionUSSDInterfacePtr supplementaryServicesIface;
+    BaseConnectionMetricsInterfacePtr metricsIface;
     uint newHandle(const QString &identifier);
     uint newGroupHandle(const QString &identifier);
 
     OfonoMessageManager *messageManager();
     OfonoVoiceCallManager *voiceCallManager();
     OfonoCallVolume *callVolume();
+    ModemRequestScheduler *modemRequestScheduler();
     QMap<QString, oFonoCallChannel*> callChannels();
 
     uint ensureHandle(const QString &phoneNumber);
@@ -151,14 +160,20 @@ private Q_SLOTS:
     void onMultipartyCallActive();
     void updateOnlineStatus();
     void onDisconnected();
+    void finishStartup();
+    void onMetricsUpdated();
 
 #ifdef USE_PULSEAUDIO
     void onAudioModeChanged(AudioMode mode);
     void onAvailableAudioModesChanged(AudioModes modes);
+    void onAudioRouteChanged(AudioRouteScheduler::Route route);
 #endif
 
 private:
+    typedef QPair<QString, qint64> StartupStage;
+    void markStartupStage(const QString &stage);
     void updateMcc();
+    uint ensureNormalizedHandle(const QString &normalizedNumber);
     bool isNetworkRegistered();
     void addMMSToService(const QString &path, const QVariantMap &properties, const QString &servicePath);
     void ensureTextChannel(const QString &message, const QVariantMap &info, bool flash);
@@ -175,6 +190,7 @@ private:
     QMap<QString, oFonoCallChannel*> mCallChannels;
 
     QStringList mModems;
+    OfonoModem::SelectionSetting mModemSetting;
     OfonoModemManager *mOfonoModemManager;
     OfonoMessageManager *mOfonoMessageManager;
     OfonoVoiceCallManager *mOfonoVoiceCallManager;
@@ -189,9 +205,15 @@ private:
     QMap<QString, MMSDService*> mMmsdServices;
     QMap<QString, QList<MMSDMessage*> > mServiceMMSList;
     oFonoConferenceCallChannel *mConferenceCall;
+    bool mStartupFinished;
+    qint64 mStartupBegin;
+    QList<StartupStage> mStartupStages;
     QString mModemPath;
     QString mActiveAudioOutput;
     AudioOutputList mAudioOutputs;
+    NumberingContext mNumberingContext;
+    AudioRouteScheduler *mAudioRouteScheduler;
+    ModemRequestScheduler *mModemRequestScheduler;
 };
 
 #endif
@@ -0,0 +1,173 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dtmfpipeline.h"
+#include "logging.h"
+#include "metrics.h"
+
+#include <QDebug>
+
+// ofono queues the whole string, but modems get slow with very long ones
+#define DEFAULT_MAX_TONES 32
+#define DEFAULT_MAX_RETRIES 5
+#define DEFAULT_RETRY_MIN_DELAY 100
+#define DEFAULT_RETRY_MAX_DELAY 2000
+
+DtmfPipeline::DtmfPipeline(QObject *parent)
+    : QObject(parent),
+      mInFlight(0),
+      mMaxTones(DEFAULT_MAX_TONES),
+      mMaxRetries(DEFAULT_MAX_RETRIES),
+      mRetryMinDelay(DEFAULT_RETRY_MIN_DELAY),
+      mRetryMaxDelay(DEFAULT_RETRY_MAX_DELAY),
+      mFailures(0)
+{
+    mClock.start();
+    mRetryTimer.setSingleShot(true);
+    QObject::connect(&mRetryTimer, SIGNAL(timeout()), SLOT(sendNext()));
+}
+
+int DtmfPipeline::maxTones() const
+{
+    return mMaxTones;
+}
+
+void DtmfPipeline::setMaxTones(int maxTones)
+{
+    mMaxTones = qMax(1, maxTones);
+}
+
+int DtmfPipeline::maxRetries() const
+{
+    return mMaxRetries;
+}
+
+void DtmfPipeline::setMaxRetries(int maxRetries)
+{
+    mMaxRetries = qMax(0, maxRetries);
+}
+
+void DtmfPipeline::setRetryDelays(int minMsecs, int maxMsecs)
+{
+    mRetryMinDelay = qMax(0, minMsecs);
+    mRetryMaxDelay = qMax(mRetryMinDelay, maxMsecs);
+}
+
+QString DtmfPipeline::pendingTones() const
+{
+    return mTones;
+}
+
+bool DtmfPipeline::isSending() const
+{
+    return mInFlight > 0;
+}
+
+bool DtmfPipeline::isRetryPending() const
+{
+    return mRetryTimer.isActive();
+}
+
+DtmfPipeline::Statistics DtmfPipeline::statistics() const
+{
+    return mStatistics;
+}
+
+void DtmfPipeline::appendTones(const QString &tones)
+{
+    if (tones.isEmpty()) {
+        return;
+    }
+    qint64 now = mClock.elapsed();
+    mTones += tones;
+    for (int i = 0; i < tones.size(); i++) {
+        mQueuedAt.append(now);
+    }
+    // while waiting for a retry, new tones go out with the failed ones
+    if (!mRetryTimer.isActive()) {
+        sendNext();
+    }
+}
+
+void DtmfPipeline::sendNext()
+{
+    if (mInFlight > 0 || mTones.isEmpty()) {
+        return;
+    }
+    mInFlight = qMin(mTones.size(), mMaxTones);
+    mStatistics.requests++;
+    Q_EMIT sendTones(mTones.left(mInFlight));
+}
+
+void DtmfPipeline::onSendTonesComplete(bool success)
+{
+    // not ours, or the queue was cleared meanwhile
+    if (mInFlight == 0) {
+        return;
+    }
+
+    int count = mInFlight;
+    mInFlight = 0;
+
+    if (success) {
+        qint64 now = mClock.elapsed();
+        for (int i = 0; i < count; i++) {
+            qint64 latency = now - mQueuedAt[i];
+            mStatistics.totalLatency += latency;
+            mStatistics.maxLatency = qMax(mStatistics.maxLatency, latency);
+            Metrics::instance()->record("dtmf.latency", latency * 1000);
+        }
+        mStatistics.sent += count;
+        mTones.remove(0, count);
+        mQueuedAt.remove(0, count);
+        mFailures = 0;
+        sendNext();
+        return;
+    }
+
+    mFailures++;
+    if (mFailures > mMaxRetries) {
+        QString dropped = mTones.left(count);
+        qCWarning(lcCall) << "Dropping DTMF tones" << dropped << "after" << mMaxRetries << "retries";
+        mStatistics.dropped += count;
+        Metrics::instance()->increment("dtmf.dropped", count);
+        mTones.remove(0, count);
+        mQueuedAt.remove(0, count);
+        mFailures = 0;
+        Q_EMIT tonesDropped(dropped);
+        sendNext();
+        return;
+    }
+
+    // double the delay on every consecutive failure
+    int delay = mRetryMinDelay;
+    for (int i = 1; i < mFailures && delay < mRetryMaxDelay; i++) {
+        delay *= 2;
+    }
+    delay = qMin(delay, mRetryMaxDelay);
+    qCDebug(lcCall) << "Failed to send DTMF tones, retrying in" << delay << "ms";
+    mStatistics.retries++;
+    mRetryTimer.start(delay);
+}
+
+void DtmfPipeline::clear()
+{
+    mRetryTimer.stop();
+    mTones.clear();
+    mQueuedAt.clear();
+    mInFlight = 0;
+    mFailures = 0;
+}
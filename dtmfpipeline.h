@@ -0,0 +1,89 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DTMFPIPELINE_H
+#define DTMFPIPELINE_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+// Queue of DTMF tones waiting to be played on a call. Tones queued while a
+// SendTones request is in flight are merged and sent together as soon as it
+// completes. Failed requests are retried with an increasing delay, and the
+// tones are dropped once the retries are exhausted.
+class DtmfPipeline : public QObject
+{
+    Q_OBJECT
+public:
+    struct Statistics {
+        Statistics() : sent(0), dropped(0), requests(0), retries(0), totalLatency(0), maxLatency(0) {}
+        // number of tones
+        quint64 sent;
+        quint64 dropped;
+        // number of SendTones requests
+        quint64 requests;
+        quint64 retries;
+        // milliseconds between queueing a tone and the modem confirming it
+        qint64 totalLatency;
+        qint64 maxLatency;
+    };
+
+    explicit DtmfPipeline(QObject *parent = 0);
+
+    int maxTones() const;
+    void setMaxTones(int maxTones);
+    int maxRetries() const;
+    void setMaxRetries(int maxRetries);
+    void setRetryDelays(int minMsecs, int maxMsecs);
+
+    // tones not confirmed yet, including the ones in flight
+    QString pendingTones() const;
+    bool isSending() const;
+    bool isRetryPending() const;
+    Statistics statistics() const;
+
+public Q_SLOTS:
+    void appendTones(const QString &tones);
+    // to be connected to the SendTones reply
+    void onSendTonesComplete(bool success);
+    // forgets about the queued tones, e.g. when the call state changes
+    void clear();
+
+Q_SIGNALS:
+    // the tones need to be sent in a single SendTones request
+    void sendTones(const QString &tones);
+    void tonesDropped(const QString &tones);
+
+private Q_SLOTS:
+    void sendNext();
+
+private:
+    QString mTones;
+    QVector<qint64> mQueuedAt;
+    int mInFlight;
+    int mMaxTones;
+    int mMaxRetries;
+    int mRetryMinDelay;
+    int mRetryMaxDelay;
+    int mFailures;
+    QTimer mRetryTimer;
+    QElapsedTimer mClock;
+    Statistics mStatistics;
+};
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "logging.h"
+
+Q_LOGGING_CATEGORY(lcConnection, "telepathy.ofono.connection", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcText, "telepathy.ofono.text", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcCall, "telepathy.ofono.call", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcMms, "telepathy.ofono.mms", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcAudio, "telepathy.ofono.audio", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcDb, "telepathy.ofono.db", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcPhoneUtils, "telepathy.ofono.phoneutils", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcWatchdog, "telepathy.ofono.watchdog", QtWarningMsg)
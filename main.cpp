@@ -22,21 +22,38 @@
 #include <TelepathyQt/Debug>
 
 #include "protocol.h"
+#include "startupprofiler.h"
+#include "stallwatchdog.h"
+#include "tracing.h"
 
 int main(int argc, char *argv[])
 {
+    // timestamps are relative to this point
+    StartupProfiler::instance();
     QCoreApplication a(argc, argv);
+    Tracer::instance()->initFromEnvironment();
     
+    StartupPhase registerTypes("main.registerTypes");
     Tp::registerTypes();
-    Tp::enableDebug(true);
+    // the telepathy-qt debug output is too verbose to be always on
+    Tp::enableDebug(!qgetenv("TP_OFONO_TP_DEBUG").isEmpty());
     Tp::enableWarnings(true);
+    registerTypes.end();
 
+    StartupPhase protocol("main.protocol");
     Tp::BaseProtocolPtr proto = Tp::BaseProtocol::create<Protocol>(
             QDBusConnection::sessionBus(), QLatin1String("ofono"));
+    protocol.end();
+
+    StartupPhase connectionManager("main.connectionManager");
     Tp::BaseConnectionManagerPtr cm = Tp::BaseConnectionManager::create(
             QDBusConnection::sessionBus(), QLatin1String("ofono"));
     cm->addProtocol(proto);
     cm->registerObject();
+    connectionManager.end();
 
-    return a.exec();
+    StallWatchdog::instance()->start(StallWatchdog::defaultThreshold());
+    int result = a.exec();
+    StallWatchdog::instance()->stop();
+    return result;
 }
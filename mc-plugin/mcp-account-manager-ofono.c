@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <malloc.h>
+#include <hybris/properties/properties.h>
 #include "mcp-account-manager-ofono.h"
 
 #define PLUGIN_NAME "ofono-account"
@@ -36,6 +37,9 @@
 
 static void account_storage_iface_init(McpAccountStorageIface *iface);
 
+/* reads the android properties in process, without forking getprop */
+static McpOfonoPropertyGetter property_getter = property_get;
+
 G_DEFINE_TYPE_WITH_CODE (McpAccountManagerOfono, mcp_account_manager_ofono,
     G_TYPE_OBJECT, G_IMPLEMENT_INTERFACE (MCP_TYPE_ACCOUNT_STORAGE,
     account_storage_iface_init));
@@ -50,6 +54,7 @@ typedef struct ofono_account OfonoAccount;
 struct _McpAccountManagerOfonoPrivate
 {
     GList *accounts;
+    GCancellable *cancellable;
 };
 
 void free_ofono_struct (gpointer data)
@@ -63,18 +68,148 @@ static void mcp_account_manager_ofono_dispose(GObject *object)
 {
     McpAccountManagerOfono *self = (McpAccountManagerOfono*) object;
 
+    /* the pending SimNames lookup must not touch the accounts anymore */
+    if (self->priv->cancellable) {
+        g_cancellable_cancel(self->priv->cancellable);
+        g_clear_object(&self->priv->cancellable);
+    }
+
     g_list_free_full(self->priv->accounts, free_ofono_struct);
+    self->priv->accounts = NULL;
 
     G_OBJECT_CLASS (mcp_account_manager_ofono_parent_class)->dispose(object);
 }
 
+void mcp_account_manager_ofono_set_property_getter(McpOfonoPropertyGetter getter)
+{
+    property_getter = getter ? getter : property_get;
+}
+
+/* fallback for when the properties can't be read in process */
+static int getprop_spawn(const char *key, char *value, const char *default_value)
+{
+    gchar *command = g_strdup_printf("/usr/bin/getprop %s '%s'", key, default_value);
+    gchar *output = NULL;
+    GError *error = NULL;
+    int len = 0;
+
+    value[0] = '\0';
+    if (g_spawn_command_line_sync(command, &output, NULL, NULL, &error)) {
+        g_strlcpy(value, g_strstrip(output), PROP_VALUE_MAX);
+        len = strlen(value);
+    } else {
+        g_debug("%s", error->message);
+        g_error_free (error);
+    }
+
+    g_free(output);
+    g_free(command);
+    return len;
+}
+
+static int get_num_modems(void)
+{
+    char libpath[PROP_VALUE_MAX] = {0};
+    char num_slots[PROP_VALUE_MAX] = {0};
+
+    if (property_getter("rild.libpath", libpath, "") > 0) {
+        property_getter("ril.num_slots", num_slots, "1");
+        return atoi(num_slots);
+    }
+
+    if (!g_file_test ("/usr/bin/getprop", G_FILE_TEST_IS_EXECUTABLE)) {
+        return 0;
+    }
+    g_debug("rild.libpath not available in process, falling back to getprop");
+    if (getprop_spawn("rild.libpath", libpath, "") > 0) {
+        getprop_spawn("ril.num_slots", num_slots, "1");
+        return atoi(num_slots);
+    }
+    return 0;
+}
+
+static void apply_sim_names(McpAccountManagerOfono *self, GVariant *sim_names)
+{
+    GList *l;
+    for (l = self->priv->accounts; l != NULL; l = l->next) {
+        OfonoAccount *account = (OfonoAccount*)l->data;
+        const gchar *modem = g_hash_table_lookup(account->params, "param-modem-objpath");
+        const gchar *current = g_hash_table_lookup(account->params, "DisplayName");
+        gchar *name = NULL;
+
+        if (!g_variant_lookup(sim_names, modem, "s", &name)) {
+            continue;
+        }
+        if (current && !strcmp(current, name)) {
+            g_free(name);
+            continue;
+        }
+
+        g_debug("%s: %s %s", G_STRFUNC, account->account_name, name);
+        g_hash_table_insert(account->params, g_strdup("DisplayName"), name);
+        mcp_account_storage_emit_altered_one(MCP_ACCOUNT_STORAGE(self), account->account_name, "DisplayName");
+    }
+}
+
+static void on_sim_names_ready(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+
+    if (error) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_warning("Failed to get SimNames property: %s", error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+
+    GVariant *sim_names = NULL;
+    g_variant_get(result, "(v)", &sim_names);
+    if (g_variant_is_of_type(sim_names, G_VARIANT_TYPE("a{ss}"))) {
+        apply_sim_names((McpAccountManagerOfono*)user_data, sim_names);
+    }
+    g_variant_unref(sim_names);
+    g_variant_unref(result);
+}
+
+static void on_system_bus_ready(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    GError *error = NULL;
+    GDBusConnection *bus = g_bus_get_finish(res, &error);
+
+    if (error) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_warning("Failed to get system bus: %s", error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+
+    McpAccountManagerOfono *self = (McpAccountManagerOfono*) user_data;
+    char dbus_path[80] = {0};
+    sprintf(dbus_path, "/org/freedesktop/Accounts/User%d", getuid());
+
+    /* Retrieve all SimNames from Accounts Service */
+    g_dbus_connection_call(bus,
+                           "org.freedesktop.Accounts",
+                           dbus_path,
+                           "org.freedesktop.DBus.Properties",
+                           "Get",
+                           g_variant_new ("(ss)", "com.ubuntu.touch.AccountsService.Phone", "SimNames"),
+                           G_VARIANT_TYPE ("(v)"),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           self->priv->cancellable,
+                           on_sim_names_ready,
+                           self);
+    g_object_unref(bus);
+}
+
 static void mcp_account_manager_ofono_init(McpAccountManagerOfono *self)
 {
     g_debug("MC ril ofono accounts plugin initialized");
-    gchar          *output = NULL;
-    gchar          *output2 = NULL;
     const gchar    *force_num_modems = g_getenv("FORCE_RIL_NUM_MODEMS");
-    GError         *error = NULL;
     int            num_modems = 0;
     int index;
 
@@ -86,68 +221,10 @@ static void mcp_account_manager_ofono_init(McpAccountManagerOfono *self)
         num_modems = atoi(force_num_modems);
         g_debug("forced number of modems: %d", num_modems);
     } else {
-        if (!g_file_test ("/usr/bin/getprop", G_FILE_TEST_IS_EXECUTABLE)) {
+        num_modems = get_num_modems();
+        if (num_modems == 0) {
             return;
         }
-        if (!g_spawn_command_line_sync("/usr/bin/getprop rild.libpath ''",
-                                        &output, NULL, NULL,
-                                        &error)) {
-            g_debug("%s", error->message);
-            g_error_free (error);
-            return;
-        }
-
-        if (strlen(g_strstrip(output)) != 0) {
-            g_spawn_command_line_sync("/usr/bin/getprop ril.num_slots 1",
-                                       &output2,
-                                       NULL,
-                                       NULL,
-                                       &error);
-            num_modems = atoi(output2);
-        }
-    }
-
-    GHashTable *sim_names = g_hash_table_new(g_str_hash, g_str_equal);
-    char dbus_path[80] = {0};
-    sprintf(dbus_path, "/org/freedesktop/Accounts/User%d", getuid());
-    GError *bus_error = NULL;
-    GDBusConnection *bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &bus_error);
-    if (bus_error) {
-        g_warning("Failed to get system bugs: %s", bus_error->message);
-        g_error_free (bus_error);
-    } else if (bus) {
-        GError *call_error = NULL;
-
-        /* Retrieve all SimNames from Accounts Service */
-        GVariant *result = g_dbus_connection_call_sync (bus,
-                                      "org.freedesktop.Accounts",
-                                      dbus_path,
-                                      "org.freedesktop.DBus.Properties",
-                                      "Get",
-                                      g_variant_new ("(ss)", "com.ubuntu.touch.AccountsService.Phone", "SimNames"),
-                                      G_VARIANT_TYPE ("(v)"),
-                                      G_DBUS_CALL_FLAGS_NONE,
-                                      -1,
-                                      NULL,
-                                      &call_error);
-
-
-        if (call_error) {
-            g_warning ("Failed to get SimNames property: %s", call_error->message);
-            g_error_free (call_error);
-        } else {
-            GVariantIter *_iter;
-            gchar *key;
-            gchar *value;
-            GVariant *dict;
-            g_variant_get (result, "(v)", &dict);
-            g_variant_get(dict, "a{ss}", &_iter);
-            while (g_variant_iter_loop (_iter, "{ss}", &key, &value)) {
-                g_hash_table_insert(sim_names, g_strdup(key), g_strdup(value));
-            }
-            g_variant_iter_free(_iter);
-        }
-        g_object_unref(bus);
     }
 
     for (index = 0; index < num_modems; index++) {
@@ -166,28 +243,13 @@ static void mcp_account_manager_ofono_init(McpAccountManagerOfono *self)
         g_hash_table_insert(account->params, g_strdup("always_dispatch"), g_strdup("true"));
         g_hash_table_insert(account->params, g_strdup("param-modem-objpath"), g_strdup(ril_modem));
 
-        GHashTableIter iter;
-        gpointer key, value;
-        g_hash_table_iter_init(&iter, sim_names);
-        while (g_hash_table_iter_next(&iter, &key, &value)) {
-            if (!strcmp((char *)key, ril_modem)) {
-                g_hash_table_insert(account->params, g_strdup("DisplayName"), g_strdup((char*)value));
-                break;
-            }
-        }
-
         self->priv->accounts = g_list_append(self->priv->accounts, account);
     }
 
-    g_hash_table_unref(sim_names);
-
-    if (output) {
-        g_free(output);
-    }
-
-    if (output2) {
-      g_free (output2);
-    }
+    /* the accounts are published with the default display name, the SimNames
+     * arrive later and must never delay the account loading */
+    self->priv->cancellable = g_cancellable_new();
+    g_bus_get(G_BUS_TYPE_SYSTEM, self->priv->cancellable, on_system_bus_ready, self);
 }
 
 static void mcp_account_manager_ofono_class_init(McpAccountManagerOfonoClass *klass)
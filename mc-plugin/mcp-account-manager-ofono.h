@@ -44,6 +44,12 @@ GType mcp_account_manager_ofono_get_type (void) G_GNUC_CONST;
 
 McpAccountManagerOfono *mcp_account_manager_ofono_new (void);
 
+/* same signature as property_get() from libandroid-properties */
+typedef int (*McpOfonoPropertyGetter) (const char *key, char *value, const char *default_value);
+
+/* replaces the android properties backend, NULL restores the default one */
+void mcp_account_manager_ofono_set_property_getter (McpOfonoPropertyGetter getter);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,181 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+
+#include "metrics.h"
+
+// minimum interval between two updated() signals
+#define DEFAULT_UPDATE_INTERVAL 5000
+
+// upper bounds of the histogram buckets in usecs, from 100us to ~1.6s
+static const qint64 bucketBounds[] = { 100, 400, 1600, 6400, 25600, 102400, 409600, 1638400 };
+static const int bucketCount = sizeof(bucketBounds) / sizeof(bucketBounds[0]) + 1;
+
+Metrics::Histogram::Histogram()
+    : count(0), sum(0), min(0), max(0)
+{
+    for (int i = 0; i < bucketCount; i++) {
+        buckets << 0;
+    }
+}
+
+Metrics::Metrics(QObject *parent)
+    : QObject(parent),
+      mUpdateTimer(new QTimer(this))
+{
+    mUpdateTimer->setSingleShot(true);
+    mUpdateTimer->setInterval(DEFAULT_UPDATE_INTERVAL);
+    connect(mUpdateTimer, SIGNAL(timeout()), SLOT(onUpdateTimeout()));
+
+    // the rate limiting timer has to run on the main thread, whichever
+    // thread records the first value, and being a child it moves with us
+    if (QCoreApplication::instance()) {
+        moveToThread(QCoreApplication::instance()->thread());
+    }
+}
+
+Metrics *Metrics::instance()
+{
+    static Metrics *self = new Metrics();
+    return self;
+}
+
+void Metrics::increment(const QString &counter, quint64 value)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mCounters[counter] += value;
+    }
+    changed();
+}
+
+void Metrics::record(const QString &histogram, qint64 usecs)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        Histogram &h = mHistograms[histogram];
+        if (h.count == 0 || usecs < h.min) {
+            h.min = usecs;
+        }
+        if (h.count == 0 || usecs > h.max) {
+            h.max = usecs;
+        }
+        h.count++;
+        h.sum += usecs;
+
+        int bucket = 0;
+        while (bucket < bucketCount - 1 && usecs > bucketBounds[bucket]) {
+            bucket++;
+        }
+        h.buckets[bucket]++;
+    }
+    changed();
+}
+
+quint64 Metrics::counter(const QString &counter) const
+{
+    QMutexLocker locker(&mMutex);
+    return mCounters.value(counter);
+}
+
+quint64 Metrics::samples(const QString &histogram) const
+{
+    QMutexLocker locker(&mMutex);
+    return mHistograms.value(histogram).count;
+}
+
+QVariantMap Metrics::snapshot() const
+{
+    QMutexLocker locker(&mMutex);
+    QVariantMap metrics;
+    QMap<QString, quint64>::const_iterator counter;
+    for (counter = mCounters.constBegin(); counter != mCounters.constEnd(); ++counter) {
+        metrics[counter.key()] = counter.value();
+    }
+
+    QVariantList bounds;
+    for (int i = 0; i < bucketCount - 1; i++) {
+        bounds << bucketBounds[i];
+    }
+
+    QMap<QString, Histogram>::const_iterator histogram;
+    for (histogram = mHistograms.constBegin(); histogram != mHistograms.constEnd(); ++histogram) {
+        const Histogram &h = histogram.value();
+        QVariantList buckets;
+        Q_FOREACH(quint64 bucket, h.buckets) {
+            buckets << bucket;
+        }
+        QVariantMap map;
+        map["count"] = h.count;
+        map["sum"] = h.sum;
+        map["min"] = h.min;
+        map["max"] = h.max;
+        map["bounds"] = bounds;
+        map["buckets"] = buckets;
+        metrics[histogram.key()] = map;
+    }
+    return metrics;
+}
+
+void Metrics::reset()
+{
+    QMutexLocker locker(&mMutex);
+    mCounters.clear();
+    mHistograms.clear();
+}
+
+void Metrics::setUpdateInterval(int msecs)
+{
+    mUpdateTimer->setInterval(msecs);
+}
+
+int Metrics::updateInterval() const
+{
+    return mUpdateTimer->interval();
+}
+
+void Metrics::changed()
+{
+    // only the first change after an update schedules the next one
+    if (mUpdatePending.testAndSetOrdered(0, 1)) {
+        QMetaObject::invokeMethod(this, "scheduleUpdate", Qt::QueuedConnection);
+    }
+}
+
+void Metrics::scheduleUpdate()
+{
+    if (!mUpdateTimer->isActive()) {
+        mUpdateTimer->start();
+    }
+}
+
+void Metrics::onUpdateTimeout()
+{
+    mUpdatePending.store(0);
+    Q_EMIT updated();
+}
+
+MetricsTimer::MetricsTimer(const QString &histogram)
+    : mHistogram(histogram)
+{
+    mTimer.start();
+}
+
+MetricsTimer::~MetricsTimer()
+{
+    Metrics::instance()->record(mHistogram, mTimer.nsecsElapsed() / 1000);
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QTimer>
+#include <QVariantMap>
+
+// Process wide counters and latency histograms. They can be updated from any
+// thread, and updated() is emitted at most once per update interval.
+class Metrics : public QObject
+{
+    Q_OBJECT
+public:
+    static Metrics *instance();
+
+    void increment(const QString &counter, quint64 value = 1);
+    // latencies are recorded in usecs
+    void record(const QString &histogram, qint64 usecs);
+
+    quint64 counter(const QString &counter) const;
+    quint64 samples(const QString &histogram) const;
+    // counters are exported as numbers, histograms as maps with count, sum,
+    // min, max, bounds and buckets (the last bucket has no upper bound)
+    QVariantMap snapshot() const;
+    void reset();
+
+    void setUpdateInterval(int msecs);
+    int updateInterval() const;
+
+Q_SIGNALS:
+    void updated();
+
+private Q_SLOTS:
+    void scheduleUpdate();
+    void onUpdateTimeout();
+
+private:
+    explicit Metrics(QObject *parent = 0);
+    void changed();
+
+    struct Histogram {
+        Histogram();
+        quint64 count;
+        qint64 sum;
+        qint64 min;
+        qint64 max;
+        QList<quint64> buckets;
+    };
+
+    mutable QMutex mMutex;
+    QMap<QString, quint64> mCounters;
+    QMap<QString, Histogram> mHistograms;
+    QTimer *mUpdateTimer;
+    QAtomicInt mUpdatePending;
+};
+
+// Records the time between its creation and its destruction in a histogram
+class MetricsTimer
+{
+public:
+    explicit MetricsTimer(const QString &histogram);
+    ~MetricsTimer();
+
+private:
+    QString mHistogram;
+    QElapsedTimer mTimer;
+};
+
+#endif
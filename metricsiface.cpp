@@ -0,0 +1,151 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDebug>
+
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/DBusObject>
+
+#include "metricsiface.h"
+
+// Conn.I.Metrics
+BaseConnectionMetricsInterface::Adaptee::Adaptee(BaseConnectionMetricsInterface *interface)
+    : QObject(interface),
+      mInterface(interface)
+{
+}
+
+
+struct TP_QT_NO_EXPORT BaseConnectionMetricsInterface::Private {
+    Private(BaseConnectionMetricsInterface *parent)
+        : adaptee(new BaseConnectionMetricsInterface::Adaptee(parent)) {
+    }
+    GetMetricsCallback getMetricsCB;
+    FlushTraceCallback flushTraceCB;
+    BaseConnectionMetricsInterface::Adaptee *adaptee;
+};
+
+BaseConnectionMetricsInterface::Adaptee::~Adaptee()
+{
+}
+
+void BaseConnectionMetricsInterface::Adaptee::getMetrics(const ConnectionInterfaceMetricsAdaptor::GetMetricsContextPtr &context)
+{
+    if (!mInterface->mPriv->getMetricsCB.isValid()) {
+        context->setFinishedWithError(TP_QT_ERROR_NOT_IMPLEMENTED, QLatin1String("Not implemented"));
+        return;
+    }
+    Tp::DBusError error;
+    QVariantMap metrics = mInterface->mPriv->getMetricsCB(&error);
+    if (error.isValid()) {
+        context->setFinishedWithError(error.name(), error.message());
+        return;
+    }
+    context->setFinished(metrics);
+}
+
+void BaseConnectionMetricsInterface::Adaptee::flushTrace(const ConnectionInterfaceMetricsAdaptor::FlushTraceContextPtr &context)
+{
+    if (!mInterface->mPriv->flushTraceCB.isValid()) {
+        context->setFinishedWithError(TP_QT_ERROR_NOT_IMPLEMENTED, QLatin1String("Not implemented"));
+        return;
+    }
+    Tp::DBusError error;
+    QString path = mInterface->mPriv->flushTraceCB(&error);
+    if (error.isValid()) {
+        context->setFinishedWithError(error.name(), error.message());
+        return;
+    }
+    context->setFinished(path);
+}
+
+
+BaseConnectionMetricsInterface::BaseConnectionMetricsInterface()
+    : AbstractConnectionInterface(TP_QT_IFACE_CONNECTION_METRICS),
+      mPriv(new Private(this))
+{
+}
+
+BaseConnectionMetricsInterface::~BaseConnectionMetricsInterface()
+{
+    delete mPriv;
+}
+
+void BaseConnectionMetricsInterface::setGetMetricsCallback(const GetMetricsCallback &cb)
+{
+    mPriv->getMetricsCB = cb;
+}
+
+void BaseConnectionMetricsInterface::setFlushTraceCallback(const FlushTraceCallback &cb)
+{
+    mPriv->flushTraceCB = cb;
+}
+
+void BaseConnectionMetricsInterface::setMetrics(const QVariantMap &metrics)
+{
+    Q_EMIT mPriv->adaptee->metricsUpdated(metrics);
+}
+
+QVariantMap BaseConnectionMetricsInterface::immutableProperties() const
+{
+    QVariantMap map;
+    return map;
+}
+
+void BaseConnectionMetricsInterface::createAdaptor()
+{
+    (void) new ConnectionInterfaceMetricsAdaptor(dbusObject()->dbusConnection(),
+            mPriv->adaptee, dbusObject());
+}
+
+
+ConnectionInterfaceMetricsAdaptor::ConnectionInterfaceMetricsAdaptor(const QDBusConnection& bus, QObject* adaptee, QObject* parent)
+    : Tp::AbstractAdaptor(bus, adaptee, parent)
+{
+    connect(adaptee, SIGNAL(metricsUpdated(QVariantMap)), SIGNAL(MetricsUpdated(QVariantMap)));
+}
+
+ConnectionInterfaceMetricsAdaptor::~ConnectionInterfaceMetricsAdaptor()
+{
+}
+
+QVariantMap ConnectionInterfaceMetricsAdaptor::GetMetrics(const QDBusMessage& dbusMessage)
+{
+    if (adaptee()->metaObject()->indexOfMethod("getMetrics(ConnectionInterfaceMetricsAdaptor::GetMetricsContextPtr)") == -1) {
+        dbusConnection().send(dbusMessage.createErrorReply(TP_QT_ERROR_NOT_IMPLEMENTED, QLatin1String("Not implemented")));
+        return QVariantMap();
+    }
+
+    GetMetricsContextPtr ctx = GetMetricsContextPtr(
+            new Tp::MethodInvocationContext< QVariantMap >(dbusConnection(), dbusMessage));
+    QMetaObject::invokeMethod(adaptee(), "getMetrics",
+        Q_ARG(ConnectionInterfaceMetricsAdaptor::GetMetricsContextPtr, ctx));
+    return QVariantMap();
+}
+
+QString ConnectionInterfaceMetricsAdaptor::FlushTrace(const QDBusMessage& dbusMessage)
+{
+    if (adaptee()->metaObject()->indexOfMethod("flushTrace(ConnectionInterfaceMetricsAdaptor::FlushTraceContextPtr)") == -1) {
+        dbusConnection().send(dbusMessage.createErrorReply(TP_QT_ERROR_NOT_IMPLEMENTED, QLatin1String("Not implemented")));
+        return QString();
+    }
+
+    FlushTraceContextPtr ctx = FlushTraceContextPtr(
+            new Tp::MethodInvocationContext< QString >(dbusConnection(), dbusMessage));
+    QMetaObject::invokeMethod(adaptee(), "flushTrace",
+        Q_ARG(ConnectionInterfaceMetricsAdaptor::FlushTraceContextPtr, ctx));
+    return QString();
+}
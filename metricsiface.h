@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OFONOMETRICSIFACE_H
+#define OFONOMETRICSIFACE_H
+
+// telepathy-qt
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/BaseConnection>
+#include <TelepathyQt/AbstractAdaptor>
+#include <TelepathyQt/DBusError>
+#include <TelepathyQt/Callbacks>
+
+class BaseConnectionMetricsInterface;
+
+typedef Tp::SharedPtr<BaseConnectionMetricsInterface> BaseConnectionMetricsInterfacePtr;
+
+#define TP_QT_IFACE_CONNECTION_METRICS "com.canonical.Telephony.Metrics"
+
+class TP_QT_EXPORT BaseConnectionMetricsInterface : public Tp::AbstractConnectionInterface
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(BaseConnectionMetricsInterface)
+
+public:
+    static BaseConnectionMetricsInterfacePtr create() {
+        return BaseConnectionMetricsInterfacePtr(new BaseConnectionMetricsInterface());
+    }
+    template<typename BaseConnectionMetricsInterfaceSubclass>
+    static Tp::SharedPtr<BaseConnectionMetricsInterfaceSubclass> create() {
+        return Tp::SharedPtr<BaseConnectionMetricsInterfaceSubclass>(
+                   new BaseConnectionMetricsInterfaceSubclass());
+    }
+    QVariantMap immutableProperties() const;
+    virtual ~BaseConnectionMetricsInterface();
+
+    typedef Tp::Callback1<QVariantMap, Tp::DBusError*> GetMetricsCallback;
+    void setGetMetricsCallback(const GetMetricsCallback &cb);
+
+    typedef Tp::Callback1<QString, Tp::DBusError*> FlushTraceCallback;
+    void setFlushTraceCallback(const FlushTraceCallback &cb);
+
+public Q_SLOTS:
+    void setMetrics(const QVariantMap &metrics);
+
+protected:
+    BaseConnectionMetricsInterface();
+
+private:
+    void createAdaptor();
+
+    class Adaptee;
+    friend class Adaptee;
+    struct Private;
+    friend struct Private;
+    Private *mPriv;
+};
+
+
+class TP_QT_EXPORT ConnectionInterfaceMetricsAdaptor : public Tp::AbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", TP_QT_IFACE_CONNECTION_METRICS)
+    Q_CLASSINFO("D-Bus Introspection", ""
+"  <interface name=\"com.canonical.Telephony.Metrics\">\n"
+"    <method name=\"GetMetrics\">\n"
+"      <arg direction=\"out\" type=\"a{sv}\" name=\"metrics\"/>\n"
+"    </method>\n"
+"    <method name=\"FlushTrace\">\n"
+"      <arg direction=\"out\" type=\"s\" name=\"path\"/>\n"
+"    </method>\n"
+"    <signal name=\"MetricsUpdated\">\n"
+"      <arg type=\"a{sv}\" name=\"metrics\"/>\n"
+"    </signal>\n"
+"  </interface>\n"
+"")
+
+public:
+    ConnectionInterfaceMetricsAdaptor(const QDBusConnection& dbusConnection, QObject* adaptee, QObject* parent);
+    virtual ~ConnectionInterfaceMetricsAdaptor();
+
+    typedef Tp::MethodInvocationContextPtr< QVariantMap > GetMetricsContextPtr;
+    typedef Tp::MethodInvocationContextPtr< QString > FlushTraceContextPtr;
+
+public Q_SLOTS: // METHODS
+    QVariantMap GetMetrics(const QDBusMessage& dbusMessage);
+    QString FlushTrace(const QDBusMessage& dbusMessage);
+
+Q_SIGNALS: // SIGNALS
+    void MetricsUpdated(const QVariantMap &metrics);
+};
+
+
+class TP_QT_NO_EXPORT BaseConnectionMetricsInterface::Adaptee : public QObject
+{
+    Q_OBJECT
+
+public:
+    Adaptee(BaseConnectionMetricsInterface *interface);
+    ~Adaptee();
+
+private Q_SLOTS:
+    void getMetrics(const ConnectionInterfaceMetricsAdaptor::GetMetricsContextPtr &context);
+    void flushTrace(const ConnectionInterfaceMetricsAdaptor::FlushTraceContextPtr &context);
+
+Q_SIGNALS:
+    void metricsUpdated(const QVariantMap &metrics);
+
+public:
+    BaseConnectionMetricsInterface *mInterface;
+};
+
+#endif
@@ -20,6 +20,7 @@
 #include <QObject>
 
 #include "mmsdmanager.h"
+#include "logging.h"
 
 struct ServiceStruct {
     QDBusObjectPath path;
@@ -49,30 +50,25 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, ServiceStruct &se
 MMSDManager::MMSDManager(QObject *parent)
     : QObject(parent)
 {
-    QDBusReply<ServiceList> reply;
-    ServiceList services;
-
     QDBusMessage request;
 
     qDBusRegisterMetaType<ServiceStruct>();
     qDBusRegisterMetaType<ServiceList>();
 
-    request = QDBusMessage::createMethodCall("org.ofono.mms",
-                                             "/org/ofono/mms", "org.ofono.mms.Manager",
-                                             "GetServices");
-    reply = QDBusConnection::sessionBus().call(request);
-
-    services = reply;
-    Q_FOREACH(ServiceStruct service, services) {
-        m_services << service.path.path();
-    }
-
     QDBusConnection::sessionBus().connect("org.ofono.mms","/org/ofono/mms","org.ofono.mms.Manager",
                                           "ServiceAdded", this, 
                                           SLOT(onServiceAdded(const QDBusObjectPath&, const QVariantMap&)));
     QDBusConnection::sessionBus().connect("org.ofono.mms","/org/ofono/mms","org.ofono.mms.Manager",
                                           "ServiceRemoved", this, 
                                           SLOT(onServiceRemoved(const QDBusObjectPath&)));
+
+    // do not block the connection startup waiting for mmsd
+    request = QDBusMessage::createMethodCall("org.ofono.mms",
+                                             "/org/ofono/mms", "org.ofono.mms.Manager",
+                                             "GetServices");
+    QDBusConnection::sessionBus().callWithCallback(request, this,
+                                                   SLOT(onGetServicesReply(QDBusMessage)),
+                                                   SLOT(onGetServicesError(QDBusError)));
 }
 
 MMSDManager::~MMSDManager()
@@ -84,16 +80,41 @@ QStringList MMSDManager::services() const
     return m_services;
 }
 
+void MMSDManager::onGetServicesReply(const QDBusMessage &reply)
+{
+    if (reply.arguments().isEmpty()) {
+        qCWarning(lcMms) << "unexpected reply to GetServices" << reply.signature();
+        return;
+    }
+    ServiceList services = qdbus_cast<ServiceList>(reply.arguments().first());
+    // serviceAdded is left to the ServiceAdded signal, the connection picks
+    // up the services already there by itself (see onCheckMMSServices)
+    Q_FOREACH(ServiceStruct service, services) {
+        // the service might have been announced while the call was in flight
+        if (!m_services.contains(service.path.path())) {
+            m_services << service.path.path();
+        }
+    }
+}
+
+void MMSDManager::onGetServicesError(const QDBusError &error)
+{
+    qCDebug(lcMms) << "failed to get mms services" << error.message();
+}
+
 void MMSDManager::onServiceAdded(const QDBusObjectPath& path, const QVariantMap& map)
 {
-    qDebug() << "service added" << path.path() << map;
+    qCDebug(lcMms) << "service added" << path.path() << map;
+    if (m_services.contains(path.path())) {
+        return;
+    }
     m_services << path.path();
     Q_EMIT serviceAdded(path.path());
 }
 
 void MMSDManager::onServiceRemoved(const QDBusObjectPath& path)
 {
-    qDebug() << "service removed" << path.path();
+    qCDebug(lcMms) << "service removed" << path.path();
     m_services.removeAll(path.path());
     Q_EMIT serviceRemoved(path.path());
 }
@@ -22,6 +22,8 @@
 #include <QObject>
 #include <QVariantMap>
 #include <QDBusObjectPath>
+#include <QDBusMessage>
+#include <QDBusError>
 #include <QStringList>
 
 class MMSDManager : public QObject
@@ -38,6 +40,8 @@ Q_SIGNALS:
     void serviceRemoved(const QString &servicePath);
 
 private Q_SLOTS:
+    void onGetServicesReply(const QDBusMessage &reply);
+    void onGetServicesError(const QDBusError &error);
     void onServiceAdded(const QDBusObjectPath &path, const QVariantMap &properties);
     void onServiceRemoved(const QDBusObjectPath &path);
 
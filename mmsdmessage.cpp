@@ -20,6 +20,8 @@
 #include <QObject>
 
 #include "mmsdmessage.h"
+#include "metrics.h"
+#include "stallwatchdog.h"
 
 MMSDMessage::MMSDMessage(QString objectPath, QVariantMap properties, QObject *parent)
     : QObject(parent), 
@@ -58,6 +60,8 @@ void MMSDMessage::markRead() const
     request = QDBusMessage::createMethodCall("org.ofono.mms",
                                    m_messagePath, "org.ofono.mms.Message",
                                    "MarkRead");
+    MetricsTimer timer("dbus.blocking");
+    StallScope stallScope("mmsd.MarkRead");
     QDBusConnection::sessionBus().call(request);
 }
 
@@ -67,5 +71,7 @@ void MMSDMessage::remove() const
     request = QDBusMessage::createMethodCall("org.ofono.mms",
                                    m_messagePath, "org.ofono.mms.Message",
                                    "Delete");
+    MetricsTimer timer("dbus.blocking");
+    StallScope stallScope("mmsd.Delete");
     QDBusConnection::sessionBus().call(request);
 }
@@ -21,6 +21,9 @@
 
 #include "dbustypes.h"
 #include "mmsdservice.h"
+#include "metrics.h"
+#include "stallwatchdog.h"
+#include "logging.h"
 
 QDBusArgument &operator<<(QDBusArgument &argument, const MessageStruct &message)
 {
@@ -71,13 +74,21 @@ MMSDService::MMSDService(QString objectPath, oFonoConnection* connection, QObjec
     request = QDBusMessage::createMethodCall("org.ofono.mms",
                                              m_servicePath, "org.ofono.mms.Service",
                                              "GetProperties");
-    replyProperties = QDBusConnection::sessionBus().call(request);
+    {
+        MetricsTimer timer("dbus.blocking");
+        StallScope stallScope("mmsd.GetProperties");
+        replyProperties = QDBusConnection::sessionBus().call(request);
+    }
     m_properties = replyProperties;
 
     request = QDBusMessage::createMethodCall("org.ofono.mms",
                                              m_servicePath, "org.ofono.mms.Service",
                                              "GetMessages");
-    replyMessages = QDBusConnection::sessionBus().call(request);
+    {
+        MetricsTimer timer("dbus.blocking");
+        StallScope stallScope("mmsd.GetMessages");
+        replyMessages = QDBusConnection::sessionBus().call(request);
+    }
 
     m_messages = replyMessages;
 
@@ -115,13 +126,13 @@ MessageList MMSDService::messages() const
 
 void MMSDService::onMessageAdded(const QDBusObjectPath &path, const QVariantMap &properties)
 {
-    qDebug() << "message added" << path.path() << properties;
+    qCDebug(lcMms) << "message added" << path.path() << properties;
     Q_EMIT messageAdded(path.path(), properties);
 }
 
 void MMSDService::onMessageRemoved(const QDBusObjectPath& path)
 {
-    qDebug() << "message removed" << path.path();
+    qCDebug(lcMms) << "message removed" << path.path();
     Q_EMIT messageRemoved(path.path());
 }
 
@@ -136,7 +147,11 @@ QDBusObjectPath MMSDService::sendMessage(QStringList recipients, OutgoingAttachm
                                              m_servicePath, "org.ofono.mms.Service",
                                              "SendMessage");
     request.setArguments(arguments);
-    reply = QDBusConnection::sessionBus().call(request);
+    {
+        MetricsTimer timer("dbus.blocking");
+        StallScope stallScope("mmsd.SendMessage");
+        reply = QDBusConnection::sessionBus().call(request);
+    }
 
     return reply;
 }
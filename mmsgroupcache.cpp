@@ -27,7 +27,7 @@ MMSGroupCache::MMSGroupCache(QObject *parent) : QObject(parent)
 {
 }
 
-MMSGroup MMSGroupCache::existingGroup(const QStringList &members)
+MMSGroup MMSGroupCache::existingGroup(const QStringList &members, NumberingContext *context)
 {
     MMSGroup group;
     if (members.isEmpty()) {
@@ -37,9 +37,10 @@ MMSGroup MMSGroupCache::existingGroup(const QStringList &members)
     // try to find all the threads which at least the first member is part of
     QString firstMember = members.first();
     QSqlQuery query(SQLiteDatabase::instance()->database());
-    query.prepare("SELECT groupId FROM mms_group_members WHERE comparePhoneNumbers(memberId, :memberId)");
+    query.prepare("SELECT groupId FROM mms_group_members WHERE comparePhoneNumbers(memberId, :memberId, :mcc)");
     query.bindValue(":memberId", firstMember);
-    if (!query.exec()) {
+    query.bindValue(":mcc", context ? context->mcc() : QString(""));
+    if (!SQLiteDatabase::exec(query)) {
         return group;
     }
 
@@ -52,7 +53,7 @@ MMSGroup MMSGroupCache::existingGroup(const QStringList &members)
     for (auto groupId : groupIds) {
         query.prepare("SELECT memberId FROM mms_group_members WHERE groupId=:groupId");
         query.bindValue(":groupId", groupId);
-        if (!query.exec()) {
+        if (!SQLiteDatabase::exec(query)) {
             return group;
         }
         QStringList groupMembers;
@@ -69,7 +70,7 @@ MMSGroup MMSGroupCache::existingGroup(const QStringList &members)
         int match = 0;
         for (auto groupMember : groupMembers) {
             for (auto member : members) {
-                if (PhoneUtils::comparePhoneNumbers(groupMember, member)) {
+                if (PhoneUtils::comparePhoneNumbers(groupMember, member, context)) {
                     match++;
                     continue;
                 }
@@ -78,7 +79,7 @@ MMSGroup MMSGroupCache::existingGroup(const QStringList &members)
         if (match == members.count()) {
             query.prepare("SELECT subject FROM mms_groups WHERE groupId=:groupId");
             query.bindValue(":groupId", groupId);
-            if (query.exec()) {
+            if (SQLiteDatabase::exec(query)) {
                 query.next();
                 group.subject = query.value(0).toString();
             }
@@ -98,12 +99,12 @@ MMSGroup MMSGroupCache::existingGroup(const QString &groupId)
     QSqlQuery query(SQLiteDatabase::instance()->database());
     query.prepare("SELECT subject FROM mms_groups WHERE groupId=:groupId");
     query.bindValue(":groupId", groupId);
-    if (query.exec() && query.next()) {
+    if (SQLiteDatabase::exec(query) && query.next()) {
         group.groupId = groupId;
         group.subject = query.value(0).toString();
         query.prepare("SELECT memberId FROM mms_group_members WHERE groupId=:groupId");
         query.bindValue(":groupId", groupId);
-        if (!query.exec()) {
+        if (!SQLiteDatabase::exec(query)) {
             return group;
         }
 
@@ -123,7 +124,7 @@ bool MMSGroupCache::saveGroup(const MMSGroup &group)
     query.prepare("INSERT INTO mms_groups(groupId, subject) VALUES (:groupId, :subject)");
     query.bindValue(":groupId", group.groupId);
     query.bindValue(":subject", group.subject);
-    if (!query.exec()) {
+    if (!SQLiteDatabase::exec(query)) {
         SQLiteDatabase::instance()->rollbackTransaction();
         return false;
     }
@@ -131,7 +132,7 @@ bool MMSGroupCache::saveGroup(const MMSGroup &group)
         query.prepare("INSERT INTO mms_group_members(groupId, memberId) VALUES(:groupId, :memberId)");
         query.bindValue(":groupId", group.groupId);
         query.bindValue(":memberId", member);
-        if (!query.exec()) {
+        if (!SQLiteDatabase::exec(query)) {
             SQLiteDatabase::instance()->rollbackTransaction();
             return false;
         }
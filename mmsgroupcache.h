@@ -22,6 +22,8 @@
 #include <QObject>
 #include <QStringList>
 
+class NumberingContext;
+
 typedef struct {
     QString groupId;
     QString subject;
@@ -32,7 +34,7 @@ class MMSGroupCache : public QObject
 {
     Q_OBJECT
 public:
-    static MMSGroup existingGroup(const QStringList &members);
+    static MMSGroup existingGroup(const QStringList &members, NumberingContext *context = 0);
     static MMSGroup existingGroup(const QString &groupId);
     static bool saveGroup(const MMSGroup &group);
     static QString generateId(const QStringList &phoneNumbers);
@@ -0,0 +1,102 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "modemrequestscheduler.h"
+
+ModemRequestScheduler::ModemRequestScheduler(QObject *parent)
+    : QObject(parent)
+{
+    for (int i = 0; i < PriorityCount; i++) {
+        mLimits[i] = 0;
+    }
+    // each message send blocks until the modem accepted it
+    mLimits[PriorityBulkMessage] = 1;
+
+    mClock.start();
+    mDispatchTimer.setSingleShot(true);
+    mDispatchTimer.setInterval(0);
+    QObject::connect(&mDispatchTimer, SIGNAL(timeout()), SLOT(dispatch()));
+}
+
+int ModemRequestScheduler::dispatchLimit(Priority priority) const
+{
+    return mLimits[priority];
+}
+
+void ModemRequestScheduler::setDispatchLimit(Priority priority, int limit)
+{
+    mLimits[priority] = qMax(0, limit);
+}
+
+void ModemRequestScheduler::submit(Priority priority, const Request &request)
+{
+    QueuedRequest queued;
+    queued.request = request;
+    queued.queuedAt = mClock.elapsed();
+    mQueues[priority].enqueue(queued);
+
+    Statistics &statistics = mStatistics[priority];
+    statistics.queued = mQueues[priority].size();
+    statistics.maxQueued = qMax(statistics.maxQueued, statistics.queued);
+
+    if (!mDispatchTimer.isActive()) {
+        mDispatchTimer.start();
+    }
+}
+
+void ModemRequestScheduler::dispatch()
+{
+    for (int i = 0; i < PriorityCount; i++) {
+        QQueue<QueuedRequest> &queue = mQueues[i];
+        Statistics &statistics = mStatistics[i];
+        int dispatched = 0;
+        while (!queue.isEmpty() && (mLimits[i] == 0 || dispatched < mLimits[i])) {
+            QueuedRequest queued = queue.dequeue();
+            qint64 wait = mClock.elapsed() - queued.queuedAt;
+            statistics.queued = queue.size();
+            statistics.totalWait += wait;
+            statistics.maxWait = qMax(statistics.maxWait, wait);
+            statistics.executed++;
+            dispatched++;
+            // the request might queue more requests
+            queued.request();
+        }
+    }
+
+    // give the event loop a chance to deliver more urgent requests first
+    if (queueDepth() > 0) {
+        mDispatchTimer.start();
+    }
+}
+
+int ModemRequestScheduler::queueDepth(Priority priority) const
+{
+    return mQueues[priority].size();
+}
+
+int ModemRequestScheduler::queueDepth() const
+{
+    int depth = 0;
+    for (int i = 0; i < PriorityCount; i++) {
+        depth += mQueues[i].size();
+    }
+    return depth;
+}
+
+ModemRequestScheduler::Statistics ModemRequestScheduler::statistics(Priority priority) const
+{
+    return mStatistics[priority];
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODEMREQUESTSCHEDULER_H
+#define MODEMREQUESTSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QQueue>
+#include <QTimer>
+
+#include <functional>
+
+// Queues the modem requests of a connection whose result is reported later
+// through ofono-qt signals (answer, hangup, hold, merge, split, USSD and the
+// tail of SMS broadcasts), and dispatches them by priority. Each pass of the event loop
+// dispatches a limited number of requests per class, so call control requests
+// never wait behind more than one queued message.
+// Requests whose result the caller needs right away (dial, createMultiparty,
+// 1-1 SMS and MMS sends returning the message path) are blocking ofono-qt
+// calls and are issued directly, without going through the scheduler.
+class ModemRequestScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    // from the most to the least urgent
+    enum Priority {
+        PriorityCallControl = 0,
+        PriorityUssd,
+        PriorityBulkMessage,
+        PriorityCount
+    };
+
+    typedef std::function<void()> Request;
+
+    struct Statistics {
+        Statistics() : executed(0), queued(0), maxQueued(0), totalWait(0), maxWait(0) {}
+        quint64 executed;
+        // current and highest queue depth
+        int queued;
+        int maxQueued;
+        // milliseconds spent in the queue
+        qint64 totalWait;
+        qint64 maxWait;
+    };
+
+    explicit ModemRequestScheduler(QObject *parent = 0);
+
+    // requests of the class dispatched per pass, 0 for no limit
+    int dispatchLimit(Priority priority) const;
+    void setDispatchLimit(Priority priority, int limit);
+
+    // queues the request, to be dispatched once nothing more urgent is pending
+    void submit(Priority priority, const Request &request);
+
+    int queueDepth(Priority priority) const;
+    int queueDepth() const;
+    Statistics statistics(Priority priority) const;
+
+private Q_SLOTS:
+    void dispatch();
+
+private:
+    struct QueuedRequest {
+        Request request;
+        qint64 queuedAt;
+    };
+
+    QQueue<QueuedRequest> mQueues[PriorityCount];
+    int mLimits[PriorityCount];
+    Statistics mStatistics[PriorityCount];
+    QTimer mDispatchTimer;
+    QElapsedTimer mClock;
+};
+
+#endif
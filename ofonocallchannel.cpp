@@ -17,6 +17,10 @@
  */
 
 #include "ofonocallchannel.h"
+#include "logging.h"
+#include "metrics.h"
+#include "stallwatchdog.h"
+#include "tracing.h"
 #ifdef USE_PULSEAUDIO
 #include "qpulseaudioengine.h"
 #endif
@@ -29,7 +33,6 @@ oFonoCallChannel::oFonoCallChannel(oFonoConnection *conn, QString phoneNumber, u
     mConnection(conn),
     mPhoneNumber(phoneNumber),
     mTargetHandle(targetHandle),
-    mDtmfLock(false),
     mMultiparty(false)
     
 {
@@ -66,6 +69,11 @@ oFonoCallChannel::oFonoCallChannel(oFonoConnection *conn, QString phoneNumber, u
 
     QObject::connect(this, SIGNAL(hangupComplete(bool)), this, SLOT(onHangupComplete(bool)));
     QObject::connect(this, SIGNAL(answerComplete(bool)), this, SLOT(onAnswerComplete(bool)));
+    // hanging up has to succeed eventually, so it is retried every 2s
+    // until ofono accepts it, while answering late is pointless
+    mRetryScheduler.setPolicy("hangup", RetryPolicy(-1, 250, 2000));
+    mRetryScheduler.setPolicy("answer", RetryPolicy(5, 250, 1000));
+    mRetryScheduler.setPolicy("swapCalls", RetryPolicy(5, 500, 2000));
     // init must be called after initialization, otherwise we will have no object path registered.
     QTimer::singleShot(0, this, SLOT(init()));
 
@@ -84,35 +92,41 @@ Tp::CallState oFonoCallChannel::callState()
 
 void oFonoCallChannel::onSplit(Tp::DBusError *error)
 {
-    mConnection->voiceCallManager()->privateChat(path());
+    oFonoConnection *connection = mConnection;
+    QString callPath = path();
+    mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityCallControl, [connection, callPath]() {
+        connection->voiceCallManager()->privateChat(callPath);
+    });
 }
 
 void oFonoCallChannel::onSetActiveAudioOutput(const QString &id, Tp::DBusError *error)
 {
-#ifdef USE_PULSEAUDIO
-    // fallback to earpiece/headset
-    AudioMode mode = AudioModeWiredOrEarpiece;
-    if (id == "bluetooth") {
-        mode = AudioModeBluetooth;
-    } else if (id == "speaker") {
-        mode = AudioModeSpeaker;
-    }
-    if (mHasPulseAudio)
-        QPulseAudioEngine::instance()->setCallMode(CallActive, mode);
-#endif
+    mConnection->selectAudioOutput(id);
 }
 
 void oFonoCallChannel::onHangupComplete(bool status)
 {
-    if (!status) {
-        QTimer::singleShot(2000, this, SLOT(hangup()));
+    if (status) {
+        mRetryScheduler.cancel("hangup");
+    } else {
+        mRetryScheduler.retry("hangup", this, "requestHangup");
     }
 }
 
 void oFonoCallChannel::onAnswerComplete(bool status)
 {
-    if (!status) {
-        QTimer::singleShot(1000, this, SLOT(answer()));
+    if (status) {
+        mRetryScheduler.cancel("answer");
+    } else if (!mRetryScheduler.retry("answer", this, "requestAnswer")) {
+        // the call is still ringing, so take it out of Accepted and let
+        // the user try again
+        QVariantMap stateDetails;
+        Tp::CallStateReason reason;
+        reason.actor =  0;
+        reason.reason = Tp::CallStateChangeReasonInternalError;
+        reason.message = errorMessage();
+        reason.DBusReason = TP_QT_ERROR_NETWORK_ERROR;
+        mCallChannel->setCallState(Tp::CallStateInitialised, 0, reason, stateDetails);
     }
 }
 
@@ -120,7 +134,9 @@ void oFonoCallChannel::onHangup(uint reason, const QString &detailedReason, cons
 {
     // TODO: use the parameters sent by telepathy
     mRequestedHangup = true;
-    hangup();
+    // no point in answering anymore
+    mRetryScheduler.cancel("answer");
+    requestHangup();
 }
 
 void oFonoCallChannel::onAccept(Tp::DBusError*)
@@ -133,16 +149,56 @@ void oFonoCallChannel::onAccept(Tp::DBusError*)
     reason.DBusReason = "";
     mCallChannel->setCallState(Tp::CallStateAccepted, 0, reason, stateDetails);
 
+#ifdef USE_PULSEAUDIO
+    if (mHasPulseAudio)
+        QPulseAudioEngine::instance()->callAnswered();
+#endif
+
     if (this->state() == "waiting") {
-        mConnection->voiceCallManager()->holdAndAnswer();
+        oFonoConnection *connection = mConnection;
+        mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityCallControl, [connection]() {
+            connection->voiceCallManager()->holdAndAnswer();
+        });
     } else {
-        answer();
+        requestAnswer();
     }
 }
 
+void oFonoCallChannel::requestHangup()
+{
+    QPointer<oFonoCallChannel> channel(this);
+    mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityCallControl, [channel]() {
+        if (!channel.isNull()) {
+            channel->hangup();
+        }
+    });
+}
+
+void oFonoCallChannel::requestAnswer()
+{
+    QPointer<oFonoCallChannel> channel(this);
+    mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityCallControl, [channel]() {
+        if (!channel.isNull()) {
+            channel->answer();
+        }
+    });
+}
+
+void oFonoCallChannel::requestSwapCalls()
+{
+    oFonoConnection *connection = mConnection;
+    mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityCallControl, [connection]() {
+        connection->voiceCallManager()->swapCalls();
+    });
+}
+
 void oFonoCallChannel::init()
 {
+    TraceScope trace("call", "initCallChannel");
+    Tracer::instance()->flow('f', "call", "call", path());
     mIncoming = this->state() == "incoming" || this->state() == "waiting";
+    mSetupTimer.start();
+    Metrics::instance()->increment(mIncoming ? "calls.in" : "calls.out");
     mMultiparty = this->multiparty();
     mPreviousState = this->state();
     mObjPath = mBaseChannel->objectPath();
@@ -183,6 +239,7 @@ void oFonoCallChannel::init()
     QObject::connect(mConnection, SIGNAL(activeAudioOutputChanged(QString)), mAudioOutputsIface.data(), SLOT(setActiveAudioOutput(QString)));
     QObject::connect(mConnection, SIGNAL(audioOutputsChanged(AudioOutputList)), mAudioOutputsIface.data(), SLOT(setAudioOutputs(AudioOutputList)));
     QObject::connect(mConnection->voiceCallManager(), SIGNAL(sendTonesComplete(bool)), SLOT(onDtmfComplete(bool)));
+    QObject::connect(&mDtmfPipeline, SIGNAL(sendTones(QString)), mConnection->voiceCallManager(), SLOT(sendTones(QString)));
     QObject::connect(this, SIGNAL(multipartyChanged(bool)), this, SLOT(onMultipartyChanged(bool)));
     
     QObject::connect(this, SIGNAL(disconnectReason(const QString &)), this, SLOT(onDisconnectReason(const QString &)));
@@ -215,28 +272,36 @@ void oFonoCallChannel::onOfonoMuteChanged(bool mute)
 void oFonoCallChannel::onHoldStateChanged(const Tp::LocalHoldState &state, const Tp::LocalHoldStateReason &reason, Tp::DBusError *error)
 {
     if (state == Tp::LocalHoldStateHeld && this->state() == "active") {
-        QObject::connect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)));
-        mConnection->voiceCallManager()->swapCalls();
+        QObject::connect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)), Qt::UniqueConnection);
+        requestSwapCalls();
         mHoldIface->setHoldState(Tp::LocalHoldStatePendingHold, Tp::LocalHoldStateReasonRequested);
     } else if (state == Tp::LocalHoldStateUnheld && this->state() == "held") {
-        QObject::connect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)));
-        mConnection->voiceCallManager()->swapCalls();
+        QObject::connect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)), Qt::UniqueConnection);
+        requestSwapCalls();
         mHoldIface->setHoldState(Tp::LocalHoldStatePendingUnhold, Tp::LocalHoldStateReasonRequested);
     }
 }
 
 void oFonoCallChannel::onSwapCallsComplete(bool success)
 {
-    if (!success && errorName() == "org.ofono.Error.InProgress") {
-        QTimer::singleShot(2000, mConnection->voiceCallManager(), SLOT(swapCalls()));
+    if (!success && errorName() == "org.ofono.Error.InProgress" &&
+            mRetryScheduler.retry("swapCalls", this, "requestSwapCalls")) {
         return;
     }
+    cancelSwapCalls();
     Tp::LocalHoldState holdState = this->state() == "active" ? Tp::LocalHoldStateUnheld : Tp::LocalHoldStateHeld;
     Tp::LocalHoldStateReason reason = success ? Tp::LocalHoldStateReasonRequested : Tp::LocalHoldStateReasonResourceNotAvailable;
-    QObject::disconnect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)));
     mHoldIface->setHoldState(holdState, reason);
 }
 
+void oFonoCallChannel::cancelSwapCalls()
+{
+    // swapCallsComplete is emitted for the swaps of every channel, so stop
+    // listening as soon as ours is done, or we would retry the swaps of others
+    mRetryScheduler.cancel("swapCalls");
+    QObject::disconnect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)));
+}
+
 void oFonoCallChannel::onMuteStateChanged(const Tp::LocalMuteState &state, Tp::DBusError *error)
 {
     if (state == Tp::LocalMuteStateMuted) {
@@ -254,35 +319,13 @@ void oFonoCallChannel::onMuteStateChanged(const Tp::LocalMuteState &state, Tp::D
     }
 }
 
-void oFonoCallChannel::sendNextDtmf()
-{
-    if (mDtmfLock) {
-        return;
-    }
-    if (!mDtmfPendingStrings.isEmpty()) {
-        mDtmfLock = true;
-        mConnection->voiceCallManager()->sendTones(mDtmfPendingStrings.front());
-    }
-}
-
 void oFonoCallChannel::onDtmfComplete(bool success)
 {
     // this might be a response for another channel
     if (mCallChannel->callState() != Tp::CallStateActive) {
         return;
     }
-    mDtmfLock = false;
-    if (success) {
-       if (mDtmfPendingStrings.count() > 0) {
-           mDtmfPendingStrings.removeFirst();
-       }
-       if (mDtmfPendingStrings.isEmpty()) {
-           return;
-       }
-       sendNextDtmf();
-    } else {
-        QTimer::singleShot(1000, this, SLOT(sendNextDtmf()));
-    }
+    mDtmfPipeline.onSendTonesComplete(success);
 }
 
 void oFonoCallChannel::onDTMFStartTone(uchar event, Tp::DBusError *error)
@@ -296,15 +339,8 @@ void oFonoCallChannel::onDTMFStartTone(uchar event, Tp::DBusError *error)
         finalString = QString::number(event);
     }
 
-    qDebug() << "start tone" << finalString;
-    // we can't append to the first item in the queue as it is being sent and 
-    // we dont know yet if it will succeed or not.
-    if (mDtmfPendingStrings.count() > 1) {
-        mDtmfPendingStrings[1] += finalString;
-    } else {
-        mDtmfPendingStrings << finalString;
-    }
-    sendNextDtmf();
+    qCDebug(lcCall) << "start tone" << finalString;
+    mDtmfPipeline.appendTones(finalString);
 }
 
 void oFonoCallChannel::onDTMFStopTone(Tp::DBusError *error)
@@ -313,7 +349,7 @@ void oFonoCallChannel::onDTMFStopTone(Tp::DBusError *error)
 
 oFonoCallChannel::~oFonoCallChannel()
 {
-    qDebug() << "call channel closed";
+    qCDebug(lcCall) << "call channel closed";
     // TODO - for some reason the object is not being removed
     mConnection->dbusConnection().unregisterObject(mObjPath, QDBusConnection::UnregisterTree);
 }
@@ -332,20 +368,32 @@ void oFonoCallChannel::onOfonoCallStateChanged(const QString &state)
     reason.message = "";
     reason.DBusReason = "";
     // we invalidate the pending dtmf strings if the call status is changed
-    mDtmfPendingStrings.clear();
-    mDtmfLock = false;
+    mDtmfPipeline.clear();
+    // and drop the retries the new state already fulfills
     if (state == "disconnected") {
-        qDebug() << "disconnected";
+        mRetryScheduler.cancelAll();
+        cancelSwapCalls();
+    } else if (state == "active" && mPreviousState != "held") {
+        mRetryScheduler.cancel("answer");
+    } else if ((state == "active" && mPreviousState == "held") ||
+               (state == "held" && mPreviousState == "active")) {
+        cancelSwapCalls();
+    }
+    if (state == "disconnected") {
+        qCDebug(lcCall) << "disconnected";
         if (mIncoming && (mPreviousState == "incoming" || mPreviousState == "waiting") && !mRequestedHangup) {
             reason.reason = Tp::CallStateChangeReasonNoAnswer;
         }
         mCallChannel->setCallState(Tp::CallStateEnded, 0, reason, stateDetails);
         // just in case, leave the channel opened for one more second before unregistering from bus
-        QThread::msleep(1000);
+        {
+            StallScope stallScope("call.closeDelay");
+            QThread::msleep(1000);
+        }
         Q_EMIT closed();
         mBaseChannel->close();
     } else if (state == "active") {
-        qDebug() << "active";
+        qCDebug(lcCall) << "active";
         mHoldIface->setHoldState(Tp::LocalHoldStateUnheld, Tp::LocalHoldStateReasonNone);
         if (mMultiparty) {
             Q_EMIT multipartyCallActive();
@@ -358,21 +406,25 @@ void oFonoCallChannel::onOfonoCallStateChanged(const QString &state)
             mConnection->callVolume()->setMuted(false);
             mCallChannel->setCallState(Tp::CallStateAccepted, 0, reason, stateDetails);
         }
+        if (mSetupTimer.isValid() && (mPreviousState == "dialing" || mPreviousState == "alerting")) {
+            Metrics::instance()->record("call.setup", mSetupTimer.nsecsElapsed() / 1000);
+            mSetupTimer.invalidate();
+        }
         mCallChannel->setCallState(Tp::CallStateActive, 0, reason, stateDetails);
     } else if (state == "held") {
         mHoldIface->setHoldState(Tp::LocalHoldStateHeld, Tp::LocalHoldStateReasonNone);
         if (mMultiparty) {
             Q_EMIT multipartyCallHeld();
         }
-        qDebug() << "held";
+        qCDebug(lcCall) << "held";
     } else if (state == "dialing") {
-        qDebug() << "dialing";
+        qCDebug(lcCall) << "dialing";
     } else if (state == "alerting") {
-        qDebug() << "alerting";
+        qCDebug(lcCall) << "alerting";
     } else if (state == "incoming") {
-        qDebug() << "incoming";
+        qCDebug(lcCall) << "incoming";
     } else if (state == "waiting") {
-        qDebug() << "waiting";
+        qCDebug(lcCall) << "waiting";
     }
     // always update the audio route when call state changes
     mConnection->updateAudioRoute();
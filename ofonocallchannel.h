@@ -20,6 +20,8 @@
 #define OFONOCALLCHANNEL_H
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <QPointer>
 
 #include <TelepathyQt/Constants>
 #include <TelepathyQt/BaseChannel>
@@ -30,6 +32,8 @@
 
 #include "connection.h"
 #include "audiooutputsiface.h"
+#include "dtmfpipeline.h"
+#include "retryscheduler.h"
 
 class oFonoConnection;
 
@@ -62,16 +66,21 @@ private Q_SLOTS:
     void onOfonoCallStateChanged(const QString &state);
     void onDtmfComplete(bool success);
     void onSwapCallsComplete(bool success);
-    void sendNextDtmf();
     void init();
     void onAnswerComplete(bool success);
     void onHangupComplete(bool success);
+    // queue the request on the connection modem request scheduler
+    void requestHangup();
+    void requestAnswer();
+    void requestSwapCalls();
 
     void onOfonoMuteChanged(bool mute);
     void onMultipartyChanged(bool multiparty);
     void onDisconnectReason(const QString &reason);
 
 private:
+    void cancelSwapCalls();
+
     QString mObjPath;
     QString mPreviousState;
 #ifdef USE_PULSEAUDIO
@@ -90,9 +99,11 @@ private:
     Tp::BaseChannelCallTypePtr mCallChannel;
     Tp::BaseCallContentDTMFInterfacePtr mDTMFIface;
     Tp::BaseCallContentPtr mCallContent;
-    bool mDtmfLock;
-    QStringList mDtmfPendingStrings;
+    DtmfPipeline mDtmfPipeline;
+    RetryScheduler mRetryScheduler;
     bool mMultiparty;
+    // time since the call showed up, used for the setup latency
+    QElapsedTimer mSetupTimer;
 };
 
 #endif // OFONOCALLCHANNEL_H
@@ -21,12 +21,12 @@
 #include "qpulseaudioengine.h"
 #endif
 #include "ofonocallchannel.h"
+#include "logging.h"
 
 
 oFonoConferenceCallChannel::oFonoConferenceCallChannel(oFonoConnection *conn, QObject *parent):
     mRequestedHangup(false),
-    mConnection(conn),
-    mDtmfLock(false)
+    mConnection(conn)
 {
 
     Q_FOREACH(oFonoCallChannel *channel, mConnection->callChannels().values()) {
@@ -90,7 +90,10 @@ Tp::BaseChannelPtr oFonoConferenceCallChannel::baseChannel()
 void oFonoConferenceCallChannel::onMerge(const QDBusObjectPath &channel, Tp::DBusError *error)
 {
     // on gsm we always merge all the existing calls
-    mConnection->voiceCallManager()->createMultiparty();
+    oFonoConnection *connection = mConnection;
+    mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityCallControl, [connection]() {
+        connection->voiceCallManager()->createMultiparty();
+    });
 }
 
 void oFonoConferenceCallChannel::onChannelMerged(const QDBusObjectPath &path)
@@ -127,23 +130,17 @@ void oFonoConferenceCallChannel::onChannelSplitted(const QDBusObjectPath &path)
 
 void oFonoConferenceCallChannel::onSetActiveAudioOutput(const QString &id, Tp::DBusError *error)
 {
-#ifdef USE_PULSEAUDIO
-    // fallback to earpiece/headset
-    AudioMode mode = AudioModeWiredOrEarpiece;
-    if (id == "bluetooth") {
-        mode = AudioModeBluetooth;
-    } else if (id == "speaker") {
-        mode = AudioModeSpeaker;
-    }
-    QPulseAudioEngine::instance()->setCallMode(CallActive, mode);
-#endif
+    mConnection->selectAudioOutput(id);
 }
 
 void oFonoConferenceCallChannel::onHangup(uint reason, const QString &detailedReason, const QString &message, Tp::DBusError *error)
 {
     // TODO: use the parameters sent by telepathy
     //mRequestedHangup = true;
-    mConnection->voiceCallManager()->hangupMultiparty();
+    oFonoConnection *connection = mConnection;
+    mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityCallControl, [connection]() {
+        connection->voiceCallManager()->hangupMultiparty();
+    });
     //hangup();
 }
 
@@ -176,6 +173,7 @@ void oFonoConferenceCallChannel::init()
     QObject::connect(mConnection, SIGNAL(activeAudioOutputChanged(QString)), mAudioOutputsIface.data(), SLOT(setActiveAudioOutput(QString)));
     QObject::connect(mConnection, SIGNAL(audioOutputsChanged(AudioOutputList)), mAudioOutputsIface.data(), SLOT(setAudioOutputs(AudioOutputList)));
     QObject::connect(mConnection->voiceCallManager(), SIGNAL(sendTonesComplete(bool)), SLOT(onDtmfComplete(bool)));
+    QObject::connect(&mDtmfPipeline, SIGNAL(sendTones(QString)), mConnection->voiceCallManager(), SLOT(sendTones(QString)));
 
     mAudioOutputsIface->setAudioOutputs(mConnection->audioOutputs());
     mAudioOutputsIface->setActiveAudioOutput(mConnection->activeAudioOutput());
@@ -205,14 +203,22 @@ void oFonoConferenceCallChannel::onHoldStateChanged(const Tp::LocalHoldState &st
     if (state == Tp::LocalHoldStateHeld && mHoldIface->getHoldState() == Tp::LocalHoldStateUnheld) {
         QObject::connect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)));
         mHoldIface->setHoldState(Tp::LocalHoldStatePendingHold, Tp::LocalHoldStateReasonRequested);
-        mConnection->voiceCallManager()->swapCalls();
+        requestSwapCalls();
     } else if (state == Tp::LocalHoldStateUnheld && mHoldIface->getHoldState() == Tp::LocalHoldStateHeld) {
         QObject::connect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)));
         mHoldIface->setHoldState(Tp::LocalHoldStatePendingUnhold, Tp::LocalHoldStateReasonRequested);
-        mConnection->voiceCallManager()->swapCalls();
+        requestSwapCalls();
     }
 }
 
+void oFonoConferenceCallChannel::requestSwapCalls()
+{
+    oFonoConnection *connection = mConnection;
+    mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityCallControl, [connection]() {
+        connection->voiceCallManager()->swapCalls();
+    });
+}
+
 void oFonoConferenceCallChannel::onSwapCallsComplete(bool success)
 {
     QObject::disconnect(mConnection->voiceCallManager(), SIGNAL(swapCallsComplete(bool)), this, SLOT(onSwapCallsComplete(bool)));
@@ -238,35 +244,13 @@ void oFonoConferenceCallChannel::onMuteStateChanged(const Tp::LocalMuteState &st
     }
 }
 
-void oFonoConferenceCallChannel::sendNextDtmf()
-{
-    if (mDtmfLock) {
-        return;
-    }
-    if (!mDtmfPendingStrings.isEmpty()) {
-        mDtmfLock = true;
-        mConnection->voiceCallManager()->sendTones(mDtmfPendingStrings.front());
-    }
-}
-
 void oFonoConferenceCallChannel::onDtmfComplete(bool success)
 {
     // this might be a response for another channel
     if (mCallChannel->callState() != Tp::CallStateActive) {
         return;
     }
-    mDtmfLock = false;
-    if (success) {
-       if (mDtmfPendingStrings.count() > 0) {
-           mDtmfPendingStrings.removeFirst();
-       }
-       if (mDtmfPendingStrings.isEmpty()) {
-           return;
-       }
-       sendNextDtmf();
-    } else {
-        QTimer::singleShot(1000, this, SLOT(sendNextDtmf()));
-    }
+    mDtmfPipeline.onSendTonesComplete(success);
 }
 
 void oFonoConferenceCallChannel::onDTMFStartTone(uchar event, Tp::DBusError *error)
@@ -280,15 +264,8 @@ void oFonoConferenceCallChannel::onDTMFStartTone(uchar event, Tp::DBusError *err
         finalString = QString::number(event);
     }
 
-    qDebug() << "start tone" << finalString;
-    // we can't append to the first item in the queue as it is being sent and 
-    // we dont know yet if it will succeed or not.
-    if (mDtmfPendingStrings.count() > 1) {
-        mDtmfPendingStrings[1] += finalString;
-    } else {
-        mDtmfPendingStrings << finalString;
-    }
-    sendNextDtmf();
+    qCDebug(lcCall) << "start tone" << finalString;
+    mDtmfPipeline.appendTones(finalString);
 }
 
 void oFonoConferenceCallChannel::onDTMFStopTone(Tp::DBusError *error)
@@ -297,7 +274,7 @@ void oFonoConferenceCallChannel::onDTMFStopTone(Tp::DBusError *error)
 
 oFonoConferenceCallChannel::~oFonoConferenceCallChannel()
 {
-    qDebug() << "conference call channel closed";
+    qCDebug(lcCall) << "conference call channel closed";
     // TODO - for some reason the object is not being removed
     mConnection->dbusConnection().unregisterObject(mObjPath, QDBusConnection::UnregisterTree);
 }
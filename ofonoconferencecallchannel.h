@@ -30,6 +30,7 @@
 
 #include "connection.h"
 #include "audiooutputsiface.h"
+#include "dtmfpipeline.h"
 
 class oFonoConnection;
 
@@ -52,7 +53,6 @@ public:
 
 private Q_SLOTS:
     void onDtmfComplete(bool success);
-    void sendNextDtmf();
     void init();
 
     void onOfonoMuteChanged(bool mute);
@@ -61,6 +61,8 @@ private Q_SLOTS:
     void onSwapCallsComplete(bool success);
 
 private:
+    void requestSwapCalls();
+
     QString mObjPath;
     QString mPreviousState;
     bool mIncoming;
@@ -76,8 +78,7 @@ private:
     Tp::BaseChannelCallTypePtr mCallChannel;
     Tp::BaseCallContentDTMFInterfacePtr mDTMFIface;
     Tp::BaseCallContentPtr mCallContent;
-    bool mDtmfLock;
-    QStringList mDtmfPendingStrings;
+    DtmfPipeline mDtmfPipeline;
 };
 
 #endif // OFONOCONFERENCECALLCHANNEL_H
@@ -17,12 +17,19 @@
  *          Gustavo Pichorim Boiko <gustavo.boiko@canonical.com>
  */
 
+// Qt
+#include <QPointer>
+
 // ofono-qt
 #include <ofonomessage.h>
 
 // telepathy-ofono
 #include "ofonotextchannel.h"
 #include "pendingmessagesmanager.h"
+#include "metrics.h"
+#include "stallwatchdog.h"
+#include "tracing.h"
+#include "logging.h"
 
 QDBusArgument &operator<<(QDBusArgument&argument, const IncomingAttachmentStruct &attachment)
 {
@@ -200,7 +207,7 @@ QString oFonoTextChannel::sendMessage(Tp::MessagePartList message, uint flags, T
             attachment.contentType = part["content-type"].variant().toString();
             QString attachmentsPath = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/telepathy-ofono/attachments";
             if (!QDir().exists(attachmentsPath) && !QDir().mkpath(attachmentsPath)) {
-                qCritical() << "Failed to create attachments directory";
+                qCCritical(lcText) << "Failed to create attachments directory";
                 objpath = QDateTime::currentDateTimeUtc().toString(Qt::ISODate) + "-" + QString::number(mMessageCounter++);
                 error->set(TP_QT_ERROR_INVALID_ARGUMENT, "Failed to create attachments to disk");
                 mPendingDeliveryReportPermanentlyFailed[objpath] = handle;
@@ -269,10 +276,14 @@ QString oFonoTextChannel::sendMessage(Tp::MessagePartList message, uint flags, T
     if (mPhoneNumbers.size() == 1) {
         QString phoneNumber = mPhoneNumbers[0];
         uint handle = mConnection->ensureHandle(phoneNumber);
-        objpath = mConnection->messageManager()->sendMessage(phoneNumber, body["content"].variant().toString(), success).path();
+        {
+            MetricsTimer timer("dbus.blocking");
+            StallScope stallScope("ofono.SendMessage");
+            objpath = mConnection->messageManager()->sendMessage(phoneNumber, body["content"].variant().toString(), success).path();
+        }
         if (objpath.isEmpty() || !success) {
             if (!success) {
-                qWarning() << mConnection->messageManager()->errorName() << mConnection->messageManager()->errorMessage();
+                qCWarning(lcText) << mConnection->messageManager()->errorName() << mConnection->messageManager()->errorMessage();
             } else {
                 error->set(TP_QT_ERROR_INVALID_ARGUMENT, mConnection->messageManager()->errorMessage());
             }
@@ -282,6 +293,7 @@ QString oFonoTextChannel::sendMessage(Tp::MessagePartList message, uint flags, T
             QTimer::singleShot(0, this, SLOT(onProcessPendingDeliveryReport()));
             return objpath;
         }
+        Metrics::instance()->increment("sms.out");
         OfonoMessage *msg = new OfonoMessage(objpath);
         if (msg->state() == "") {
             // message was already sent or failed too fast (this case is only reproducible with the emulator)
@@ -295,24 +307,32 @@ QString oFonoTextChannel::sendMessage(Tp::MessagePartList message, uint flags, T
         QObject::connect(msg, SIGNAL(stateChanged(QString)), SLOT(onOfonoMessageStateChanged(QString)));
         return objpath;
     } else {
-        // Broadcast sms
-        bool someMessageSent = false;
+        // Broadcast sms: the first message is sent right away so it can be tracked,
+        // the other ones are queued so they don't hold the modem for call control
+        QString content = body["content"].variant().toString();
+        int sentIndex = -1;
         QString lastPhoneNumber;
-        Q_FOREACH(const QString &phoneNumber, mPhoneNumbers) {
-            objpath = mConnection->messageManager()->sendMessage(phoneNumber, body["content"].variant().toString(), success).path();
+        for (int i = 0; i < mPhoneNumbers.size() && sentIndex < 0; i++) {
+            const QString &phoneNumber = mPhoneNumbers[i];
+            {
+                MetricsTimer timer("dbus.blocking");
+                StallScope stallScope("ofono.SendMessage");
+                objpath = mConnection->messageManager()->sendMessage(phoneNumber, content, success).path();
+            }
             lastPhoneNumber = phoneNumber;
             // dont fail if this is a broadcast chat as we cannot track individual messages
             if (objpath.isEmpty() || !success) {
                 if (!success) {
-                    qWarning() << mConnection->messageManager()->errorName() << mConnection->messageManager()->errorMessage();
+                    qCWarning(lcText) << mConnection->messageManager()->errorName() << mConnection->messageManager()->errorMessage();
                 } else {
                     error->set(TP_QT_ERROR_INVALID_ARGUMENT, mConnection->messageManager()->errorMessage());
                 }
                 continue;
             }
-            someMessageSent = true;
+            sentIndex = i;
+            Metrics::instance()->increment("sms.out");
         }
-        if (!someMessageSent) {
+        if (sentIndex < 0) {
             // for group chat we only fail if all the messages failed to send
             objpath = QDateTime::currentDateTimeUtc().toString(Qt::ISODate) + "-" + QString::number(mMessageCounter++);
             uint handle = mConnection->ensureHandle(lastPhoneNumber);
@@ -320,6 +340,27 @@ QString oFonoTextChannel::sendMessage(Tp::MessagePartList message, uint flags, T
             QTimer::singleShot(0, this, SLOT(onProcessPendingDeliveryReport()));
             return objpath;
         }
+        QPointer<OfonoMessageManager> messageManager(mConnection->messageManager());
+        Q_FOREACH(const QString &phoneNumber, mPhoneNumbers.mid(sentIndex + 1)) {
+            mConnection->modemRequestScheduler()->submit(ModemRequestScheduler::PriorityBulkMessage, [messageManager, phoneNumber, content]() {
+                if (messageManager.isNull()) {
+                    return;
+                }
+                bool success = true;
+                QString path;
+                {
+                    MetricsTimer timer("dbus.blocking");
+                    StallScope stallScope("ofono.SendMessage");
+                    path = messageManager->sendMessage(phoneNumber, content, success).path();
+                }
+                if (path.isEmpty() || !success) {
+                    qCWarning(lcText) << "Failed to send broadcast message to" << phoneNumber
+                               << messageManager->errorName() << messageManager->errorMessage();
+                    return;
+                }
+                Metrics::instance()->increment("sms.out");
+            });
+        }
         OfonoMessage *msg = new OfonoMessage(objpath);
         if (msg->state() == "") {
             // message was already sent or failed too fast (this case is only reproducible with the emulator)
@@ -327,7 +368,7 @@ QString oFonoTextChannel::sendMessage(Tp::MessagePartList message, uint flags, T
             uint handle = mConnection->ensureHandle(lastPhoneNumber);
             mPendingDeliveryReportUnknown[objpath] = handle;
             QTimer::singleShot(0, this, SLOT(onProcessPendingDeliveryReport()));
-            // return only the last one in case of group chat for history purposes
+            // return only the first one in case of group chat for history purposes
             return objpath;
         }
         QObject::connect(msg, SIGNAL(stateChanged(QString)), SLOT(onOfonoMessageStateChanged(QString)));
@@ -337,7 +378,7 @@ QString oFonoTextChannel::sendMessage(Tp::MessagePartList message, uint flags, T
 
 void oFonoTextChannel::onMMSPropertyChanged(QString property, QVariant value)
 {
-    qDebug() << "oFonoTextChannel::onMMSPropertyChanged" << property << value;
+    qCDebug(lcText) << "oFonoTextChannel::onMMSPropertyChanged" << property << value;
     bool canRemoveFiles = true;
     MMSDMessage *msg = qobject_cast<MMSDMessage*>(sender());
     // FIXME - mms groupchat
@@ -452,6 +493,10 @@ void oFonoTextChannel::onOfonoMessageStateChanged(QString status)
 
 void oFonoTextChannel::messageReceived(const QString &message, uint handle, const QVariantMap &info)
 {
+    TraceScope trace("text", "messageReceived");
+    if (Tracer::instance()->isEnabled()) {
+        Tracer::instance()->flow('f', "text", "message", info["Sender"].toString() + info["SentTime"].toString());
+    }
     Tp::MessagePartList partList;
 
     Tp::MessagePart body;
@@ -472,6 +517,8 @@ void oFonoTextChannel::messageReceived(const QString &message, uint handle, cons
 
 void oFonoTextChannel::mmsReceived(const QString &id, uint handle, const QVariantMap &properties)
 {
+    TraceScope trace("mms", "mmsReceived");
+    Tracer::instance()->flow('f', "mms", "mms", id);
     Tp::MessagePartList message;
     QString subject = properties["Subject"].toString();
     QString smil = properties["Smil"].toString();
@@ -511,7 +558,7 @@ void oFonoTextChannel::mmsReceived(const QString &id, uint handle, const QVarian
     Q_FOREACH(const IncomingAttachmentStruct &attachment, mmsdAttachments) {
         QFile attachmentFile(attachment.filePath);
         if (!attachmentFile.open(QIODevice::ReadOnly)) {
-            qWarning() << "fail to load attachment" << attachmentFile.errorString() << attachment.filePath;
+            qCWarning(lcText) << "fail to load attachment" << attachmentFile.errorString() << attachment.filePath;
             continue;
         }
         // FIXME check if we managed to read the total attachment file
@@ -21,6 +21,7 @@
 #include <QSqlError>
 #include "pendingmessagesmanager.h"
 #include "sqlitedatabase.h"
+#include "logging.h"
 
 PendingMessagesManager::PendingMessagesManager(QObject *parent) :
     QObject(parent),
@@ -41,8 +42,8 @@ QString PendingMessagesManager::recipientIdForMessageId(const QString &messageId
     query.prepare(queryString);
     query.bindValue(":messageId", messageId);
 
-    if (!query.exec()) {
-        qCritical() << "Error:" << query.lastError() << query.lastQuery();
+    if (!SQLiteDatabase::exec(query)) {
+        qCCritical(lcText) << "Error:" << query.lastError() << query.lastQuery();
         return QString();
     }
 
@@ -67,8 +68,8 @@ void PendingMessagesManager::addPendingMessage(const QString &messageId, const Q
     query.bindValue(":recipientId", message.recipientId);
     query.bindValue(":timestamp", message.timestamp.toString(Qt::ISODate));
 
-    if (!query.exec()) {
-        qCritical() << "Error:" << query.lastError() << query.lastQuery();
+    if (!SQLiteDatabase::exec(query)) {
+        qCCritical(lcText) << "Error:" << query.lastError() << query.lastQuery();
         return;
     }
 }
@@ -81,8 +82,8 @@ void PendingMessagesManager::removePendingMessage(const QString &messageId)
     query.prepare(queryString);
     query.bindValue(":messageId", messageId);
 
-    if (!query.exec()) {
-        qCritical() << "Error:" << query.lastError() << query.lastQuery();
+    if (!SQLiteDatabase::exec(query)) {
+        qCCritical(lcText) << "Error:" << query.lastError() << query.lastQuery();
         return;
     }
 }
@@ -22,7 +22,11 @@
  */
 
 #include "phoneutils_p.h"
+#include "countrycodes.h"
+#include "startupprofiler.h"
+#include "logging.h"
 
+#include <algorithm>
 
 #include <phonenumbers/phonenumbermatch.h>
 #include <phonenumbers/phonenumbermatcher.h>
@@ -30,46 +34,57 @@
 
 #include <QLocale>
 #include <QDebug>
-#include <QTextStream>
-#include <QFile>
+#include <QtConcurrent/QtConcurrentMap>
 
-QString PhoneUtils::mMcc = QString();
+// parsed numbers kept by each NumberingContext before the cache is flushed
+#define MAX_CACHED_NUMBERS 1024
+// lists shorter than this are not worth distributing across threads
+#define PARALLEL_PARSING_THRESHOLD 32
 
-void PhoneUtils::setMcc(const QString &mcc)
+static constexpr size_t mccCountryCodesSize = sizeof(mccCountryCodes) / sizeof(mccCountryCodes[0]);
+
+static constexpr bool mccCountryCodesSorted(const MccCountryCode *codes, size_t size)
 {
-    mMcc = mcc;
+    return size < 2 || (codes[0].mcc < codes[1].mcc && mccCountryCodesSorted(codes + 1, size - 1));
 }
 
-QString PhoneUtils::countryCodeForMCC(const QString &mcc, bool useFallback)
+static_assert(mccCountryCodesSorted(mccCountryCodes, mccCountryCodesSize), "countrycodes.h must be sorted by mcc");
+
+// the first call loads the metadata of all regions, which is a noticeable part of the startup
+static i18n::phonenumbers::PhoneNumberUtil *phoneNumberUtil()
 {
-    static QMap<QString, QString> countryCodes;
-    if (countryCodes.isEmpty()) {
-        QFile countryCodesFile(":/countrycodes.txt");
-        if (!countryCodesFile.open(QFile::ReadOnly)) {
-            qCritical() << "Failed to open " << countryCodesFile.fileName();
-            if (useFallback) {
-                return region();
-            }
-            return QString();
-        }
-        QTextStream stream(&countryCodesFile);
-        while (!stream.atEnd()) {
-            QString line = stream.readLine();
-            QStringList tuple = line.split(":");
-            if (tuple.size() != 2) {
-                qCritical() << "Failed to parse line" << line;
-                if (useFallback) {
-                    return region();
-                }
-                return QString();
-            }
-            countryCodes[tuple[0]] = tuple[1];
-        }
+    static i18n::phonenumbers::PhoneNumberUtil *util = []() {
+        StartupPhase phase("phonenumbers.metadata");
+        return i18n::phonenumbers::PhoneNumberUtil::GetInstance();
+    }();
+    return util;
+}
+
+// returns the two letters country code for the given mcc, or NULL if unknown
+static const char *lookupCountryCode(const QString &mcc)
+{
+    bool ok = false;
+    int value = mcc.toInt(&ok);
+    if (!ok) {
+        return NULL;
+    }
+
+    const MccCountryCode *end = mccCountryCodes + mccCountryCodesSize;
+    const MccCountryCode *code = std::lower_bound(mccCountryCodes, end, value,
+                                                  [](const MccCountryCode &entry, int mcc) { return entry.mcc < mcc; });
+    if (code == end || code->mcc != value) {
+        return NULL;
     }
-    if (!countryCodes.contains(mcc) && useFallback) {
-        return region();
+    return code->countryCode;
+}
+
+QString PhoneUtils::countryCodeForMCC(const QString &mcc, bool useFallback)
+{
+    const char *countryCode = lookupCountryCode(mcc);
+    if (!countryCode) {
+        return useFallback ? region() : QString();
     }
-    return countryCodes[mcc];
+    return QString::fromLatin1(countryCode);
 }
 
 QString PhoneUtils::region()
@@ -83,52 +98,342 @@ QString PhoneUtils::region()
      return countryCode;
 }
 
-QString PhoneUtils::normalizePhoneNumber(const QString &phoneNumber)
+const std::string &PhoneUtils::systemRegionCode()
 {
-    static i18n::phonenumbers::PhoneNumberUtil *phonenumberUtil = i18n::phonenumbers::PhoneNumberUtil::GetInstance();
+    static const std::string regionCode = region().toStdString();
+    return regionCode;
+}
+
+QString PhoneUtils::normalizePhoneNumber(const QString &phoneNumber, NumberingContext *context)
+{
+    if (context) {
+        return context->normalizePhoneNumber(phoneNumber);
+    }
     if (!isPhoneNumber(phoneNumber)) {
         return phoneNumber;
     }
-    std::string number = phoneNumber.toStdString();
-    phonenumberUtil->NormalizeDiallableCharsOnly(&number);
-    return QString::fromStdString(number);
+    return normalizeDiallableChars(phoneNumber);
 }
 
-bool PhoneUtils::comparePhoneNumbers(const QString &phoneNumberA, const QString &phoneNumberB)
+bool PhoneUtils::comparePhoneNumbers(const QString &phoneNumberA, const QString &phoneNumberB, NumberingContext *context)
 {
-    static i18n::phonenumbers::PhoneNumberUtil *phonenumberUtil = i18n::phonenumbers::PhoneNumberUtil::GetInstance();
+    if (context) {
+        return context->comparePhoneNumbers(phoneNumberA, phoneNumberB);
+    }
     // if any of the number isn't a phone number, just do a simple string comparison
     if (!isPhoneNumber(phoneNumberA) || !isPhoneNumber(phoneNumberB)) {
         return phoneNumberA == phoneNumberB;
     }
+    return matchPhoneNumbers(phoneNumberA, phoneNumberB);
+}
+
+bool PhoneUtils::isPhoneNumber(const QString &phoneNumber, NumberingContext *context)
+{
+    if (context) {
+        return context->isPhoneNumber(phoneNumber);
+    }
+    return isPhoneNumberForRegion(phoneNumber, systemRegionCode());
+}
+
+QString PhoneUtils::normalizeDiallableChars(const QString &phoneNumber)
+{
+    static i18n::phonenumbers::PhoneNumberUtil *phonenumberUtil = phoneNumberUtil();
+    std::string number = phoneNumber.toStdString();
+    phonenumberUtil->NormalizeDiallableCharsOnly(&number);
+    return QString::fromStdString(number);
+}
+
+bool PhoneUtils::matchPhoneNumbers(const QString &phoneNumberA, const QString &phoneNumberB)
+{
+    static i18n::phonenumbers::PhoneNumberUtil *phonenumberUtil = phoneNumberUtil();
     i18n::phonenumbers::PhoneNumberUtil::MatchType match = phonenumberUtil->
             IsNumberMatchWithTwoStrings(phoneNumberA.toStdString(),
                                         phoneNumberB.toStdString());
     return (match > i18n::phonenumbers::PhoneNumberUtil::NO_MATCH);
 }
 
-bool PhoneUtils::isPhoneNumber(const QString &phoneNumber)
+bool PhoneUtils::isPhoneNumberForRegion(const QString &phoneNumber, const std::string &regionCode,
+                                        i18n::phonenumbers::PhoneNumber *number)
 {
-    static i18n::phonenumbers::PhoneNumberUtil *phonenumberUtil = i18n::phonenumbers::PhoneNumberUtil::GetInstance();
-    std::string formattedNumber;
-    i18n::phonenumbers::PhoneNumber number;
+    static i18n::phonenumbers::PhoneNumberUtil *phonenumberUtil = phoneNumberUtil();
+    i18n::phonenumbers::PhoneNumber parsedNumber;
     i18n::phonenumbers::PhoneNumberUtil::ErrorType error;
-    error = phonenumberUtil->Parse(phoneNumber.toStdString(), countryCodeForMCC(mMcc, true).toStdString(), &number);
+    error = phonenumberUtil->Parse(phoneNumber.toStdString(), regionCode, number ? number : &parsedNumber);
 
     switch(error) {
     case i18n::phonenumbers::PhoneNumberUtil::INVALID_COUNTRY_CODE_ERROR:
-        qWarning() << "Invalid country code for:" << phoneNumber;
+        qCDebug(lcPhoneUtils) << "Invalid country code for:" << phoneNumber;
         return false;
     case i18n::phonenumbers::PhoneNumberUtil::NOT_A_NUMBER:
-        qWarning() << "The phone number is not a valid number:" << phoneNumber;
+        qCDebug(lcPhoneUtils) << "The phone number is not a valid number:" << phoneNumber;
         return false;
     case i18n::phonenumbers::PhoneNumberUtil::TOO_SHORT_AFTER_IDD:
     case i18n::phonenumbers::PhoneNumberUtil::TOO_SHORT_NSN:
     case i18n::phonenumbers::PhoneNumberUtil::TOO_LONG_NSN:
-        qWarning() << "Invalid phone number" << phoneNumber;
+        qCDebug(lcPhoneUtils) << "Invalid phone number" << phoneNumber;
         return false;
     default:
         break;
     }
     return true;
 }
+
+NormalizedPhoneNumber PhoneUtils::parsePhoneNumber(const QString &phoneNumber, const std::string &regionCode)
+{
+    static i18n::phonenumbers::PhoneNumberUtil *phonenumberUtil = phoneNumberUtil();
+    NormalizedPhoneNumber result;
+    i18n::phonenumbers::PhoneNumber number;
+    result.phoneNumber = phoneNumber;
+    result.isPhoneNumber = isPhoneNumberForRegion(phoneNumber, regionCode, &number);
+    if (!result.isPhoneNumber) {
+        result.normalized = phoneNumber;
+        result.key = phoneNumber;
+        return result;
+    }
+
+    result.normalized = normalizeDiallableChars(phoneNumber);
+    std::string key;
+    phonenumberUtil->Format(number, i18n::phonenumbers::PhoneNumberUtil::E164, &key);
+    if (number.has_extension()) {
+        key += "#" + number.extension();
+    }
+    result.key = QString::fromStdString(key);
+
+    std::string nationalNumber;
+    phonenumberUtil->GetNationalSignificantNumber(number, &nationalNumber);
+    if (number.has_extension()) {
+        nationalNumber += "#" + number.extension();
+    }
+    result.nationalNumber = QString::fromStdString(nationalNumber);
+    result.hasCountryCode = result.normalized.startsWith('+');
+    return result;
+}
+
+struct PhoneNumberParser
+{
+    typedef NormalizedPhoneNumber result_type;
+
+    PhoneNumberParser(const std::string &regionCode) : mRegionCode(regionCode) {}
+    NormalizedPhoneNumber operator()(const QString &phoneNumber) const
+    {
+        return PhoneUtils::parsePhoneNumber(phoneNumber, mRegionCode);
+    }
+
+    std::string mRegionCode;
+};
+
+NormalizedPhoneNumbers PhoneUtils::parsePhoneNumbers(const QStringList &phoneNumbers, const std::string &regionCode)
+{
+    PhoneNumberParser parser(regionCode);
+    if (phoneNumbers.size() < PARALLEL_PARSING_THRESHOLD) {
+        NormalizedPhoneNumbers result;
+        Q_FOREACH(const QString &phoneNumber, phoneNumbers) {
+            result << parser(phoneNumber);
+        }
+        return result;
+    }
+
+    // PhoneNumberUtil is thread safe once created, so make sure it is not
+    // initialized concurrently by the worker threads
+    phoneNumberUtil();
+    return QtConcurrent::blockingMapped<NormalizedPhoneNumbers>(phoneNumbers, parser);
+}
+
+NormalizedPhoneNumbers PhoneUtils::normalizePhoneNumbers(const QStringList &phoneNumbers, NumberingContext *context)
+{
+    if (context) {
+        return context->normalizePhoneNumbers(phoneNumbers);
+    }
+    return parsePhoneNumbers(phoneNumbers, systemRegionCode());
+}
+
+NormalizedPhoneNumbers PhoneUtils::removePhoneNumbers(const NormalizedPhoneNumbers &phoneNumbers,
+                                                      const QStringList &numbersToRemove,
+                                                      NumberingContext *context)
+{
+    if (numbersToRemove.isEmpty()) {
+        return phoneNumbers;
+    }
+
+    QSet<QString> keys;
+    // numbers in national format get the country code of the region they are
+    // parsed with, which is the visited country when roaming, so they are
+    // also matched by national number like comparePhoneNumbers() does
+    QSet<QString> nationalNumbers;
+    NormalizedPhoneNumbers nationalFormatNumbers;
+    Q_FOREACH(const NormalizedPhoneNumber &number, normalizePhoneNumbers(numbersToRemove, context)) {
+        keys << number.key;
+        if (number.isPhoneNumber && !number.hasCountryCode) {
+            nationalNumbers << number.nationalNumber;
+            nationalFormatNumbers << number;
+        }
+    }
+
+    NormalizedPhoneNumbers result;
+    Q_FOREACH(const NormalizedPhoneNumber &number, phoneNumbers) {
+        if (keys.contains(number.key)) {
+            continue;
+        }
+        if (number.isPhoneNumber && !nationalNumbers.isEmpty()) {
+            if (nationalNumbers.contains(number.nationalNumber)) {
+                continue;
+            }
+            // a national number without its area code can still be a short
+            // match, only parse the numbers again when one is a suffix of the other
+            bool matched = false;
+            Q_FOREACH(const NormalizedPhoneNumber &numberToRemove, nationalFormatNumbers) {
+                if ((number.nationalNumber.endsWith(numberToRemove.nationalNumber) ||
+                     numberToRemove.nationalNumber.endsWith(number.nationalNumber)) &&
+                        comparePhoneNumbers(number.phoneNumber, numberToRemove.phoneNumber, context)) {
+                    matched = true;
+                    break;
+                }
+            }
+            if (matched) {
+                continue;
+            }
+        }
+        result << number;
+    }
+    return result;
+}
+
+NumberingContext::NumberingContext(const QString &mcc)
+{
+    setMcc(mcc);
+}
+
+QString NumberingContext::mcc() const
+{
+    return mMcc;
+}
+
+void NumberingContext::setMcc(const QString &mcc)
+{
+    mMcc = mcc;
+    QString countryCode = PhoneUtils::countryCodeForMCC(mcc, true);
+    if (countryCode == mCountryCode) {
+        return;
+    }
+
+    // parsing results depend on the region, so they can't be reused
+    if (!mCountryCode.isEmpty()) {
+        mStatistics.regionChanges++;
+    }
+    mCountryCode = countryCode;
+    mRegionCode = countryCode.toStdString();
+    mCache.clear();
+}
+
+QString NumberingContext::countryCode() const
+{
+    return mCountryCode;
+}
+
+const NormalizedPhoneNumber &NumberingContext::lookup(const QString &identifier)
+{
+    mStatistics.lookups++;
+    QHash<QString, NormalizedPhoneNumber>::const_iterator it = mCache.constFind(identifier);
+    if (it != mCache.constEnd()) {
+        mStatistics.hits++;
+        return it.value();
+    }
+
+    if (mCache.size() >= MAX_CACHED_NUMBERS) {
+        mCache.clear();
+    }
+
+    return mCache.insert(identifier, PhoneUtils::parsePhoneNumber(identifier, mRegionCode)).value();
+}
+
+bool NumberingContext::isPhoneNumber(const QString &identifier)
+{
+    return lookup(identifier).isPhoneNumber;
+}
+
+QString NumberingContext::normalizePhoneNumber(const QString &phoneNumber)
+{
+    return lookup(phoneNumber).normalized;
+}
+
+bool NumberingContext::comparePhoneNumbers(const QString &phoneNumberA, const QString &phoneNumberB)
+{
+    const NormalizedPhoneNumber numberA = lookup(phoneNumberA);
+    const NormalizedPhoneNumber &numberB = lookup(phoneNumberB);
+    // if any of the number isn't a phone number, just do a simple string comparison
+    if (!numberA.isPhoneNumber || !numberB.isPhoneNumber) {
+        return phoneNumberA == phoneNumberB;
+    }
+    // numbers with the same dialable characters always match, no need to parse them again
+    if (numberA.normalized == numberB.normalized) {
+        return true;
+    }
+    return PhoneUtils::matchPhoneNumbers(phoneNumberA, phoneNumberB);
+}
+
+NormalizedPhoneNumbers NumberingContext::normalizePhoneNumbers(const QStringList &phoneNumbers)
+{
+    if (phoneNumbers.size() < PARALLEL_PARSING_THRESHOLD) {
+        NormalizedPhoneNumbers result;
+        Q_FOREACH(const QString &phoneNumber, phoneNumbers) {
+            result << lookup(phoneNumber);
+        }
+        return result;
+    }
+
+    // the cache is not thread safe, so parse everything in parallel without it
+    // and only fill it afterwards
+    NormalizedPhoneNumbers result = PhoneUtils::parsePhoneNumbers(phoneNumbers, mRegionCode);
+    mStatistics.lookups += result.size();
+    if (mCache.size() + result.size() > MAX_CACHED_NUMBERS) {
+        mCache.clear();
+    }
+    Q_FOREACH(const NormalizedPhoneNumber &number, result) {
+        mCache.insert(number.phoneNumber, number);
+    }
+    return result;
+}
+
+NumberingContext::Statistics NumberingContext::statistics() const
+{
+    return mStatistics;
+}
+
+PhoneNumberMatcher::PhoneNumberMatcher(const QString &phoneNumber, const QString &mcc)
+    : mContext(mcc), mPhoneNumber(phoneNumber),
+      mNormalized(mContext.normalizePhoneNumber(phoneNumber)),
+      mIsPhoneNumber(mContext.isPhoneNumber(phoneNumber))
+{
+}
+
+QString PhoneNumberMatcher::mcc() const
+{
+    return mContext.mcc();
+}
+
+bool PhoneNumberMatcher::matches(const QString &phoneNumber)
+{
+    if (phoneNumber == mPhoneNumber) {
+        return true;
+    }
+
+    // if any of the numbers isn't a phone number, the strings would need to be equal
+    if (!mIsPhoneNumber) {
+        return false;
+    }
+
+    QHash<QString, bool>::const_iterator it = mResults.constFind(phoneNumber);
+    if (it != mResults.constEnd()) {
+        return it.value();
+    }
+
+    bool result = false;
+    if (mContext.isPhoneNumber(phoneNumber)) {
+        // numbers with the same dialable characters always match, no need to parse them again
+        result = (mContext.normalizePhoneNumber(phoneNumber) == mNormalized) ||
+                 PhoneUtils::matchPhoneNumbers(phoneNumber, mPhoneNumber);
+    }
+
+    mResults[phoneNumber] = result;
+    return result;
+}
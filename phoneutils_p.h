@@ -25,6 +25,35 @@
 #define TELEPHONY_PHONEUTILS_H
 
 #include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <string>
+
+namespace i18n {
+namespace phonenumbers {
+class PhoneNumber;
+}
+}
+
+class NumberingContext;
+
+struct NormalizedPhoneNumber
+{
+    NormalizedPhoneNumber() : isPhoneNumber(false), hasCountryCode(false) {}
+    QString phoneNumber;
+    // the same as PhoneUtils::normalizePhoneNumber() would return
+    QString normalized;
+    // E.164 form (plus extension) for phone numbers, the identifier itself otherwise
+    QString key;
+    // national significant number (plus extension), it does not depend on the region
+    QString nationalNumber;
+    bool isPhoneNumber;
+    // false when the country code of the key comes from the region the number was parsed with
+    bool hasCountryCode;
+};
+
+typedef QList<NormalizedPhoneNumber> NormalizedPhoneNumbers;
 
 class PhoneUtils : public QObject
 {
@@ -38,14 +67,84 @@ public:
         Auto
     };
 
-    static QString normalizePhoneNumber(const QString &phoneNumber);
-    static bool comparePhoneNumbers(const QString &phoneNumberA,const QString &phoneNumberB);
-    static bool isPhoneNumber(const QString &identifier);
+    // when no context is given, numbers are parsed using the region of the system locale
+    static QString normalizePhoneNumber(const QString &phoneNumber, NumberingContext *context = 0);
+    static bool comparePhoneNumbers(const QString &phoneNumberA,const QString &phoneNumberB, NumberingContext *context = 0);
+    static bool isPhoneNumber(const QString &identifier, NumberingContext *context = 0);
     static QString countryCodeForMCC(const QString &mcc, bool useFallback = true);
-    static void setMcc(const QString &mcc);
+
+    // parses each number only once, large lists are parsed in parallel
+    static NormalizedPhoneNumbers normalizePhoneNumbers(const QStringList &phoneNumbers, NumberingContext *context = 0);
+    // removes the numbers matching any of the given ones. Numbers are matched by
+    // key, or by national number for the given numbers without a country code
+    static NormalizedPhoneNumbers removePhoneNumbers(const NormalizedPhoneNumbers &phoneNumbers,
+                                                     const QStringList &numbersToRemove,
+                                                     NumberingContext *context = 0);
 private:
+    friend class NumberingContext;
+    friend struct PhoneNumberParser;
     static QString region();
-    static QString mMcc;
+    static const std::string &systemRegionCode();
+    static bool isPhoneNumberForRegion(const QString &identifier, const std::string &regionCode,
+                                       i18n::phonenumbers::PhoneNumber *number = 0);
+    static NormalizedPhoneNumber parsePhoneNumber(const QString &phoneNumber, const std::string &regionCode);
+    static NormalizedPhoneNumbers parsePhoneNumbers(const QStringList &phoneNumbers, const std::string &regionCode);
+    static QString normalizeDiallableChars(const QString &phoneNumber);
+    static bool matchPhoneNumbers(const QString &phoneNumberA, const QString &phoneNumberB);
+};
+
+// Numbering settings and parsed number cache of a single modem. Each connection
+// owns its own context, so modems registered on networks of different countries
+// normalize numbers independently. A context is not thread safe, but different
+// contexts can be used from different threads at the same time.
+class NumberingContext
+{
+public:
+    struct Statistics {
+        Statistics() : lookups(0), hits(0), regionChanges(0) {}
+        quint64 lookups;
+        quint64 hits;
+        quint64 regionChanges;
+    };
+
+    explicit NumberingContext(const QString &mcc = QString());
+
+    QString mcc() const;
+    void setMcc(const QString &mcc);
+    QString countryCode() const;
+
+    bool isPhoneNumber(const QString &identifier);
+    QString normalizePhoneNumber(const QString &phoneNumber);
+    bool comparePhoneNumbers(const QString &phoneNumberA, const QString &phoneNumberB);
+    NormalizedPhoneNumbers normalizePhoneNumbers(const QStringList &phoneNumbers);
+
+    Statistics statistics() const;
+
+private:
+    const NormalizedPhoneNumber &lookup(const QString &identifier);
+
+    QString mMcc;
+    QString mCountryCode;
+    std::string mRegionCode;
+    QHash<QString, NormalizedPhoneNumber> mCache;
+    Statistics mStatistics;
+};
+
+// Compares a list of phone numbers against the same number, which is only
+// parsed once. Results are cached, so repeated numbers are only compared once.
+class PhoneNumberMatcher
+{
+public:
+    explicit PhoneNumberMatcher(const QString &phoneNumber, const QString &mcc = QString());
+    QString mcc() const;
+    bool matches(const QString &phoneNumber);
+
+private:
+    NumberingContext mContext;
+    QString mPhoneNumber;
+    QString mNormalized;
+    bool mIsPhoneNumber;
+    QHash<QString, bool> mResults;
 };
 
 #endif
@@ -16,12 +16,23 @@
  * Authors: Andreas Pokorny <andreas.pokorny@canonical.com>
  */
 
-#include <QDBusInterface>
+#include <QDBusConnection>
 #include "powerdaudiomodemediator.h"
 
+// audio mode changes closer than this are collapsed into a single update
+#define PROXIMITY_APPLY_DELAY 50
+
 PowerDAudioModeMediator::PowerDAudioModeMediator(PowerD &powerd)
-    : powerd(powerd)
+    : powerd(powerd),
+      mScreenOnMessage(QDBusMessage::createMethodCall("com.canonical.Unity.Screen",
+                                                      "/com/canonical/Unity/Screen",
+                                                      "com.canonical.Unity.Screen",
+                                                      "setScreenPowerMode"))
 {
+    mScreenOnMessage << QString("on") << 3;
+    mApplyTimer.setSingleShot(true);
+    mApplyTimer.setInterval(PROXIMITY_APPLY_DELAY);
+    QObject::connect(&mApplyTimer, &QTimer::timeout, [this]() { apply(); });
 }
 
 void PowerDAudioModeMediator::audioModeChanged(const QString &mode)
@@ -31,24 +42,31 @@ void PowerDAudioModeMediator::audioModeChanged(const QString &mode)
     if (mProximityEnabled != enableProximity)
     {
         mProximityEnabled = enableProximity;
-        apply();
+        scheduleApply();
     }
 }
 
-void PowerDAudioModeMediator::apply() const
+void PowerDAudioModeMediator::scheduleApply()
 {
+    // keep the first deadline, so a steady stream of changes can't postpone the update forever
+    if (!mApplyTimer.isActive()) {
+        mApplyTimer.start();
+    }
+}
+
+void PowerDAudioModeMediator::apply()
+{
+    // the mode flipped back before the update was sent
+    if (mAppliedProximityEnabled == mProximityEnabled) {
+        return;
+    }
+    mAppliedProximityEnabled = mProximityEnabled;
+
     if (mProximityEnabled) {
         powerd.enableProximityHandling();
     } else {
         // we need to power the screen on before disabling the proximity handling
-        QDBusInterface unityIface("com.canonical.Unity.Screen",
-                                  "/com/canonical/Unity/Screen",
-                                  "com.canonical.Unity.Screen",
-                                  QDBusConnection::systemBus());
-        QList<QVariant> args;
-        args.append("on");
-        args.append(3);
-        unityIface.callWithArgumentList(QDBus::NoBlock, "setScreenPowerMode", args);
+        QDBusConnection::systemBus().send(mScreenOnMessage);
         powerd.disableProximityHandling();
     }
 }
@@ -58,6 +76,6 @@ void PowerDAudioModeMediator::audioOutputClosed()
     if (mProximityEnabled)
     {
         mProximityEnabled = false;
-        apply();
+        scheduleApply();
     }
 }
@@ -20,7 +20,9 @@
 
 #include "powerd.h"
 
+#include <QDBusMessage>
 #include <QString>
+#include <QTimer>
 #include <fstream>
 #include <memory>
 
@@ -30,6 +32,8 @@ class PowerD;
  * handling of powerd during different call states and used audio outputs.
  * In General that mean enabling sreen blanking on proximity events, when
  * a call is active and neither a bluetooth headset nor the speakers are used.
+ * Changes are applied asynchronously, and a burst of audio mode changes only
+ * results in the final proximity state being sent.
  */
 class PowerDAudioModeMediator
 {
@@ -38,9 +42,13 @@ public:
     void audioModeChanged(const QString &mode);
     void audioOutputClosed();
 private:
-    void apply() const;
+    void scheduleApply();
+    void apply();
     PowerD &powerd;
     bool mProximityEnabled{false};
+    bool mAppliedProximityEnabled{false};
+    QTimer mApplyTimer;
+    QDBusMessage mScreenOnMessage;
 };
 
 #endif
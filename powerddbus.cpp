@@ -19,25 +19,29 @@
 #include "powerddbus.h"
 
 #include <QDBusConnection>
-#include <QDBusInterface>
-#include <QDBusReply>
+
+static QDBusMessage proximityMessage(const QString &method)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall("com.canonical.powerd",
+                                                          "/com/canonical/powerd",
+                                                          "com.canonical.powerd",
+                                                          method);
+    message << QString("telepathy-ofono");
+    return message;
+}
 
 PowerDDBus::PowerDDBus()
-    : mPowerDIface{
-        new QDBusInterface(
-            "com.canonical.powerd",
-            "/com/canonical/powerd",
-            "com.canonical.powerd",
-            QDBusConnection::systemBus())}
+    : mEnableProximityMessage(proximityMessage("enableProximityHandling")),
+      mDisableProximityMessage(proximityMessage("disableProximityHandling"))
 {
 }
 
 void PowerDDBus::enableProximityHandling()
 {
-    mPowerDIface->call("enableProximityHandling", "telepathy-ofono");
+    QDBusConnection::systemBus().send(mEnableProximityMessage);
 }
 
 void PowerDDBus::disableProximityHandling()
 {
-    mPowerDIface->call("disableProximityHandling", "telepathy-ofono");
+    QDBusConnection::systemBus().send(mDisableProximityMessage);
 }
@@ -21,10 +21,12 @@
 
 #include "powerd.h"
 
-#include <memory>
-
-class QDBusInterface;
+#include <QDBusMessage>
 
+/*!
+ * \brief PowerDDBus talks to powerd on the system bus. Calls are sent
+ * without waiting for a reply, so they never block the caller.
+ */
 class PowerDDBus : public PowerD
 {
 public:
@@ -32,7 +34,8 @@ public:
     void enableProximityHandling() override;
     void disableProximityHandling() override;
 private:
-    std::unique_ptr<QDBusInterface> mPowerDIface;
+    QDBusMessage mEnableProximityMessage;
+    QDBusMessage mDisableProximityMessage;
 };
 
 #endif
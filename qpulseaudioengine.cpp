@@ -18,28 +18,33 @@
 ****************************************************************************/
 
 #include <QtCore/qdebug.h>
+#include <QtCore/qtimer.h>
 
 #include "qpulseaudioengine.h"
+#include "startupprofiler.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "logging.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <hybris/properties/properties.h>
 
-#define PULSEAUDIO_PROFILE_HSP "headset_head_unit"
-#define PULSEAUDIO_PROFILE_A2DP "a2dp_sink"
+#define RECONNECT_MIN_DELAY 100
+#define RECONNECT_MAX_DELAY 5000
 
-QT_BEGIN_NAMESPACE
+static_assert(AudioPortAvailableUnknown == PA_PORT_AVAILABLE_UNKNOWN &&
+              AudioPortAvailableNo == PA_PORT_AVAILABLE_NO &&
+              AudioPortAvailableYes == PA_PORT_AVAILABLE_YES,
+              "AudioPortAvailability must match pa_port_available_t");
 
-static void contextStateCallbackInit(pa_context *context, void *userdata)
-{
-    Q_UNUSED(context);
-    QPulseAudioEngineWorker *pulseEngine = reinterpret_cast<QPulseAudioEngineWorker*>(userdata);
-    pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
-}
+QT_BEGIN_NAMESPACE
 
 static void contextStateCallback(pa_context *context, void *userdata)
 {
-    Q_UNUSED(userdata);
     Q_UNUSED(context);
+    /* Called from the PulseAudio thread: let the worker handle the new state */
+    QMetaObject::invokeMethod(static_cast<QPulseAudioEngineWorker*>(userdata),
+            "handleContextState", Qt::QueuedConnection);
 }
 
 static void success_cb(pa_context *context, int success, void *userdata)
@@ -48,53 +53,77 @@ static void success_cb(pa_context *context, int success, void *userdata)
     pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
 }
 
-/* Callbacks used when handling events from PulseAudio */
-static void plug_card_cb(pa_context *c, const pa_card_info *info, int isLast, void *userdata)
+/* Callbacks used to fill the model */
+static void cardinfo_cb(pa_context *context, const pa_card_info *info, int isLast, void *userdata)
 {
     QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
     if (isLast != 0 || !pulseEngine || !info) {
         pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
         return;
     }
-    pulseEngine->plugCardCallback(info);
+    pulseEngine->storeCard(info);
 }
 
-static void update_card_cb(pa_context *c, const pa_card_info *info, int isLast, void *userdata)
+static void sinkinfo_cb(pa_context *context, const pa_sink_info *info, int isLast, void *userdata)
 {
     QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
     if (isLast != 0 || !pulseEngine || !info) {
         pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
         return;
     }
-    pulseEngine->updateCardCallback(info);
+    pulseEngine->storeSink(info);
 }
 
-static void unplug_card_cb(pa_context *c, const pa_card_info *info, int isLast, void *userdata)
+static void sourceinfo_cb(pa_context *context, const pa_source_info *info, int isLast, void *userdata)
 {
     QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
-    if (!pulseEngine) {
+    if (isLast != 0 || !pulseEngine || !info) {
         pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
         return;
     }
+    pulseEngine->storeSource(info);
+}
 
-    if (info == NULL) {
-        /* That means that the card used to query card_info was removed */
-        pulseEngine->unplugCardCallback();
+static void serverinfo_cb(pa_context *context, const pa_server_info *info, void *userdata)
+{
+    QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
+    if (!pulseEngine || !info) {
+        pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
+        return;
     }
+    pulseEngine->serverInfoCallback(info);
 }
 
 static void subscribeCallback(pa_context *context, pa_subscription_event_type_t t, uint32_t idx, void *userdata)
 {
+    QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
+    pa_subscription_event_type_t facility = (pa_subscription_event_type_t) (t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK);
+    pa_subscription_event_type_t type = (pa_subscription_event_type_t) (t & PA_SUBSCRIPTION_EVENT_TYPE_MASK);
+    pa_operation *o = NULL;
+
+    /* Keep the cached model up-to-date. Card info is refreshed by handleCardEvent */
+    if (type == PA_SUBSCRIPTION_EVENT_REMOVE) {
+        pulseEngine->removeObject(facility, idx);
+    } else if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+        o = pa_context_get_sink_info_by_index(context, idx, sinkinfo_cb, userdata);
+    } else if (facility == PA_SUBSCRIPTION_EVENT_SOURCE) {
+        o = pa_context_get_source_info_by_index(context, idx, sourceinfo_cb, userdata);
+    } else if (facility == PA_SUBSCRIPTION_EVENT_SERVER) {
+        o = pa_context_get_server_info(context, serverinfo_cb, userdata);
+    }
+    if (o)
+        pa_operation_unref(o);
+
     /* For card change events (slot plug/unplug and add/remove card) */
-    if ((t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == PA_SUBSCRIPTION_EVENT_CARD) {
-        if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE) {
-            QMetaObject::invokeMethod((QPulseAudioEngineWorker *) userdata, "handleCardEvent",
+    if (facility == PA_SUBSCRIPTION_EVENT_CARD) {
+        if (type == PA_SUBSCRIPTION_EVENT_CHANGE) {
+            QMetaObject::invokeMethod(pulseEngine, "handleCardEvent",
                     Qt::QueuedConnection, Q_ARG(int, PA_SUBSCRIPTION_EVENT_CHANGE), Q_ARG(unsigned int, idx));
-        } else if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_NEW) {
-            QMetaObject::invokeMethod((QPulseAudioEngineWorker *) userdata, "handleCardEvent",
+        } else if (type == PA_SUBSCRIPTION_EVENT_NEW) {
+            QMetaObject::invokeMethod(pulseEngine, "handleCardEvent",
                     Qt::QueuedConnection, Q_ARG(int, PA_SUBSCRIPTION_EVENT_NEW), Q_ARG(unsigned int, idx));
-        } else if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
-            QMetaObject::invokeMethod((QPulseAudioEngineWorker *) userdata, "handleCardEvent",
+        } else if (type == PA_SUBSCRIPTION_EVENT_REMOVE) {
+            QMetaObject::invokeMethod(pulseEngine, "handleCardEvent",
                     Qt::QueuedConnection, Q_ARG(int, PA_SUBSCRIPTION_EVENT_REMOVE), Q_ARG(unsigned int, idx));
         }
     }
@@ -124,122 +153,179 @@ QPulseAudioEngineWorker::QPulseAudioEngineWorker(QObject *parent)
     : QObject(parent)
     , m_mainLoopApi(0)
     , m_context(0)
-    , m_callstatus(CallEnded)
-    , m_audiomode(AudioModeSpeaker)
-    , m_micmute(false)
-    , m_defaultsink("sink.primary")
-    , m_defaultsource("source.primary")
-    , m_voicecallcard("")
-    , m_voicecallhighest("")
-    , m_voicecallprofile("")
-    , m_bt_hsp("")
-    , m_bt_hsp_a2dp("")
+    , m_reconnectTimer(0)
+    , m_router(new AudioRouter(this, this))
+    , m_ready(false)
+    , m_pendingcallmode(false)
+    , m_reconnectdelay(RECONNECT_MIN_DELAY)
+    , m_modelgeneration(0)
+    , m_targetcallstatus(CallEnded)
+    , m_targetaudiomode(AudioModeSpeaker)
+    , m_targetmicmute(false)
+    , m_targethascallmode(false)
+    , m_targetscheduled(false)
+    , m_targetrequests(0)
+{
+    int len = 0;
+    const char *sink = quirk_sinkprimary_name(len);
+    std::string forcedsink = (len > 0 && sink) ? sink : "";
+    const char *source = quirk_sourceprimary_name(len);
+    std::string forcedsource = (len > 0 && source) ? source : "";
+    m_router->setForcedDevices(forcedsink, forcedsource);
+
+    connect(m_router, SIGNAL(audioModeChanged(const AudioMode)), this, SIGNAL(audioModeChanged(const AudioMode)));
+    connect(m_router, SIGNAL(availableAudioModesChanged(const AudioModes)), this, SIGNAL(availableAudioModesChanged(const AudioModes)));
+    connect(m_router, SIGNAL(routeSwitched(qint64)), this, SIGNAL(routeSwitched(qint64)));
+    connect(m_router, SIGNAL(callAudioActivated()), this, SIGNAL(callAudioActivated()));
 
-{
     m_mainLoop = pa_threaded_mainloop_new();
     if (m_mainLoop == 0) {
-        qWarning("Unable to create pulseaudio mainloop");
+        qCWarning(lcAudio, "Unable to create pulseaudio mainloop");
         return;
     }
 
     if (pa_threaded_mainloop_start(m_mainLoop) != 0) {
-        qWarning("Unable to start pulseaudio mainloop");
+        qCWarning(lcAudio, "Unable to start pulseaudio mainloop");
         pa_threaded_mainloop_free(m_mainLoop);
         m_mainLoop = 0;
         return;
     }
 
-    createPulseContext();
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, SIGNAL(timeout()), this, SLOT(createPulseContext()));
 }
 
 bool QPulseAudioEngineWorker::createPulseContext()
 {
-    bool keepGoing = true;
-    bool ok = true;
-
+    TraceScope trace("audio", "createPulseContext");
     if (m_context)
         return true;
 
+    if (!m_mainLoop)
+        return false;
+
+    StartupPhase phase("pulseaudio.context");
     m_mainLoopApi = pa_threaded_mainloop_get_api(m_mainLoop);
 
     pa_threaded_mainloop_lock(m_mainLoop);
 
     m_context = pa_context_new(m_mainLoopApi, QString(QLatin1String("QtmPulseContext:%1")).arg(::getpid()).toLatin1().constData());
-    pa_context_set_state_callback(m_context, contextStateCallbackInit, this);
 
     if (!m_context) {
-        qWarning("Unable to create new pulseaudio context");
+        qCWarning(lcAudio, "Unable to create new pulseaudio context");
         pa_threaded_mainloop_unlock(m_mainLoop);
+        scheduleReconnect();
         return false;
     }
 
+    pa_context_set_state_callback(m_context, contextStateCallback, this);
+
     if (pa_context_connect(m_context, NULL, PA_CONTEXT_NOAUTOSPAWN, NULL) < 0) {
-        qWarning("Unable to create a connection to the pulseaudio context");
+        qCWarning(lcAudio, "Unable to create a connection to the pulseaudio context");
         pa_threaded_mainloop_unlock(m_mainLoop);
         releasePulseContext();
+        scheduleReconnect();
         return false;
     }
 
-    pa_threaded_mainloop_wait(m_mainLoop);
+    pa_threaded_mainloop_unlock(m_mainLoop);
+    return true;
+}
 
-    while (keepGoing) {
-        switch (pa_context_get_state(m_context)) {
-            case PA_CONTEXT_CONNECTING:
-            case PA_CONTEXT_AUTHORIZING:
-            case PA_CONTEXT_SETTING_NAME:
-                break;
+void QPulseAudioEngineWorker::handleContextState()
+{
+    if (!m_context)
+        return;
 
-            case PA_CONTEXT_READY:
-                qDebug("Pulseaudio connection established.");
-                keepGoing = false;
-                break;
+    pa_threaded_mainloop_lock(m_mainLoop);
 
-            case PA_CONTEXT_TERMINATED:
-                qCritical("Pulseaudio context terminated.");
-                keepGoing = false;
-                ok = false;
-                break;
+    switch (pa_context_get_state(m_context)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+        case PA_CONTEXT_UNCONNECTED:
+            pa_threaded_mainloop_unlock(m_mainLoop);
+            return;
 
-            case PA_CONTEXT_FAILED:
-            default:
-                qCritical() << QString("Pulseaudio connection failure: %1").arg(pa_strerror(pa_context_errno(m_context)));
-                keepGoing = false;
-                ok = false;
+        case PA_CONTEXT_READY: {
+            if (m_ready) {
+                pa_threaded_mainloop_unlock(m_mainLoop);
+                return;
+            }
+            qCDebug(lcAudio, "Pulseaudio connection established.");
+            pa_context_set_subscribe_callback(m_context, subscribeCallback, this);
+            pa_operation *o = pa_context_subscribe(m_context, (pa_subscription_mask_t) (PA_SUBSCRIPTION_MASK_CARD |
+                                                                                        PA_SUBSCRIPTION_MASK_SINK |
+                                                                                        PA_SUBSCRIPTION_MASK_SOURCE |
+                                                                                        PA_SUBSCRIPTION_MASK_SERVER), NULL, this);
+            if (o)
+                pa_operation_unref(o);
+            /* From now on the model is updated by the subscription events */
+            StartupPhase phase("pulseaudio.model");
+            if (!refreshModel())
+                return;
+            phase.end();
+            m_ready = true;
+            m_reconnectdelay = RECONNECT_MIN_DELAY;
+            break;
         }
 
-        if (keepGoing) {
-            pa_threaded_mainloop_wait(m_mainLoop);
-        }
-    }
+        case PA_CONTEXT_TERMINATED:
+            qCCritical(lcAudio, "Pulseaudio context terminated.");
+            pa_threaded_mainloop_unlock(m_mainLoop);
+            releasePulseContext();
+            scheduleReconnect();
+            return;
 
-    if (ok) {
-        pa_context_set_state_callback(m_context, contextStateCallback, this);
-        pa_context_set_subscribe_callback(m_context, subscribeCallback, this);
-        pa_context_subscribe(m_context, PA_SUBSCRIPTION_MASK_CARD, NULL, this);
-    } else {
-        if (m_context) {
-            pa_context_unref(m_context);
-            m_context = 0;
-        }
+        case PA_CONTEXT_FAILED:
+        default:
+            qCCritical(lcAudio) << QString("Pulseaudio connection failure: %1").arg(pa_strerror(pa_context_errno(m_context)));
+            pa_threaded_mainloop_unlock(m_mainLoop);
+            releasePulseContext();
+            scheduleReconnect();
+            return;
     }
 
     pa_threaded_mainloop_unlock(m_mainLoop);
-    return true;
+
+    /* Apply what was requested while we were not connected. After a reconnection
+     * the server lost our routing, so an ongoing call is set up again */
+    if (m_pendingcallmode) {
+        m_pendingcallmode = false;
+        m_router->setCallMode(m_pendingcallstatus, m_pendingaudiomode);
+    } else {
+        m_router->reapply();
+    }
 }
 
+void QPulseAudioEngineWorker::scheduleReconnect()
+{
+    if (!m_reconnectTimer || m_reconnectTimer->isActive())
+        return;
 
+    qCDebug(lcAudio, "Reconnecting to PulseAudio in %d ms", m_reconnectdelay);
+    m_reconnectTimer->start(m_reconnectdelay);
+    m_reconnectdelay = qMin(m_reconnectdelay * 2, RECONNECT_MAX_DELAY);
+}
 void QPulseAudioEngineWorker::releasePulseContext()
 {
     if (m_context) {
         pa_threaded_mainloop_lock(m_mainLoop);
+        pa_context_set_state_callback(m_context, NULL, NULL);
+        pa_context_set_subscribe_callback(m_context, NULL, NULL);
         pa_context_disconnect(m_context);
         pa_context_unref(m_context);
+        m_cards.clear();
+        m_sinks.clear();
+        m_sources.clear();
+        m_modelgeneration++;
         pa_threaded_mainloop_unlock(m_mainLoop);
         m_context = 0;
+        m_ready = false;
     }
 
 }
-
 QPulseAudioEngineWorker::~QPulseAudioEngineWorker()
 {
     releasePulseContext();
@@ -250,233 +336,141 @@ QPulseAudioEngineWorker::~QPulseAudioEngineWorker()
         m_mainLoop = 0;
     }
 }
+/* Must be called with the mainloop lock held. On failure the lock is released */
+bool QPulseAudioEngineWorker::refreshModel()
+{
+    TraceScope trace("audio", "refreshModel");
+    QList<pa_operation*> operations;
 
-void QPulseAudioEngineWorker::cardInfoCallback(const pa_card_info *info)
-{
-    pa_card_profile_info2 *voice_call = NULL, *highest = NULL;
-    pa_card_profile_info2 *hsp = NULL, *a2dp = NULL;
-
-    /* For now we only support one card with the voicecall feature */
-    for (int i = 0; i < info->n_profiles; i++) {
-        if (!highest || info->profiles2[i]->priority > highest->priority)
-            highest = info->profiles2[i];
-        if (!strcmp(info->profiles2[i]->name, "voicecall"))
-            voice_call = info->profiles2[i];
-        else if (!strcmp(info->profiles2[i]->name, PULSEAUDIO_PROFILE_HSP) &&
-                 info->profiles2[i]->available != 0)
-            hsp = info->profiles2[i];
-        else if (!strcmp(info->profiles2[i]->name, PULSEAUDIO_PROFILE_A2DP) &&
-                 info->profiles2[i]->available != 0)
-            a2dp = info->profiles2[i];
-    }
-
-    /* Record the card that supports voicecall (default one to be used) */
-    if (voice_call) {
-        qDebug("Found card that supports voicecall: '%s'", info->name);
-        m_voicecallcard = info->name;
-        m_voicecallhighest = highest->name;
-        m_voicecallprofile = voice_call->name;
-    }
-
-    /* Handle the use cases needed for bluetooth */
-    if (hsp && a2dp) {
-        qDebug("Found card that supports hsp and a2dp: '%s'", info->name);
-        m_bt_hsp_a2dp = info->name;
-    } else if (hsp && (a2dp == NULL)) {
-        /* This card only provides the hsp profile */
-        qDebug("Found card that supports only hsp: '%s'", info->name);
-        m_bt_hsp = info->name;
-    }
-}
-
-void QPulseAudioEngineWorker::sinkInfoCallback(const pa_sink_info *info)
-{
-    pa_sink_port_info *earpiece = NULL, *speaker = NULL;
-    pa_sink_port_info *wired_headset = NULL, *wired_headphone = NULL;
-    pa_sink_port_info *preferred = NULL;
-    pa_sink_port_info *bluetooth_sco = NULL;
-    pa_sink_port_info *speaker_and_wired_headphone = NULL;
-    AudioMode audiomodetoset;
-    AudioModes modes;
-
-    for (int i = 0; i < info->n_ports; i++) {
-        if (!strcmp(info->ports[i]->name, "output-earpiece"))
-            earpiece = info->ports[i];
-        else if (!strcmp(info->ports[i]->name, "output-wired_headset") &&
-                (info->ports[i]->available != PA_PORT_AVAILABLE_NO) &&
-                (info->ports[i]->available != PA_PORT_AVAILABLE_UNKNOWN))
-            wired_headset = info->ports[i];
-        else if (!strcmp(info->ports[i]->name, "output-wired_headphone") &&
-                (info->ports[i]->available != PA_PORT_AVAILABLE_NO) &&
-                (info->ports[i]->available != PA_PORT_AVAILABLE_UNKNOWN))
-            wired_headphone = info->ports[i];
-        else if (!strcmp(info->ports[i]->name, "output-speaker"))
-            speaker = info->ports[i];
-        else if (!strcmp(info->ports[i]->name, "output-bluetooth_sco"))
-            bluetooth_sco = info->ports[i];
-        else if (!strcmp(info->ports[i]->name, "output-speaker+wired_headphone"))
-            speaker_and_wired_headphone = info->ports[i];
-    }
-
-    if (!earpiece || !speaker)
-        return; /* Not the right sink */
-
-    /* Refresh list of available audio modes */
-    modes.append(AudioModeEarpiece);
-    modes.append(AudioModeSpeaker);
-    if (wired_headset || wired_headphone)
-        modes.append(AudioModeWiredHeadset);
-    if (bluetooth_sco && ((m_bt_hsp != "") || (m_bt_hsp_a2dp != "")))
-        modes.append(AudioModeBluetooth);
-
-    /* Check if the requested mode is available (earpiece*/
-    if (((m_audiomode == AudioModeWiredHeadset) && !modes.contains(AudioModeWiredHeadset)) ||
-            ((m_audiomode == AudioModeBluetooth) && !modes.contains(AudioModeBluetooth)))
-        return;
-
-    /* Now to decide which output to be used, depending on the active mode */
-    qDebug("Deciding output...");
-    if (m_audiomode & AudioModeEarpiece) {
-        preferred = earpiece;
-        audiomodetoset = AudioModeEarpiece;
-        qDebug("Prefer AudioModeEarpiece");
-    }
-    if (m_audiomode & AudioModeSpeaker) {
-        preferred = speaker;
-        audiomodetoset = AudioModeSpeaker;
-        qDebug("Prefer AudioModeSpeaker");
-    }
-    if ((m_audiomode & AudioModeWiredHeadset) && (modes.contains(AudioModeWiredHeadset))) {
-        preferred = wired_headset ? wired_headset : wired_headphone;
-        audiomodetoset = AudioModeWiredHeadset;
-        qDebug("Prefer AudioModeWiredHeadset");
-    }
-    if (m_callstatus == CallRinging && speaker_and_wired_headphone) {
-        preferred = speaker_and_wired_headphone;
-        audiomodetoset = AudioModeWiredOrSpeaker;
-        qDebug("Prefer AudioModeWiredOrSpeaker");
-    }
-    if ((m_audiomode & AudioModeBluetooth) && (modes.contains(AudioModeBluetooth))) {
-        preferred = bluetooth_sco;
-        audiomodetoset = AudioModeBluetooth;
-        qDebug("Prefer AudioModeBluetooth");
-    }
-
-    m_audiomode = audiomodetoset;
-
-    int force_sink_len = 0;
-    const char* sink_name = quirk_sinkprimary_name(force_sink_len);
-    if (force_sink_len > 0 && sink_name) {
-        m_nametoset = sink_name;
-    } else {
-        m_nametoset = info->name;
-    }
-
-    if (info->active_port != preferred)
-        m_valuetoset = preferred->name;
-
-    if (modes != m_availableAudioModes)
-        m_availableAudioModes = modes;
+    m_cards.clear();
+    m_sinks.clear();
+    m_sources.clear();
+    operations << pa_context_get_card_info_list(m_context, cardinfo_cb, this);
+    operations << pa_context_get_sink_info_list(m_context, sinkinfo_cb, this);
+    operations << pa_context_get_source_info_list(m_context, sourceinfo_cb, this);
+    operations << pa_context_get_server_info(m_context, serverinfo_cb, this);
+    return handleOperations(operations, "refreshModel");
 }
 
-void QPulseAudioEngineWorker::sourceInfoCallback(const pa_source_info *info)
+static bool samePorts(const QList<AudioPort> &a, const QList<AudioPort> &b)
 {
-    pa_source_port_info *builtin_mic = NULL, *preferred = NULL;
-    pa_source_port_info *wired_headset = NULL, *bluetooth_sco = NULL;
-
-    if (info->monitor_of_sink != PA_INVALID_INDEX)
-        return;  /* Not the right source */
-
-    for (int i = 0; i < info->n_ports; i++) {
-        if (!strcmp(info->ports[i]->name, "input-builtin_mic"))
-            builtin_mic = info->ports[i];
-        else if (!strcmp(info->ports[i]->name, "input-wired_headset") &&
-                (info->ports[i]->available != PA_PORT_AVAILABLE_NO))
-            wired_headset = info->ports[i];
-        else if (!strcmp(info->ports[i]->name, "input-bluetooth_sco_headset"))
-            bluetooth_sco = info->ports[i];
+    if (a.size() != b.size())
+        return false;
+    for (int i = 0; i < a.size(); i++) {
+        if (a[i].name != b[i].name || a[i].available != b[i].available)
+            return false;
     }
+    return true;
+}
 
-    if (!builtin_mic)
-        return; /* Not the right source */
-
-    /* Now to decide which output to be used, depending on the active mode */
-    if ((m_audiomode & AudioModeEarpiece) || (m_audiomode & AudioModeSpeaker))
-        preferred = builtin_mic;
-    if ((m_audiomode & AudioModeWiredHeadset) && (m_availableAudioModes.contains(AudioModeWiredHeadset)))
-        preferred = wired_headset ? wired_headset : builtin_mic;
-    if ((m_audiomode & AudioModeBluetooth) && (m_availableAudioModes.contains(AudioModeBluetooth)))
-        preferred = bluetooth_sco;
+static bool sameDevice(const AudioDevice &a, const AudioDevice &b)
+{
+    return a.name == b.name && a.activePort == b.activePort &&
+            a.isMonitor == b.isMonitor && samePorts(a.ports, b.ports);
+}
 
-    int force_source_len = 0;
-    const char* source_name = quirk_sourceprimary_name(force_source_len);
-    if (force_source_len > 0 && source_name) {
-        m_nametoset = source_name;
-    } else {
-        m_nametoset = info->name;
+static bool sameCard(const AudioCard &a, const AudioCard &b)
+{
+    if (a.name != b.name || a.profiles.size() != b.profiles.size() || !samePorts(a.ports, b.ports))
+        return false;
+    for (int i = 0; i < a.profiles.size(); i++) {
+        if (a.profiles[i].name != b.profiles[i].name || a.profiles[i].available != b.profiles[i].available)
+            return false;
     }
-
-    if (info->active_port != preferred)
-        m_valuetoset = preferred->name;
+    return true;
 }
 
-void QPulseAudioEngineWorker::serverInfoCallback(const pa_server_info *info)
+void QPulseAudioEngineWorker::storeCard(const pa_card_info *info)
 {
-    /* Saving default sink/source to restore after call hangup */
-    m_defaultsink = info->default_sink_name;
-    m_defaultsource = info->default_source_name;
-
-    /* In the case of a server callback we need to signal the mainloop */
-    pa_threaded_mainloop_signal(mainloop(), 0);
+    AudioCard card;
+    card.index = info->index;
+    card.name = info->name;
+    for (uint32_t i = 0; i < info->n_profiles; i++) {
+        AudioProfile profile;
+        profile.name = info->profiles2[i]->name;
+        profile.priority = info->profiles2[i]->priority;
+        profile.available = info->profiles2[i]->available;
+        card.profiles.append(profile);
+    }
+    for (uint32_t i = 0; i < info->n_ports; i++) {
+        AudioPort port;
+        port.name = info->ports[i]->name;
+        port.available = info->ports[i]->available;
+        card.ports.append(port);
+    }
+    /* Only changes that can affect the routing decision invalidate a prepared route */
+    if (!m_cards.contains(card.index) || !sameCard(m_cards[card.index], card))
+        m_modelgeneration++;
+    m_cards[card.index] = card;
 }
 
-static void cardinfo_cb(pa_context *context, const pa_card_info *info, int isLast, void *userdata)
+void QPulseAudioEngineWorker::storeSink(const pa_sink_info *info)
 {
-    QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
-    if (isLast != 0 || !pulseEngine || !info) {
-        pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
-        return;
+    AudioDevice sink;
+    sink.index = info->index;
+    sink.name = info->name;
+    sink.activePort = info->active_port ? info->active_port->name : "";
+    sink.isMonitor = false;
+    for (uint32_t i = 0; i < info->n_ports; i++) {
+        AudioPort port;
+        port.name = info->ports[i]->name;
+        port.available = info->ports[i]->available;
+        sink.ports.append(port);
     }
-    pulseEngine->cardInfoCallback(info);
+    /* Only changes that can affect the routing decision invalidate a prepared route */
+    if (!m_sinks.contains(sink.index) || !sameDevice(m_sinks[sink.index], sink))
+        m_modelgeneration++;
+    m_sinks[sink.index] = sink;
 }
 
-static void sinkinfo_cb(pa_context *context, const pa_sink_info *info, int isLast, void *userdata)
+void QPulseAudioEngineWorker::storeSource(const pa_source_info *info)
 {
-    QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
-    if (isLast != 0 || !pulseEngine || !info) {
-        pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
-        return;
+    AudioDevice source;
+    source.index = info->index;
+    source.name = info->name;
+    source.activePort = info->active_port ? info->active_port->name : "";
+    source.isMonitor = (info->monitor_of_sink != PA_INVALID_INDEX);
+    for (uint32_t i = 0; i < info->n_ports; i++) {
+        AudioPort port;
+        port.name = info->ports[i]->name;
+        port.available = info->ports[i]->available;
+        source.ports.append(port);
     }
-    pulseEngine->sinkInfoCallback(info);
+    /* Only changes that can affect the routing decision invalidate a prepared route */
+    if (!m_sources.contains(source.index) || !sameDevice(m_sources[source.index], source))
+        m_modelgeneration++;
+    m_sources[source.index] = source;
 }
 
-static void sourceinfo_cb(pa_context *context, const pa_source_info *info, int isLast, void *userdata)
+void QPulseAudioEngineWorker::removeObject(pa_subscription_event_type_t facility, uint32_t idx)
 {
-    QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
-    if (isLast != 0 || !pulseEngine || !info) {
-        pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
-        return;
-    }
-    pulseEngine->sourceInfoCallback(info);
+    if (facility == PA_SUBSCRIPTION_EVENT_CARD)
+        m_cards.remove(idx);
+    else if (facility == PA_SUBSCRIPTION_EVENT_SINK)
+        m_sinks.remove(idx);
+    else if (facility == PA_SUBSCRIPTION_EVENT_SOURCE)
+        m_sources.remove(idx);
+    m_modelgeneration++;
 }
 
-static void serverinfo_cb(pa_context *context, const pa_server_info *info, void *userdata)
+void QPulseAudioEngineWorker::serverInfoCallback(const pa_server_info *info)
 {
-    QPulseAudioEngineWorker *pulseEngine = static_cast<QPulseAudioEngineWorker*>(userdata);
-    if (!pulseEngine || !info) {
-        pa_threaded_mainloop_signal(pulseEngine->mainloop(), 0);
-        return;
-    }
-    pulseEngine->serverInfoCallback(info);
+    /* Keep track of the current default sink/source */
+    m_serverdefaultsink = info->default_sink_name ? info->default_sink_name : "";
+    m_serverdefaultsource = info->default_source_name ? info->default_source_name : "";
+
+    /* In the case of a server callback we need to signal the mainloop */
+    pa_threaded_mainloop_signal(mainloop(), 0);
 }
 
 bool QPulseAudioEngineWorker::handleOperation(pa_operation *operation, const char *func_name)
 {
     if (!operation) {
-        qCritical("'%s' failed (lost PulseAudio connection?)", func_name);
-        /* Free resources so it can retry a new connection during next operation */
+        qCCritical(lcAudio, "'%s' failed (lost PulseAudio connection?)", func_name);
+        /* Free resources and retry a new connection */
         pa_threaded_mainloop_unlock(m_mainLoop);
         releasePulseContext();
+        scheduleReconnect();
         return false;
     }
 
@@ -486,320 +480,287 @@ bool QPulseAudioEngineWorker::handleOperation(pa_operation *operation, const cha
     return true;
 }
 
-int QPulseAudioEngineWorker::setupVoiceCall()
+bool QPulseAudioEngineWorker::handleOperations(const QList<pa_operation*> &operations, const char *func_name)
 {
-    pa_operation *o;
-
-    qDebug("Setting up pulseaudio for voice call");
-
-    pa_threaded_mainloop_lock(m_mainLoop);
+    TraceScope trace("audio", "handleOperations");
+    if (operations.isEmpty())
+        return true;
 
-    /* Get and set the default sink/source to be restored later */
-    o = pa_context_get_server_info(m_context, serverinfo_cb, this);
-    if (!handleOperation(o, "pa_context_get_server_info"))
-        return -1;
-
-    qDebug("Recorded default sink: %s default source: %s",
-            m_defaultsink.c_str(), m_defaultsource.c_str());
-
-    /* Walk through the list of devices, find the voice call capable card and
-     * identify if we have bluetooth capable devices (hsp and a2dp) */
-    m_voicecallcard = m_voicecallhighest = m_voicecallprofile = "";
-    m_bt_hsp = m_bt_hsp_a2dp = "";
-    o = pa_context_get_card_info_list(m_context, cardinfo_cb, this);
-    if (!handleOperation(o, "pa_context_get_card_info_list"))
-        return -1;
-    /* In case we have only one bt device that provides hsp and a2dp, we need
-     * to make sure we switch the default profile for that card (to hsp) */
-    if ((m_bt_hsp_a2dp != "") && (m_bt_hsp == "")) {
-        qDebug("Setting PulseAudio card '%s' profile '%s'",
-                m_bt_hsp_a2dp.c_str(), PULSEAUDIO_PROFILE_HSP);
-        o = pa_context_set_card_profile_by_name(m_context,
-            m_bt_hsp_a2dp.c_str(), PULSEAUDIO_PROFILE_HSP, success_cb, this);
-        if (!handleOperation(o, "pa_context_set_card_profile_by_name"))
-            return -1;
+    if (operations.contains(NULL)) {
+        Q_FOREACH(pa_operation *operation, operations) {
+            if (operation)
+                pa_operation_unref(operation);
+        }
+        return handleOperation(NULL, func_name);
     }
 
-    pa_threaded_mainloop_unlock(m_mainLoop);
+    /* PulseAudio handles the requests of a context in order, so once the last
+     * one is done all of them are: the whole batch costs a single round trip */
+    pa_operation *last = operations.last();
+    while (pa_operation_get_state(last) == PA_OPERATION_RUNNING)
+        pa_threaded_mainloop_wait(m_mainLoop);
+    Q_FOREACH(pa_operation *operation, operations)
+        pa_operation_unref(operation);
+    return true;
+}
 
-    return 0;
+void QPulseAudioEngineWorker::requestCallMode(CallStatus callstatus, AudioMode audiomode)
+{
+    QMutexLocker locker(&m_targetmutex);
+    m_targetcallstatus = callstatus;
+    m_targetaudiomode = audiomode;
+    m_targethascallmode = true;
+    m_targetrequests++;
+    if (!m_targetscheduled) {
+        m_targetscheduled = true;
+        QMetaObject::invokeMethod(this, "applyRouteTarget", Qt::QueuedConnection);
+    }
 }
 
-void QPulseAudioEngineWorker::restoreVoiceCall()
+void QPulseAudioEngineWorker::requestMicMute(bool muted)
 {
-    pa_operation *o;
+    QMutexLocker locker(&m_targetmutex);
+    m_targetmicmute = muted;
+    m_targetrequests++;
+    if (!m_targetscheduled) {
+        m_targetscheduled = true;
+        QMetaObject::invokeMethod(this, "applyRouteTarget", Qt::QueuedConnection);
+    }
+}
 
-    qDebug("Restoring pulseaudio previous state");
+int QPulseAudioEngineWorker::collapsedTransitions() const
+{
+    return m_collapsedtransitions.load();
+}
 
-    /* Then restore previous settings */
-    pa_threaded_mainloop_lock(m_mainLoop);
+void QPulseAudioEngineWorker::applyRouteTarget()
+{
+    TraceScope trace("audio", "applyRouteTarget");
+    m_targetmutex.lock();
+    CallStatus callstatus = m_targetcallstatus;
+    AudioMode audiomode = m_targetaudiomode;
+    bool micmute = m_targetmicmute;
+    bool hascallmode = m_targethascallmode;
+    int requests = m_targetrequests;
+    m_targethascallmode = false;
+    m_targetscheduled = false;
+    m_targetrequests = 0;
+    m_targetmutex.unlock();
 
-    /* See if we need to restore any HSP+AD2P device state */
-    if ((m_bt_hsp_a2dp != "") && (m_bt_hsp == "")) {
-        qDebug("Restoring PulseAudio card '%s' to profile '%s'",
-                m_bt_hsp_a2dp.c_str(), PULSEAUDIO_PROFILE_A2DP);
-        o = pa_context_set_card_profile_by_name(m_context,
-            m_bt_hsp_a2dp.c_str(), PULSEAUDIO_PROFILE_A2DP, success_cb, this);
-        if (!handleOperation(o, "pa_context_set_card_profile_by_name"))
-            return;
+    if (requests > 1) {
+        m_collapsedtransitions.fetchAndAddRelaxed(requests - 1);
+        qCDebug(lcAudio, "Collapsed %d audio route requests", requests - 1);
     }
 
-    /* Restore default sink/source */
-    if (m_defaultsink != "") {
-        qDebug("Restoring PulseAudio default sink to '%s'", m_defaultsink.c_str());
-        o = pa_context_set_default_sink(m_context, m_defaultsink.c_str(), success_cb, this);
-        if (!handleOperation(o, "pa_context_set_default_sink"))
-            return;
-    }
-    if (m_defaultsource != "") {
-        qDebug("Restoring PulseAudio default source to '%s'", m_defaultsource.c_str());
-        o = pa_context_set_default_source(m_context, m_defaultsource.c_str(), success_cb, this);
-        if (!handleOperation(o, "pa_context_set_default_source"))
-            return;
+    /* A single pass converges to the latest target, including the mic mute state */
+    if (hascallmode) {
+        if (!m_ready) {
+            m_router->setMicMute(micmute);
+            setCallMode(callstatus, audiomode);
+        } else {
+            m_router->setCallMode(callstatus, audiomode, micmute);
+        }
+    } else {
+        setMicMute(micmute);
     }
-
-    pa_threaded_mainloop_unlock(m_mainLoop);
 }
 
 void QPulseAudioEngineWorker::setCallMode(CallStatus callstatus, AudioMode audiomode)
 {
-    if (!createPulseContext()) {
-       return;
+    if (!m_ready) {
+        /* Applied once the context is ready, only the latest request matters */
+        qCDebug(lcAudio, "PulseAudio not ready yet, delaying call mode change");
+        m_pendingcallmode = true;
+        m_pendingcallstatus = callstatus;
+        m_pendingaudiomode = audiomode;
+        createPulseContext();
+        return;
     }
-    CallStatus p_callstatus = m_callstatus;
-    AudioMode p_audiomode = m_audiomode;
-    AudioModes p_availableAudioModes = m_availableAudioModes;
-    pa_operation *o;
 
-    /* Check if we need to save the current pulseaudio state (e.g. when starting a call) */
-    if ((callstatus != CallEnded) && (p_callstatus == CallEnded)) {
-        if (setupVoiceCall() < 0) {
-            qCritical("Failed to setup PulseAudio for Voice Call");
-            return;
-        }
-    }
+    m_router->setCallMode(callstatus, audiomode);
+}
 
-    /* If we have an active call, update internal state (used later when updating sink/source ports) */
-    m_callstatus = callstatus;
-    m_audiomode = audiomode;
+void QPulseAudioEngineWorker::setMicMute(bool muted)
+{
+    /* If not ready yet, the mute state is applied together with the call mode */
+    m_router->setMicMute(muted);
+}
 
-    pa_threaded_mainloop_lock(m_mainLoop);
+void QPulseAudioEngineWorker::prepareCall(AudioMode audiomode)
+{
+    TraceScope trace("audio", "prepareCall");
+    if (m_ready)
+        m_router->prepareCall(audiomode);
+}
 
-    /* Switch the virtual card mode when call is active and not active
-     * This needs to be done before sink/source gets updated, because after changing mode
-     * it will automatically move to input/output-parking */
-    if ((m_callstatus == CallActive) && (p_callstatus != CallActive) &&
-            (m_voicecallcard != "") && (m_voicecallprofile != "")) {
-        qDebug("Setting PulseAudio card '%s' profile '%s'",
-                m_voicecallcard.c_str(), m_voicecallprofile.c_str());
-        o = pa_context_set_card_profile_by_name(m_context,
-                m_voicecallcard.c_str(), m_voicecallprofile.c_str(), success_cb, this);
-        if (!handleOperation(o, "pa_context_set_card_profile_by_name"))
-            return;
-    } else if ((m_callstatus == CallEnded) && (m_voicecallcard != "") && (m_voicecallhighest != "")) {
-        /* If using droid, make sure to restore to the profile that has the highest score */
-        qDebug("Restoring PulseAudio card '%s' to profile '%s'",
-                m_voicecallcard.c_str(), m_voicecallhighest.c_str());
-        o = pa_context_set_card_profile_by_name(m_context,
-            m_voicecallcard.c_str(), m_voicecallhighest.c_str(), success_cb, this);
-        if (!handleOperation(o, "pa_context_set_card_profile_by_name"))
-            return;
-    }
+QList<AudioCard> QPulseAudioEngineWorker::cards()
+{
+    if (!m_ready)
+        return QList<AudioCard>();
 
-    /* Find highest compatible sink/source elements from the voicecall
-       compatible card (on touch this means the pulse droid element) */
-    m_nametoset = m_valuetoset = "";
-    o = pa_context_get_sink_info_list(m_context, sinkinfo_cb, this);
-    if (!handleOperation(o, "pa_context_get_sink_info_list"))
-        return;
-    if (m_nametoset != "") {
-        qDebug("Setting PulseAudio default sink to '%s'", m_nametoset.c_str());
-        o = pa_context_set_default_sink(m_context, m_nametoset.c_str(), success_cb, this);
-        if (!handleOperation(o, "pa_context_set_default_sink"))
-            return;
-    }
-    if (m_valuetoset != "") {
-        qDebug("Setting PulseAudio sink '%s' port '%s'",
-                m_nametoset.c_str(), m_valuetoset.c_str());
-        o = pa_context_set_sink_port_by_name(m_context, m_nametoset.c_str(),
-                                             m_valuetoset.c_str(), success_cb, this);
-        if (!handleOperation(o, "pa_context_set_sink_port_by_name"))
-            return;
-    }
+    pa_threaded_mainloop_lock(m_mainLoop);
+    QList<AudioCard> cards = m_cards.values();
+    pa_threaded_mainloop_unlock(m_mainLoop);
+    return cards;
+}
 
-    /* Same for source */
-    m_nametoset = m_valuetoset = "";
-    o = pa_context_get_source_info_list(m_context, sourceinfo_cb, this);
-    if (!handleOperation(o, "pa_context_get_source_info_list"))
-        return;
-    if (m_nametoset != "") {
-        qDebug("Setting PulseAudio default source to '%s'", m_nametoset.c_str());
-        o = pa_context_set_default_source(m_context, m_nametoset.c_str(), success_cb, this);
-        if (!handleOperation(o, "pa_context_set_default_source"))
-            return;
-    }
-    if (m_valuetoset != "") {
-        qDebug("Setting PulseAudio source '%s' port '%s'",
-                m_nametoset.c_str(), m_valuetoset.c_str());
-        o = pa_context_set_source_port_by_name(m_context, m_nametoset.c_str(),
-                                               m_valuetoset.c_str(), success_cb, this);
-        if (!handleOperation(o, "pa_context_set_source_port_by_name"))
-            return;
-    }
+QList<AudioDevice> QPulseAudioEngineWorker::sinks()
+{
+    if (!m_ready)
+        return QList<AudioDevice>();
 
+    pa_threaded_mainloop_lock(m_mainLoop);
+    QList<AudioDevice> sinks = m_sinks.values();
     pa_threaded_mainloop_unlock(m_mainLoop);
+    return sinks;
+}
 
-    /* Notify if the list of audio modes changed */
-    if (p_availableAudioModes != m_availableAudioModes)
-        Q_EMIT availableAudioModesChanged(m_availableAudioModes);
+QList<AudioDevice> QPulseAudioEngineWorker::sources()
+{
+    if (!m_ready)
+        return QList<AudioDevice>();
 
-    /* Notify if call mode changed */
-    if (p_audiomode != m_audiomode) {
-        Q_EMIT audioModeChanged(m_audiomode);
-    }
+    pa_threaded_mainloop_lock(m_mainLoop);
+    QList<AudioDevice> sources = m_sources.values();
+    pa_threaded_mainloop_unlock(m_mainLoop);
+    return sources;
+}
 
-    /* If no more active voicecall, restore previous saved pulseaudio state */
-    if (callstatus == CallEnded) {
-        restoreVoiceCall();
-    }
+std::string QPulseAudioEngineWorker::defaultSink()
+{
+    if (!m_ready)
+        return std::string();
 
-    /* In case the app had set mute when the call wasn't active, make sure we reflect it here */
-    if (m_callstatus != CallEnded)
-        setMicMute(m_micmute);
+    pa_threaded_mainloop_lock(m_mainLoop);
+    std::string sink = m_serverdefaultsink;
+    pa_threaded_mainloop_unlock(m_mainLoop);
+    return sink;
 }
 
-void QPulseAudioEngineWorker::setMicMute(bool muted)
+std::string QPulseAudioEngineWorker::defaultSource()
 {
-    if (!createPulseContext()) {
-       return;
-    }
- 
-    m_micmute = muted;
-
-    if (m_callstatus == CallEnded)
-        return;
+    if (!m_ready)
+        return std::string();
 
     pa_threaded_mainloop_lock(m_mainLoop);
+    std::string source = m_serverdefaultsource;
+    pa_threaded_mainloop_unlock(m_mainLoop);
+    return source;
+}
 
-    m_nametoset = "";
-    pa_operation *o = pa_context_get_source_info_list(m_context, sourceinfo_cb, this);
-    if (!handleOperation(o, "pa_context_get_source_info_list"))
-        return;
+quint64 QPulseAudioEngineWorker::generation()
+{
+    if (!m_mainLoop)
+        return m_modelgeneration;
 
-    if (m_nametoset != "") {
-        int m = m_micmute ? 1 : 0;
-        qDebug("Setting PulseAudio source '%s' muted '%d'", m_nametoset.c_str(), m);
-        o = pa_context_set_source_mute_by_name(m_context, 
-            m_nametoset.c_str(), m, success_cb, this);
-        if (!handleOperation(o, "pa_context_set_source_mute_by_name"))
-            return;
-    }
+    pa_threaded_mainloop_lock(m_mainLoop);
+    quint64 generation = m_modelgeneration;
+    pa_threaded_mainloop_unlock(m_mainLoop);
+    return generation;
+}
+
+bool QPulseAudioEngineWorker::sync()
+{
+    if (!m_ready)
+        return false;
 
+    pa_threaded_mainloop_lock(m_mainLoop);
+    if (!refreshModel())
+        return false;
     pa_threaded_mainloop_unlock(m_mainLoop);
+    return true;
 }
 
-void QPulseAudioEngineWorker::plugCardCallback(const pa_card_info *info)
+bool QPulseAudioEngineWorker::apply(const AudioOperations &operations)
 {
-    qDebug("Notified about card (%s) add event from PulseAudio", info->name);
+    QList<pa_operation*> pending;
 
-    /* We only care about BT (HSP) devices, and if one is not already available */
-    if ((m_callstatus != CallEnded) && ((m_bt_hsp == "") || (m_bt_hsp_a2dp == ""))) {
-        /* Check if it's indeed a BT device (with at least one hsp profile) */
-        pa_card_profile_info *hsp = NULL;
-        for (int i = 0; i < info->n_profiles; i++) {
-            if (!strcmp(info->profiles[i].name, PULSEAUDIO_PROFILE_HSP))
-                hsp = &info->profiles[i];
-        }
-        if (hsp)
-            m_handleevent = true;
-    }
-}
-
-void QPulseAudioEngineWorker::updateCardCallback(const pa_card_info *info)
-{
-    qDebug("Notified about card (%s) changes event from PulseAudio", info->name);
-
-    /* We only care if the card event for the voicecall capable card */
-    if ((m_callstatus == CallActive) && (!strcmp(info->name, m_voicecallcard.c_str()))) {
-        if (m_audiomode == AudioModeWiredHeadset) {
-            /* If previous mode is wired, it means it got unplugged */
-            m_handleevent = true;
-            m_audiomodetoset = AudioModeBtOrWiredOrEarpiece;
-        } else if ((m_audiomode == AudioModeEarpiece) || ((m_audiomode == AudioModeSpeaker))) {
-            /* Now only trigger the event in case wired headset/headphone is now available */
-            pa_card_port_info *port_info = NULL;
-            for (int i = 0; i < info->n_ports; i++) {
-                if (info->ports[i] && (info->ports[i]->available == PA_PORT_AVAILABLE_YES) && (
-                            !strcmp(info->ports[i]->name, "output-wired_headset") ||
-                            !strcmp(info->ports[i]->name, "output-wired_headphone"))) {
-                    m_handleevent = true;
-                    m_audiomodetoset = AudioModeWiredOrEarpiece;
-                }
-            }
-        } else if (m_audiomode == AudioModeBluetooth) {
-            /* Handle the event so we can update the audiomodes */
-            m_handleevent = true;
-            m_audiomodetoset = AudioModeBluetooth;
+    if (operations.isEmpty())
+        return true;
+
+    if (!m_ready)
+        return false;
+
+    pa_threaded_mainloop_lock(m_mainLoop);
+
+    Q_FOREACH(const AudioOperation &operation, operations) {
+        const char *object = operation.object.c_str();
+        const char *value = operation.value.c_str();
+        switch (operation.type) {
+        case AudioOperation::SetCardProfile:
+            pending << pa_context_set_card_profile_by_name(m_context, object, value, success_cb, this);
+            break;
+        case AudioOperation::SetDefaultSink:
+            pending << pa_context_set_default_sink(m_context, object, success_cb, this);
+            break;
+        case AudioOperation::SetDefaultSource:
+            pending << pa_context_set_default_source(m_context, object, success_cb, this);
+            break;
+        case AudioOperation::SetSinkPort:
+            pending << pa_context_set_sink_port_by_name(m_context, object, value, success_cb, this);
+            break;
+        case AudioOperation::SetSourcePort:
+            pending << pa_context_set_source_port_by_name(m_context, object, value, success_cb, this);
+            break;
+        case AudioOperation::SetSourceMute:
+            pending << pa_context_set_source_mute_by_name(m_context, object, operation.mute ? 1 : 0, success_cb, this);
+            break;
         }
     }
+
+    if (!handleOperations(pending, "apply"))
+        return false;
+
+    /* Reflect our own changes in the model, so the events they cause are no news */
+    Q_FOREACH(const AudioOperation &operation, operations) {
+        if (operation.type == AudioOperation::SetSinkPort)
+            updateActivePort(m_sinks, operation.object, operation.value);
+        else if (operation.type == AudioOperation::SetSourcePort)
+            updateActivePort(m_sources, operation.object, operation.value);
+    }
+
+    pa_threaded_mainloop_unlock(m_mainLoop);
+    return true;
 }
 
-void QPulseAudioEngineWorker::unplugCardCallback()
+/* Must be called with the mainloop lock held */
+void QPulseAudioEngineWorker::updateActivePort(QMap<uint32_t, AudioDevice> &devices,
+                                               const std::string &name, const std::string &port)
 {
-    if (m_callstatus != CallEnded) {
-        m_handleevent = true;
+    QMap<uint32_t, AudioDevice>::iterator it;
+    for (it = devices.begin(); it != devices.end(); ++it) {
+        if (it->name == name)
+            it->activePort = port;
     }
 }
 
 void QPulseAudioEngineWorker::handleCardEvent(const int evt, const unsigned int idx)
 {
-    pa_operation *o = NULL;
-
-    /* Internal state var used to know if we need to update our internal state */
-    m_handleevent = false;
+    /* Queued from a context that is gone already */
+    if (!m_ready)
+        return;
 
-    if (evt == PA_SUBSCRIPTION_EVENT_NEW) {
-        o = pa_context_get_card_info_by_index(m_context, idx, plug_card_cb, this);
-        if (!handleOperation(o, "pa_context_get_card_info_by_index"))
-            return;
-        if (m_handleevent) {
-            qDebug("Adding new BT-HSP capable device");
-            /* In case A2DP is available, switch to HSP */
-            if (setupVoiceCall() < 0)
-                return;
-            /* Enable the HSP output port  */
-            setCallMode(m_callstatus, AudioModeBluetooth);
-        }
-    } else if (evt == PA_SUBSCRIPTION_EVENT_CHANGE) {
-        o = pa_context_get_card_info_by_index(m_context, idx, update_card_cb, this);
-        if (!handleOperation(o, "pa_context_get_card_info_by_index"))
-            return;
-        if (m_handleevent) {
-            /* In this case it means the handset state changed */
-            qDebug("Notifying card changes for the voicecall capable card");
-            setCallMode(m_callstatus, m_audiomodetoset);
-        }
-    } else if (evt == PA_SUBSCRIPTION_EVENT_REMOVE) {
-        /* Check if the main HSP card was removed */
-        if (m_bt_hsp != "") {
-            o = pa_context_get_card_info_by_name(m_context, m_bt_hsp.c_str(), unplug_card_cb, this);
-            if (!handleOperation(o, "pa_context_get_sink_info_by_name"))
-                return;
-        }
-        if (m_bt_hsp_a2dp != "") {
-            o = pa_context_get_card_info_by_name(m_context, m_bt_hsp_a2dp.c_str(), unplug_card_cb, this);
-            if (!handleOperation(o, "pa_context_get_sink_info_by_name"))
-                return;
-        }
-        if (m_handleevent) {
-            qDebug("Notifying about BT-HSP card removal");
-            /* Needed in order to save the default sink/source */
-            if (setupVoiceCall() < 0)
-                return;
-            /* Enable the default handset output port  */
-            setCallMode(m_callstatus, AudioModeWiredOrEarpiece);
-        }
+    if (evt == PA_SUBSCRIPTION_EVENT_REMOVE) {
+        /* The card is already gone from the model */
+        m_router->cardRemoved();
+        return;
     }
+
+    pa_threaded_mainloop_lock(m_mainLoop);
+    pa_operation *o = pa_context_get_card_info_by_index(m_context, idx, cardinfo_cb, this);
+    if (!handleOperation(o, "pa_context_get_card_info_by_index"))
+        return;
+    bool found = m_cards.contains(idx);
+    AudioCard card = m_cards.value(idx);
+    pa_threaded_mainloop_unlock(m_mainLoop);
+
+    if (!found)
+        return;
+
+    if (evt == PA_SUBSCRIPTION_EVENT_NEW)
+        m_router->cardAdded(card);
+    else if (evt == PA_SUBSCRIPTION_EVENT_CHANGE)
+        m_router->cardChanged(card);
 }
 
 Q_GLOBAL_STATIC(QPulseAudioEngine, pulseEngine);
@@ -813,11 +774,14 @@ QPulseAudioEngine::QPulseAudioEngine(QObject *parent) :
     mWorker = new QPulseAudioEngineWorker();
     QObject::connect(mWorker, SIGNAL(audioModeChanged(const AudioMode)), this, SIGNAL(audioModeChanged(const AudioMode)), Qt::QueuedConnection);
     QObject::connect(mWorker, SIGNAL(availableAudioModesChanged(const AudioModes)), this, SIGNAL(availableAudioModesChanged(const AudioModes)), Qt::QueuedConnection);
-    mWorker->createPulseContext();
+    QObject::connect(mWorker, SIGNAL(routeSwitched(qint64)), this, SIGNAL(routeSwitched(qint64)), Qt::QueuedConnection);
+    QObject::connect(mWorker, SIGNAL(callAudioActivated()), this, SLOT(onCallAudioActivated()), Qt::QueuedConnection);
+    QObject::connect(this, SIGNAL(routeSwitched(qint64)), this, SLOT(onRouteSwitched(qint64)));
     mWorker->moveToThread(&mThread);
     mThread.start();
+    /* Connect from the worker thread, so nobody waits for PulseAudio to be up */
+    QMetaObject::invokeMethod(mWorker, "createPulseContext", Qt::QueuedConnection);
 }
-
 QPulseAudioEngine::~QPulseAudioEngine()
 {
     mThread.quit();
@@ -832,12 +796,44 @@ QPulseAudioEngine *QPulseAudioEngine::instance()
 
 void QPulseAudioEngine::setCallMode(CallStatus callstatus, AudioMode audiomode)
 {
-    QMetaObject::invokeMethod(mWorker, "setCallMode", Qt::QueuedConnection, Q_ARG(CallStatus, callstatus), Q_ARG(AudioMode, audiomode));
+    mWorker->requestCallMode(callstatus, audiomode);
 }
 
 void QPulseAudioEngine::setMicMute(bool muted)
 {
-    QMetaObject::invokeMethod(mWorker, "setMicMute", Qt::QueuedConnection, Q_ARG(bool, muted));
+    mWorker->requestMicMute(muted);
+}
+
+void QPulseAudioEngine::prepareCall(AudioMode audiomode)
+{
+    QMetaObject::invokeMethod(mWorker, "prepareCall", Qt::QueuedConnection, Q_ARG(AudioMode, audiomode));
+}
+
+void QPulseAudioEngine::callAnswered()
+{
+    mAnswerTimer.start();
+}
+
+void QPulseAudioEngine::onCallAudioActivated()
+{
+    if (!mAnswerTimer.isValid())
+        return;
+
+    qint64 latency = mAnswerTimer.elapsed();
+    mAnswerTimer.invalidate();
+    qCDebug(lcAudio, "Answer to audio latency: %lld ms", latency);
+    Metrics::instance()->record("audio.answer", latency * 1000);
+    Q_EMIT answerToAudioLatency(latency);
+}
+
+void QPulseAudioEngine::onRouteSwitched(qint64 elapsedUsecs)
+{
+    Metrics::instance()->record("audio.route_switch", elapsedUsecs);
+}
+
+int QPulseAudioEngine::collapsedTransitions() const
+{
+    return mWorker->collapsedTransitions();
 }
 
 QT_END_NAMESPACE
@@ -22,35 +22,22 @@
 
 #include <QtCore/qmap.h>
 #include <QtCore/qbytearray.h>
+#include <QtCore/qlist.h>
 #include <QThread>
+#include <QTimer>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <string>
 #include <pulse/pulseaudio.h>
 
-enum AudioMode {
-    AudioModeEarpiece = 0x0001,
-    AudioModeWiredHeadset = 0x0002,
-    AudioModeSpeaker = 0x0004,
-    AudioModeBluetooth = 0x0008,
-    AudioModeBtOrWiredOrEarpiece = AudioModeBluetooth | AudioModeWiredHeadset | AudioModeEarpiece,
-    AudioModeWiredOrEarpiece = AudioModeWiredHeadset | AudioModeEarpiece,
-    AudioModeWiredOrSpeaker = AudioModeWiredHeadset | AudioModeSpeaker
-};
-
-Q_DECLARE_METATYPE(AudioMode)
-
-typedef QList<AudioMode> AudioModes;
-Q_DECLARE_METATYPE(AudioModes)
-
-enum CallStatus {
-    CallRinging,
-    CallActive,
-    CallEnded
-};
-
-Q_DECLARE_METATYPE(CallStatus)
+#include "audiorouting.h"
 
 QT_BEGIN_NAMESPACE
 
-class QPulseAudioEngineWorker : public QObject
+/* PulseAudio implementation of AudioBackend. It keeps an in-memory copy of
+ * the cards, sinks and sources, updated by subscription events */
+class QPulseAudioEngineWorker : public QObject, public AudioBackend
 {
     Q_OBJECT
 
@@ -60,44 +47,76 @@ public:
 
     pa_threaded_mainloop *mainloop() { return m_mainLoop; }
     pa_context *context() { return m_context; }
-    bool createPulseContext(void);
-    int setupVoiceCall(void);
-    void restoreVoiceCall(void);
     /* Callbacks to be used internally */
-    void cardInfoCallback(const pa_card_info *card);
-    void sinkInfoCallback(const pa_sink_info *sink);
-    void sourceInfoCallback(const pa_source_info *source);
     void serverInfoCallback(const pa_server_info *server);
-    void plugCardCallback(const pa_card_info *card);
-    void updateCardCallback(const pa_card_info *card);
-    void unplugCardCallback();
+    /* Model updates, called from the PulseAudio thread with the mainloop lock held */
+    void storeCard(const pa_card_info *card);
+    void storeSink(const pa_sink_info *sink);
+    void storeSource(const pa_source_info *source);
+    void removeObject(pa_subscription_event_type_t facility, uint32_t idx);
+    /* Thread safe: record the desired route, only the latest one gets applied */
+    void requestCallMode(CallStatus callstatus, AudioMode audiomode);
+    void requestMicMute(bool muted);
+    int collapsedTransitions() const;
+
+    /* AudioBackend */
+    QList<AudioCard> cards() override;
+    QList<AudioDevice> sinks() override;
+    QList<AudioDevice> sources() override;
+    std::string defaultSink() override;
+    std::string defaultSource() override;
+    quint64 generation() override;
+    bool sync() override;
+    bool apply(const AudioOperations &operations) override;
 
 Q_SIGNALS:
     void audioModeChanged(const AudioMode mode);
     void availableAudioModesChanged(const AudioModes modes);
+    void routeSwitched(qint64 elapsedUsecs);
+    void callAudioActivated();
 
 public Q_SLOTS:
+    bool createPulseContext(void);
+    void handleContextState(void);
     void handleCardEvent(const int evt, const unsigned int idx);
     void setCallMode(CallStatus callstatus, AudioMode audiomode);
     void setMicMute(bool muted); /* True if muted, false if unmuted */
+    void applyRouteTarget();
+    /* Resolves in advance the route of a call that is about to become active */
+    void prepareCall(AudioMode audiomode);
 
 private:
     pa_mainloop_api *m_mainLoopApi;
     pa_threaded_mainloop *m_mainLoop;
     pa_context *m_context;
-
-    AudioModes m_availableAudioModes;
-    CallStatus m_callstatus;
-    AudioMode m_audiomode;
-    AudioMode m_audiomodetoset;
-    bool m_micmute, m_handleevent;
-    std::string m_nametoset, m_valuetoset;
-    std::string m_defaultsink, m_defaultsource;
-    std::string m_bt_hsp, m_bt_hsp_a2dp;
-    std::string m_voicecallcard, m_voicecallhighest, m_voicecallprofile;
+    QTimer *m_reconnectTimer;
+    AudioRouter *m_router;
+
+    /* Route requested before the context got ready */
+    bool m_ready, m_pendingcallmode;
+    CallStatus m_pendingcallstatus;
+    AudioMode m_pendingaudiomode;
+    int m_reconnectdelay;
+    std::string m_serverdefaultsink, m_serverdefaultsource;
+    QMap<uint32_t, AudioCard> m_cards;
+    QMap<uint32_t, AudioDevice> m_sinks, m_sources;
+    quint64 m_modelgeneration;
+
+    /* Latest requested route, protected by m_targetmutex */
+    QMutex m_targetmutex;
+    CallStatus m_targetcallstatus;
+    AudioMode m_targetaudiomode;
+    bool m_targetmicmute, m_targethascallmode, m_targetscheduled;
+    int m_targetrequests;
+    QAtomicInt m_collapsedtransitions;
 
     bool handleOperation(pa_operation *operation, const char *func_name);
+    bool handleOperations(const QList<pa_operation*> &operations, const char *func_name);
+    bool refreshModel(void);
+    void updateActivePort(QMap<uint32_t, AudioDevice> &devices,
+                          const std::string &name, const std::string &port);
     void releasePulseContext(void);
+    void scheduleReconnect(void);
 };
 
 class QPulseAudioEngine : public QObject
@@ -110,13 +129,27 @@ public:
 
     void setCallMode(CallStatus callstatus, AudioMode audiomode);
     void setMicMute(bool muted); /* True if muted, false if unmuted */
+    /* Number of requests superseded before they were applied */
+    int collapsedTransitions() const;
+    /* Pre-warms the audio path of a ringing/dialing call */
+    void prepareCall(AudioMode audiomode);
+    /* Starts measuring the answer to audio latency */
+    void callAnswered();
 
 Q_SIGNALS:
     void audioModeChanged(const AudioMode mode);
     void availableAudioModesChanged(const AudioModes modes);
+    void routeSwitched(qint64 elapsedUsecs);
+    void answerToAudioLatency(qint64 msecs);
+
+private Q_SLOTS:
+    void onCallAudioActivated();
+    void onRouteSwitched(qint64 elapsedUsecs);
+
 private:
     QPulseAudioEngineWorker *mWorker;
     QThread mThread;
+    QElapsedTimer mAnswerTimer;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,135 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "retryscheduler.h"
+#include "logging.h"
+#include "metrics.h"
+
+#include <QDebug>
+
+RetryScheduler::RetryScheduler(QObject *parent)
+    : QObject(parent)
+{
+}
+
+RetryPolicy RetryScheduler::policy(const QString &operation) const
+{
+    return mOperations.value(operation).policy;
+}
+
+void RetryScheduler::setPolicy(const QString &operation, const RetryPolicy &policy)
+{
+    mOperations[operation].policy = policy;
+}
+
+int RetryScheduler::delayFor(const RetryPolicy &policy, int attempt) const
+{
+    if (policy.retryImmediately) {
+        if (attempt == 1) {
+            return 0;
+        }
+        attempt--;
+    }
+    int delay = policy.initialDelay;
+    for (int i = 1; i < attempt && delay < policy.maxDelay; i++) {
+        delay *= 2;
+    }
+    return qMin(delay, policy.maxDelay);
+}
+
+bool RetryScheduler::retry(const QString &operation, QObject *receiver, const char *method)
+{
+    OperationState &state = mOperations[operation];
+
+    if (state.policy.maxRetries >= 0 && state.attempts >= state.policy.maxRetries) {
+        qCWarning(lcCall) << "Giving up on" << operation << "after" << state.attempts << "retries";
+        state.exhausted++;
+        Metrics::instance()->increment("call.retries_exhausted." + operation);
+        state.attempts = 0;
+        if (state.timer) {
+            state.timer->stop();
+        }
+        Q_EMIT retriesExhausted(operation);
+        return false;
+    }
+
+    if (!state.timer) {
+        state.timer = new QTimer(this);
+        state.timer->setSingleShot(true);
+        QObject::connect(state.timer, &QTimer::timeout, this, [this, operation]() { onRetryTimeout(operation); });
+    }
+
+    state.attempts++;
+    state.retries++;
+    Metrics::instance()->increment("call.retries." + operation);
+    state.receiver = receiver;
+    state.method = method;
+    int delay = delayFor(state.policy, state.attempts);
+    qCDebug(lcCall) << "Retrying" << operation << "in" << delay << "ms, attempt" << state.attempts;
+    // even immediate retries go through the event loop, so they never recurse
+    state.timer->start(delay);
+    return true;
+}
+
+void RetryScheduler::onRetryTimeout(const QString &operation)
+{
+    OperationState &state = mOperations[operation];
+    if (state.receiver.isNull()) {
+        return;
+    }
+    QMetaObject::invokeMethod(state.receiver.data(), state.method.constData());
+}
+
+void RetryScheduler::cancel(const QString &operation)
+{
+    QHash<QString, OperationState>::iterator it = mOperations.find(operation);
+    if (it == mOperations.end()) {
+        return;
+    }
+    if (it->timer && it->timer->isActive()) {
+        qCDebug(lcCall) << "Cancelling pending retry of" << operation;
+        it->timer->stop();
+    }
+    it->attempts = 0;
+}
+
+void RetryScheduler::cancelAll()
+{
+    Q_FOREACH(const QString &operation, mOperations.keys()) {
+        cancel(operation);
+    }
+}
+
+bool RetryScheduler::isRetryPending(const QString &operation) const
+{
+    QTimer *timer = mOperations.value(operation).timer;
+    return timer && timer->isActive();
+}
+
+int RetryScheduler::attempts(const QString &operation) const
+{
+    return mOperations.value(operation).attempts;
+}
+
+quint64 RetryScheduler::retryCount(const QString &operation) const
+{
+    return mOperations.value(operation).retries;
+}
+
+quint64 RetryScheduler::exhaustedCount(const QString &operation) const
+{
+    return mOperations.value(operation).exhausted;
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RETRYSCHEDULER_H
+#define RETRYSCHEDULER_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+struct RetryPolicy
+{
+    RetryPolicy(int maxRetries = 5, int initialDelay = 250, int maxDelay = 2000, bool retryImmediately = true)
+        : maxRetries(maxRetries), initialDelay(initialDelay), maxDelay(maxDelay), retryImmediately(retryImmediately) {}
+    // retries after the first attempt failed, negative for no limit
+    int maxRetries;
+    // delay before the first delayed retry, doubled on every following one
+    int initialDelay;
+    int maxDelay;
+    // the first retry is done right away, failures are often transient
+    bool retryImmediately;
+};
+
+// Retries failed modem operations (hangup, answer, swapCalls...) following
+// a per operation policy. Operations are identified by name, and there is
+// at most one retry pending per operation.
+class RetryScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RetryScheduler(QObject *parent = 0);
+
+    RetryPolicy policy(const QString &operation) const;
+    void setPolicy(const QString &operation, const RetryPolicy &policy);
+
+    // Invokes the given slot of the receiver once the delay for the next
+    // attempt elapsed. Returns false if the operation ran out of retries.
+    bool retry(const QString &operation, QObject *receiver, const char *method);
+    // the operation succeeded, or is not needed anymore
+    void cancel(const QString &operation);
+    void cancelAll();
+
+    bool isRetryPending(const QString &operation) const;
+    // retries of the current attempt
+    int attempts(const QString &operation) const;
+    // total number of retries and of times the retries were exhausted
+    quint64 retryCount(const QString &operation) const;
+    quint64 exhaustedCount(const QString &operation) const;
+
+Q_SIGNALS:
+    void retriesExhausted(const QString &operation);
+
+private:
+    struct OperationState {
+        OperationState() : timer(0), attempts(0), retries(0), exhausted(0) {}
+        RetryPolicy policy;
+        QTimer *timer;
+        QPointer<QObject> receiver;
+        QByteArray method;
+        int attempts;
+        quint64 retries;
+        quint64 exhausted;
+    };
+
+    int delayFor(const RetryPolicy &policy, int attempt) const;
+    void onRetryTimeout(const QString &operation);
+
+    QHash<QString, OperationState> mOperations;
+};
+
+#endif
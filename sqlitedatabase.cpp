@@ -19,6 +19,11 @@
 #include "phoneutils_p.h"
 #include "sqlite3.h"
 #include "sqlitedatabase.h"
+#include "startupprofiler.h"
+#include "metrics.h"
+#include "stallwatchdog.h"
+#include "tracing.h"
+#include "logging.h"
 #include <QStandardPaths>
 #include <QSqlDriver>
 #include <QSqlQuery>
@@ -30,12 +35,35 @@
 Q_DECLARE_OPAQUE_POINTER(sqlite3*)
 Q_DECLARE_METATYPE(sqlite3*)
 
-// custom sqlite function "comparePhoneNumbers" used to compare IDs if necessary
+static void deletePhoneNumberMatcher(void *matcher)
+{
+    delete static_cast<PhoneNumberMatcher*>(matcher);
+}
+
+// custom sqlite function "comparePhoneNumbers" used to compare IDs if necessary.
+// An optional third argument gives the mcc of the network used to parse the numbers.
+// The second argument is usually a bound parameter, so it is parsed only once and
+// kept as auxiliary data for the whole statement.
 void comparePhoneNumbers(sqlite3_context *context, int argc, sqlite3_value **argv)
 {
-    QString arg1((const char*)sqlite3_value_text(argv[0]));
-    QString arg2((const char*)sqlite3_value_text(argv[1]));
-    sqlite3_result_int(context, (int)PhoneUtils::comparePhoneNumbers(arg1, arg2));
+    QString arg1 = QString::fromUtf8((const char*)sqlite3_value_text(argv[0]), sqlite3_value_bytes(argv[0]));
+    QString mcc;
+    if (argc > 2) {
+        mcc = QString::fromUtf8((const char*)sqlite3_value_text(argv[2]), sqlite3_value_bytes(argv[2]));
+    }
+
+    PhoneNumberMatcher *matcher = static_cast<PhoneNumberMatcher*>(sqlite3_get_auxdata(context, 1));
+    if (matcher && matcher->mcc() == mcc) {
+        sqlite3_result_int(context, (int)matcher->matches(arg1));
+        return;
+    }
+
+    QString arg2 = QString::fromUtf8((const char*)sqlite3_value_text(argv[1]), sqlite3_value_bytes(argv[1]));
+    matcher = new PhoneNumberMatcher(arg2, mcc);
+    sqlite3_result_int(context, (int)matcher->matches(arg1));
+    // sqlite takes ownership of the matcher, and might delete it right away
+    // if the argument is not constant
+    sqlite3_set_auxdata(context, 1, matcher, &deletePhoneNumberMatcher);
 }
 
 SQLiteDatabase::SQLiteDatabase(QObject *parent) :
@@ -59,7 +87,7 @@ bool SQLiteDatabase::initializeDatabase()
 
         QDir dir(mDatabasePath);
         if (!dir.exists("telepathy-ofono") && !dir.mkpath("telepathy-ofono")) {
-            qCritical() << "Failed to create dir";
+            qCCritical(lcDb) << "Failed to create dir";
             return false;
         }
         dir.cd("telepathy-ofono");
@@ -71,8 +99,9 @@ bool SQLiteDatabase::initializeDatabase()
     mDatabase.setDatabaseName(mDatabasePath);
 
     // always run the createDatabase function at least during the development
+    StartupPhase phase("sqlite.schema");
     if (!createOrUpdateDatabase()) {
-        qCritical() << "Failed to create or update the database";
+        qCCritical(lcDb) << "Failed to create or update the database";
         return false;
     }
 
@@ -108,68 +137,87 @@ bool SQLiteDatabase::reopen()
 
     // make sure the database is up-to-date after reopening.
     // this is mainly required for the memory backend used for testing
-    createOrUpdateDatabase();
+    return createOrUpdateDatabase();
 }
 
-bool SQLiteDatabase::createOrUpdateDatabase()
+bool SQLiteDatabase::exec(QSqlQuery &query)
 {
-    bool create = !QFile(mDatabasePath).exists();
+    MetricsTimer timer("sqlite.query");
+    StallScope stallScope("sqlite.query");
+    TraceScope trace("sqlite", "query");
+    return query.exec();
+}
 
+bool SQLiteDatabase::createOrUpdateDatabase()
+{
     if (!mDatabase.open()) {
         return false;
     }
 
     // create the comparePhoneNumbers custom sqlite function
     sqlite3 *handle = database().driver()->handle().value<sqlite3*>();
-    sqlite3_create_function(handle, "comparePhoneNumbers", 2, SQLITE_ANY, NULL, &comparePhoneNumbers, NULL, NULL);
-
-    parseVersionInfo();
+    sqlite3_create_function(handle, "comparePhoneNumbers", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, &comparePhoneNumbers, NULL, NULL);
+    sqlite3_create_function(handle, "comparePhoneNumbers", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, &comparePhoneNumbers, NULL, NULL);
 
-    QSqlQuery query(mDatabase);
+    if (mSchemaVersion == 0) {
+        parseVersionInfo();
+    }
 
-    QStringList statements;
+    // the schema version is kept in the database header (PRAGMA user_version),
+    // so checking an up-to-date database costs a single pragma read and no
+    // access to the schema tables or to the schema files in the resources
+    int currentVersion = userVersion();
+    if (currentVersion == mSchemaVersion) {
+        return true;
+    }
 
-    if (create) {
-         statements = parseSchemaFile(":/database/schema/schema.sql");
-    } else {
-        // if the database already exists, we don´t need to create the tables
-        // only check if an update is needed
-        query.exec("SELECT * FROM schema_version");
-        if (!query.exec() || !query.next()) {
+    // databases created before user_version was used only have the schema_version table
+    if (currentVersion == 0) {
+        currentVersion = legacySchemaVersion();
+        if (currentVersion < 0) {
             return false;
         }
-
-        int upgradeToVersion = query.value(0).toInt() + 1;
-        while (upgradeToVersion <= mSchemaVersion) {
-            statements += parseSchemaFile(QString(":/database/schema/v%1.sql").arg(QString::number(upgradeToVersion)));
-            ++upgradeToVersion;
-        }
     }
 
-    // if at this point needsUpdate is still false, it means the database is up-to-date
-    if (statements.isEmpty()) {
+    if (currentVersion > mSchemaVersion) {
+        qCWarning(lcDb) << "Database schema version" << currentVersion << "is newer than the supported version" << mSchemaVersion;
         return true;
     }
 
+    QSqlQuery query(mDatabase);
+
     beginTransation();
 
-    Q_FOREACH(const QString &statement, statements) {
-        if (!query.exec(statement)) {
-            qCritical() << "Failed to create or update database. SQL Statements:" << query.lastQuery() << "Error:" << query.lastError();
+    if (currentVersion == 0) {
+        if (!execStatements(parseSchemaFile(":/database/schema/schema.sql"))) {
             rollbackTransaction();
             return false;
         }
+    } else {
+        // migrate one version at a time, all inside the same transaction
+        for (int version = currentVersion + 1; version <= mSchemaVersion; ++version) {
+            if (!execStatements(parseSchemaFile(QString(":/database/schema/v%1.sql").arg(QString::number(version))))) {
+                rollbackTransaction();
+                return false;
+            }
+        }
     }
 
-    // now set the new database schema version
+    // keep the schema_version table in sync so that older versions can still read it
     if (!query.exec("DELETE FROM schema_version")) {
-        qCritical() << "Failed to remove previous schema versions. SQL Statement:" << query.lastQuery() << "Error:" << query.lastError();
+        qCCritical(lcDb) << "Failed to remove previous schema versions. SQL Statement:" << query.lastQuery() << "Error:" << query.lastError();
         rollbackTransaction();
         return false;
     }
 
     if (!query.exec(QString("INSERT INTO schema_version VALUES (%1)").arg(mSchemaVersion))) {
-        qCritical() << "Failed to insert new schema version. SQL Statement:" << query.lastQuery() << "Error:" << query.lastError();
+        qCCritical(lcDb) << "Failed to insert new schema version. SQL Statement:" << query.lastQuery() << "Error:" << query.lastError();
+        rollbackTransaction();
+        return false;
+    }
+
+    if (!query.exec(QString("PRAGMA user_version = %1").arg(mSchemaVersion))) {
+        qCCritical(lcDb) << "Failed to set the schema version. SQL Statement:" << query.lastQuery() << "Error:" << query.lastError();
         rollbackTransaction();
         return false;
     }
@@ -179,11 +227,54 @@ bool SQLiteDatabase::createOrUpdateDatabase()
     return true;
 }
 
+int SQLiteDatabase::userVersion()
+{
+    QSqlQuery query(mDatabase);
+    if (!query.exec("PRAGMA user_version") || !query.next()) {
+        return 0;
+    }
+    return query.value(0).toInt();
+}
+
+/// returns the version stored in the schema_version table, 0 if the database
+/// is empty or -1 on failure
+int SQLiteDatabase::legacySchemaVersion()
+{
+    QSqlQuery query(mDatabase);
+    if (!query.exec("SELECT name FROM sqlite_master WHERE type='table' AND name='schema_version'")) {
+        return -1;
+    }
+    if (!query.next()) {
+        return 0;
+    }
+
+    if (!query.exec("SELECT version FROM schema_version") || !query.next()) {
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+bool SQLiteDatabase::execStatements(const QStringList &statements)
+{
+    if (statements.isEmpty()) {
+        return false;
+    }
+
+    QSqlQuery query(mDatabase);
+    Q_FOREACH(const QString &statement, statements) {
+        if (!query.exec(statement)) {
+            qCCritical(lcDb) << "Failed to create or update database. SQL Statements:" << query.lastQuery() << "Error:" << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
 QStringList SQLiteDatabase::parseSchemaFile(const QString &fileName)
 {
     QFile schema(fileName);
     if (!schema.open(QFile::ReadOnly)) {
-        qCritical() << "Failed to open " << fileName;
+        qCCritical(lcDb) << "Failed to open " << fileName;
         return QStringList();
     }
 
@@ -228,8 +319,8 @@ void SQLiteDatabase::parseVersionInfo()
 {
     QFile schema(":/database/schema/version.info");
     if (!schema.open(QFile::ReadOnly)) {
-        qDebug() << schema.error();
-        qCritical() << "Failed to get database version";
+        qCDebug(lcDb) << schema.error();
+        qCCritical(lcDb) << "Failed to get database version";
     }
 
     QString version = schema.readAll();
@@ -21,6 +21,7 @@
 
 #include <QObject>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 
 class SQLiteDatabase : public QObject
 {
@@ -37,8 +38,14 @@ public:
 
     bool reopen();
 
+    // executes a prepared query, recording its latency
+    static bool exec(QSqlQuery &query);
+
 protected:
     bool createOrUpdateDatabase();
+    int userVersion();
+    int legacySchemaVersion();
+    bool execStatements(const QStringList &statements);
     QStringList parseSchemaFile(const QString &fileName);
     void parseVersionInfo();
 
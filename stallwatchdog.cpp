@@ -0,0 +1,197 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+
+#include "stallwatchdog.h"
+#include "metrics.h"
+#include "logging.h"
+
+// the main loop is checked at least this often while a ping is pending (msecs)
+#define MIN_CHECK_INTERVAL 10
+
+StallWatchdog::StallWatchdog(QObject *parent)
+    : QObject(parent),
+      mCheckTimer(0),
+      mThreshold(0),
+      mPingTime(-1),
+      mStallPingTime(-1)
+{
+    if (QCoreApplication::instance()) {
+        moveToThread(QCoreApplication::instance()->thread());
+    }
+}
+
+StallWatchdog *StallWatchdog::instance()
+{
+    static StallWatchdog *self = new StallWatchdog();
+    return self;
+}
+
+int StallWatchdog::defaultThreshold()
+{
+    // the watchdog wakes the device up on every check, so it is opt-in
+    bool ok = false;
+    int threshold = qgetenv("TP_OFONO_STALL_THRESHOLD").toInt(&ok);
+    return ok ? threshold : 0;
+}
+
+void StallWatchdog::start(int thresholdMsecs)
+{
+    if (thresholdMsecs <= 0 || isRunning()) {
+        return;
+    }
+
+    mThreshold = thresholdMsecs;
+    mPingTime.store(-1);
+    mClock.start();
+
+    mCheckTimer = new QTimer();
+    mCheckTimer->setInterval(qMax(thresholdMsecs / 2, MIN_CHECK_INTERVAL));
+    // let the system batch the wakeups with other timers
+    mCheckTimer->setTimerType(Qt::CoarseTimer);
+    mCheckTimer->moveToThread(&mThread);
+    // no context object, so check() runs in the watchdog thread
+    connect(mCheckTimer, &QTimer::timeout, [this]() { check(); });
+    connect(&mThread, SIGNAL(started()), mCheckTimer, SLOT(start()));
+    mThread.start();
+}
+
+void StallWatchdog::stop()
+{
+    if (!isRunning()) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(mCheckTimer, "stop", Qt::BlockingQueuedConnection);
+    mThread.quit();
+    mThread.wait();
+    delete mCheckTimer;
+    mCheckTimer = 0;
+    mPingTime.store(-1);
+}
+
+bool StallWatchdog::isRunning() const
+{
+    return mThread.isRunning();
+}
+
+int StallWatchdog::threshold() const
+{
+    return mThreshold;
+}
+
+QString StallWatchdog::currentOperation() const
+{
+    QMutexLocker locker(&mMutex);
+    return currentOperationLocked();
+}
+
+QString StallWatchdog::currentOperationLocked() const
+{
+    QStringList operations;
+    for (int i = mOperations.size() - 1; i >= 0; i--) {
+        operations << QString::fromLatin1(mOperations[i]);
+    }
+    return operations.join('/');
+}
+
+bool StallWatchdog::enter(const char *operation)
+{
+    if (QThread::currentThread() != thread()) {
+        return false;
+    }
+    QMutexLocker locker(&mMutex);
+    mOperations.append(operation);
+    return true;
+}
+
+void StallWatchdog::leave()
+{
+    QMutexLocker locker(&mMutex);
+    if (!mOperations.isEmpty()) {
+        mOperations.removeLast();
+    }
+}
+
+void StallWatchdog::check()
+{
+    qint64 now = mClock.elapsed();
+    qint64 pingTime = mPingTime.load();
+    if (pingTime < 0) {
+        mPingTime.store(now);
+        QMetaObject::invokeMethod(this, "pong", Qt::QueuedConnection);
+        return;
+    }
+
+    if (now - pingTime < mThreshold) {
+        return;
+    }
+
+    // the main loop is stalled right now, remember what it is busy with
+    QMutexLocker locker(&mMutex);
+    if (mStallPingTime != pingTime || mStallOperation.isEmpty()) {
+        mStallPingTime = pingTime;
+        mStallOperation = currentOperationLocked();
+    }
+}
+
+void StallWatchdog::pong()
+{
+    qint64 pingTime = mPingTime.load();
+    if (pingTime < 0) {
+        return;
+    }
+
+    qint64 age = mClock.elapsed() - pingTime;
+    QString operation;
+    {
+        QMutexLocker locker(&mMutex);
+        if (mStallPingTime == pingTime) {
+            operation = mStallOperation;
+        }
+        mStallPingTime = -1;
+        mStallOperation.clear();
+    }
+    mPingTime.store(-1);
+
+    if (age >= mThreshold) {
+        reportStall(operation, age * 1000);
+    }
+}
+
+void StallWatchdog::reportStall(const QString &operation, qint64 usecs)
+{
+    QString name = operation.isEmpty() ? QString("unknown") : operation;
+    qCWarning(lcWatchdog) << "Main loop stalled for" << usecs / 1000 << "ms in" << name;
+
+    Metrics::instance()->increment("mainloop.stalls");
+    Metrics::instance()->increment("mainloop.stalls." + name.section('/', 0, 0));
+    Metrics::instance()->record("mainloop.stall", usecs);
+    Q_EMIT stalled(name, usecs);
+}
+
+StallScope::StallScope(const char *operation)
+    : mEntered(StallWatchdog::instance()->enter(operation))
+{
+}
+
+StallScope::~StallScope()
+{
+    if (mEntered) {
+        StallWatchdog::instance()->leave();
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+
+// Detects stalls of the main event loop. A separate thread pings the main loop
+// and every ping answered later than the threshold is reported as a stall to
+// the log and to Metrics, along with the operation the main loop was busy with.
+// Operations are tagged with StallScope markers around the known blocking calls.
+class StallWatchdog : public QObject
+{
+    Q_OBJECT
+public:
+    static StallWatchdog *instance();
+    // threshold in TP_OFONO_STALL_THRESHOLD (msecs), disabled when unset or 0
+    static int defaultThreshold();
+
+    // monitors the thread the watchdog lives in, which is the main thread
+    void start(int thresholdMsecs);
+    void stop();
+    bool isRunning() const;
+    int threshold() const;
+
+    // innermost operations first, separated by '/'
+    QString currentOperation() const;
+
+    // used by StallScope, ignored when called from other threads
+    bool enter(const char *operation);
+    void leave();
+
+Q_SIGNALS:
+    // the duration is measured from the ping, so it is a lower bound
+    void stalled(const QString &operation, qint64 usecs);
+
+private Q_SLOTS:
+    void pong();
+
+private:
+    explicit StallWatchdog(QObject *parent = 0);
+    void check();
+    QString currentOperationLocked() const;
+    void reportStall(const QString &operation, qint64 usecs);
+
+    QThread mThread;
+    QTimer *mCheckTimer;
+    QElapsedTimer mClock;
+    int mThreshold;
+    // time of the unanswered ping in msecs, -1 when there is none
+    QAtomicInteger<qint64> mPingTime;
+
+    // protected by mMutex
+    mutable QMutex mMutex;
+    QVector<const char*> mOperations;
+    qint64 mStallPingTime;
+    QString mStallOperation;
+};
+
+// Tags the main loop as busy with the given operation until it goes out of scope
+class StallScope
+{
+public:
+    explicit StallScope(const char *operation);
+    ~StallScope();
+
+private:
+    bool mEntered;
+};
+
+#endif
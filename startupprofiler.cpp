@@ -0,0 +1,136 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <stdio.h>
+
+#include "startupprofiler.h"
+
+StartupProfiler::StartupProfiler()
+    : mFinishedAt(-1)
+{
+    mTimer.start();
+}
+
+StartupProfiler *StartupProfiler::instance()
+{
+    static StartupProfiler *self = new StartupProfiler();
+    return self;
+}
+
+qint64 StartupProfiler::elapsed() const
+{
+    return mTimer.nsecsElapsed() / 1000;
+}
+
+void StartupProfiler::record(const QString &name, qint64 start, qint64 duration)
+{
+    QMutexLocker locker(&mMutex);
+    if (mFinishedAt >= 0) {
+        return;
+    }
+    Phase phase;
+    phase.name = name;
+    phase.start = start;
+    phase.duration = duration;
+    mPhases << phase;
+}
+
+QList<StartupProfiler::Phase> StartupProfiler::phases() const
+{
+    QMutexLocker locker(&mMutex);
+    return mPhases;
+}
+
+bool StartupProfiler::isFinished() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFinishedAt >= 0;
+}
+
+void StartupProfiler::finish()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        if (mFinishedAt >= 0) {
+            return;
+        }
+        mFinishedAt = elapsed();
+    }
+
+    QByteArray path = qgetenv("TP_OFONO_STARTUP_TRACE");
+    if (path.isEmpty()) {
+        return;
+    }
+
+    QByteArray json = toJson();
+    if (path == "-") {
+        fprintf(stderr, "%s\n", json.constData());
+        return;
+    }
+
+    QFile file(QString::fromLocal8Bit(path));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to write the startup trace to" << file.fileName();
+        return;
+    }
+    file.write(json);
+}
+
+QByteArray StartupProfiler::toJson() const
+{
+    QMutexLocker locker(&mMutex);
+    QJsonArray phases;
+    Q_FOREACH(const Phase &phase, mPhases) {
+        QJsonObject object;
+        object["name"] = phase.name;
+        object["start"] = phase.start;
+        object["duration"] = phase.duration;
+        phases << object;
+    }
+
+    QJsonObject trace;
+    trace["pid"] = QCoreApplication::applicationPid();
+    trace["finished"] = mFinishedAt;
+    trace["phases"] = phases;
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+StartupPhase::StartupPhase(const QString &name)
+    : mName(name), mStart(StartupProfiler::instance()->elapsed()), mEnded(false)
+{
+}
+
+StartupPhase::~StartupPhase()
+{
+    end();
+}
+
+void StartupPhase::end()
+{
+    if (mEnded) {
+        return;
+    }
+    mEnded = true;
+    StartupProfiler *profiler = StartupProfiler::instance();
+    profiler->record(mName, mStart, profiler->elapsed() - mStart);
+}
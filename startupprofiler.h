@@ -0,0 +1,75 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+// Records how long each phase of the process startup takes, using monotonic
+// timestamps relative to the creation of the profiler. Once the first
+// connection is connected the phases are dumped as JSON to the file given in
+// TP_OFONO_STARTUP_TRACE ("-" means stderr). Phases can be recorded from any
+// thread.
+class StartupProfiler
+{
+public:
+    struct Phase {
+        Phase() : start(0), duration(0) {}
+        QString name;
+        qint64 start;    // usecs since the profiler was created
+        qint64 duration; // usecs
+    };
+
+    static StartupProfiler *instance();
+
+    // usecs since the profiler was created
+    qint64 elapsed() const;
+    void record(const QString &name, qint64 start, qint64 duration);
+    QList<Phase> phases() const;
+    bool isFinished() const;
+
+    // ends the startup, phases recorded afterwards are ignored
+    void finish();
+    QByteArray toJson() const;
+
+private:
+    StartupProfiler();
+
+    QElapsedTimer mTimer;
+    mutable QMutex mMutex;
+    QList<Phase> mPhases;
+    qint64 mFinishedAt;
+};
+
+// Records the phase between its creation and its destruction, or until end()
+class StartupPhase
+{
+public:
+    explicit StartupPhase(const QString &name);
+    ~StartupPhase();
+    void end();
+
+private:
+    QString mName;
+    qint64 mStart;
+    bool mEnded;
+};
+
+#endif
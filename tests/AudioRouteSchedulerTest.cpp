@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "audioroutescheduler.h"
+
+Q_DECLARE_METATYPE(AudioRouteScheduler::Route)
+
+class AudioRouteSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testSwitchIsImmediate();
+    void testRestoreAfterDelay();
+    void testNewCallCancelsRestore();
+    void testSeveralHangupsRestoreOnce();
+};
+
+void AudioRouteSchedulerTest::initTestCase()
+{
+    qRegisterMetaType<AudioRouteScheduler::Route>();
+}
+
+void AudioRouteSchedulerTest::testSwitchIsImmediate()
+{
+    AudioRouteScheduler scheduler;
+    QSignalSpy spy(&scheduler, SIGNAL(routeChanged(AudioRouteScheduler::Route)));
+
+    scheduler.switchTo(AudioRouteScheduler::RouteRingtone);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first()[0].value<AudioRouteScheduler::Route>(), AudioRouteScheduler::RouteRingtone);
+    QVERIFY(!scheduler.isRestorePending());
+    QCOMPARE(scheduler.restoreRemainingTime(), -1);
+}
+
+void AudioRouteSchedulerTest::testRestoreAfterDelay()
+{
+    AudioRouteScheduler scheduler;
+    QCOMPARE(scheduler.restoreDelay(), 2000);
+    scheduler.setRestoreDelay(50);
+    QSignalSpy spy(&scheduler, SIGNAL(routeChanged(AudioRouteScheduler::Route)));
+
+    scheduler.scheduleRestore();
+    QVERIFY(scheduler.isRestorePending());
+    QVERIFY(scheduler.restoreRemainingTime() <= 50);
+    QCOMPARE(spy.count(), 0);
+
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(spy.first()[0].value<AudioRouteScheduler::Route>(), AudioRouteScheduler::RouteNormal);
+    QVERIFY(!scheduler.isRestorePending());
+}
+
+void AudioRouteSchedulerTest::testNewCallCancelsRestore()
+{
+    AudioRouteScheduler scheduler;
+    scheduler.setRestoreDelay(50);
+    QSignalSpy spy(&scheduler, SIGNAL(routeChanged(AudioRouteScheduler::Route)));
+
+    // call ended, and a new call starts ringing inside the restore window
+    scheduler.scheduleRestore();
+    QElapsedTimer timer;
+    timer.start();
+    scheduler.switchTo(AudioRouteScheduler::RouteRingtone);
+
+    // the ringtone route is applied right away and never torn down
+    QCOMPARE(spy.count(), 1);
+    QVERIFY(timer.elapsed() < scheduler.restoreDelay());
+    QVERIFY(!scheduler.isRestorePending());
+    QTest::qWait(100);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first()[0].value<AudioRouteScheduler::Route>(), AudioRouteScheduler::RouteRingtone);
+}
+
+void AudioRouteSchedulerTest::testSeveralHangupsRestoreOnce()
+{
+    AudioRouteScheduler scheduler;
+    scheduler.setRestoreDelay(50);
+    QSignalSpy spy(&scheduler, SIGNAL(routeChanged(AudioRouteScheduler::Route)));
+
+    scheduler.scheduleRestore();
+    scheduler.scheduleRestore();
+    scheduler.scheduleRestore();
+
+    QTRY_COMPARE(spy.count(), 1);
+    QTest::qWait(100);
+    QCOMPARE(spy.count(), 1);
+}
+
+QTEST_MAIN(AudioRouteSchedulerTest)
+#include "AudioRouteSchedulerTest.moc"
@@ -0,0 +1,299 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "audiorouting.h"
+#include "fakeaudiobackend.h"
+
+class AudioRouterTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testRingingUsesSpeaker();
+    void testActiveCallUsesEarpiece();
+    void testSpeakerToggle();
+    void testMicMute();
+    void testCallEndedRestoresState();
+    void testWiredHeadset();
+    void testBluetoothHeadset();
+    void testBluetoothA2dpHeadset();
+    void testPreparedRoute();
+    void testPreparedRouteInvalidated();
+    void testPlugStorm();
+    void benchmarkRouteDecision();
+    void benchmarkPlugStorm();
+};
+
+void AudioRouterTest::initTestCase()
+{
+    qRegisterMetaType<AudioMode>();
+    qRegisterMetaType<AudioModes>();
+}
+
+void AudioRouterTest::testRingingUsesSpeaker()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+
+    router.setCallMode(CallRinging, AudioModeWiredOrSpeaker);
+    QCOMPARE(router.audioMode(), AudioModeWiredOrSpeaker);
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-speaker+wired_headphone"));
+    QCOMPARE(backend.activeProfile(FAKE_VOICECALL_CARD), std::string("default"));
+    QCOMPARE(backend.batches(), 1);
+}
+
+void AudioRouterTest::testActiveCallUsesEarpiece()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    QSignalSpy modeSpy(&router, SIGNAL(audioModeChanged(AudioMode)));
+    QSignalSpy activatedSpy(&router, SIGNAL(callAudioActivated()));
+
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+    QCOMPARE(router.audioMode(), AudioModeEarpiece);
+    QCOMPARE(router.availableAudioModes(), AudioModes() << AudioModeEarpiece << AudioModeSpeaker);
+    QCOMPARE(backend.activeProfile(FAKE_VOICECALL_CARD), std::string("voicecall"));
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-earpiece"));
+    QCOMPARE(backend.source(FAKE_SOURCE).activePort, std::string("input-builtin_mic"));
+    QCOMPARE(modeSpy.count(), 1);
+    QCOMPARE(activatedSpy.count(), 1);
+
+    // the profile switch and the ports it parks are set in a single batch,
+    // with the profile switch first
+    QCOMPARE(backend.batches(), 1);
+    QCOMPARE(backend.operations().first().type, AudioOperation::SetCardProfile);
+}
+
+void AudioRouterTest::testSpeakerToggle()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+    backend.clearOperations();
+
+    router.setCallMode(CallActive, AudioModeSpeaker);
+    QCOMPARE(router.audioMode(), AudioModeSpeaker);
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-speaker"));
+    QCOMPARE(backend.batches(), 1);
+    Q_FOREACH(const AudioOperation &operation, backend.operations()) {
+        QVERIFY(operation.type != AudioOperation::SetCardProfile);
+    }
+
+    // nothing to change but the mute state
+    backend.clearOperations();
+    router.setCallMode(CallActive, AudioModeSpeaker);
+    QCOMPARE(backend.operations().size(), 1);
+    QCOMPARE(backend.operations().first().type, AudioOperation::SetSourceMute);
+}
+
+void AudioRouterTest::testMicMute()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+
+    // muting before the call is only applied when the call starts
+    router.setMicMute(true);
+    QCOMPARE(backend.batches(), 0);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+    QVERIFY(backend.isSourceMuted(FAKE_SOURCE));
+
+    router.setMicMute(false);
+    QVERIFY(!backend.isSourceMuted(FAKE_SOURCE));
+
+    router.setCallMode(CallActive, AudioModeSpeaker, true);
+    QVERIFY(backend.isSourceMuted(FAKE_SOURCE));
+    QVERIFY(router.micMute());
+}
+
+void AudioRouterTest::testCallEndedRestoresState()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallRinging, AudioModeWiredOrSpeaker);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+    backend.clearOperations();
+
+    router.setCallMode(CallEnded, AudioModeSpeaker);
+    QCOMPARE(router.callStatus(), CallEnded);
+    QCOMPARE(backend.activeProfile(FAKE_VOICECALL_CARD), std::string("default"));
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-speaker"));
+    QCOMPARE(backend.defaultSink(), std::string(FAKE_SINK));
+    QCOMPARE(backend.defaultSource(), std::string(FAKE_SOURCE));
+    QCOMPARE(backend.batches(), 2);
+}
+
+void AudioRouterTest::testWiredHeadset()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+    QSignalSpy modeSpy(&router, SIGNAL(audioModeChanged(AudioMode)));
+    QSignalSpy modesSpy(&router, SIGNAL(availableAudioModesChanged(AudioModes)));
+
+    router.cardChanged(backend.setWiredHeadsetPlugged(true));
+    QCOMPARE(router.audioMode(), AudioModeWiredHeadset);
+    QVERIFY(router.availableAudioModes().contains(AudioModeWiredHeadset));
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-wired_headset"));
+    QCOMPARE(backend.source(FAKE_SOURCE).activePort, std::string("input-wired_headset"));
+    QCOMPARE(modeSpy.count(), 1);
+    QCOMPARE(modesSpy.count(), 1);
+
+    router.cardChanged(backend.setWiredHeadsetPlugged(false));
+    QCOMPARE(router.audioMode(), AudioModeEarpiece);
+    QVERIFY(!router.availableAudioModes().contains(AudioModeWiredHeadset));
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-earpiece"));
+    QCOMPARE(backend.source(FAKE_SOURCE).activePort, std::string("input-builtin_mic"));
+    QCOMPARE(modeSpy.count(), 2);
+    QCOMPARE(modesSpy.count(), 2);
+}
+
+void AudioRouterTest::testBluetoothHeadset()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+
+    router.cardAdded(backend.plugBluetooth(false));
+    QCOMPARE(router.audioMode(), AudioModeBluetooth);
+    QVERIFY(router.availableAudioModes().contains(AudioModeBluetooth));
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-bluetooth_sco"));
+    QCOMPARE(backend.source(FAKE_SOURCE).activePort, std::string("input-bluetooth_sco_headset"));
+    QCOMPARE(backend.activeProfile(FAKE_BLUETOOTH_CARD), std::string("headset_head_unit"));
+
+    backend.unplugBluetooth();
+    router.cardRemoved();
+    QCOMPARE(router.audioMode(), AudioModeEarpiece);
+    QVERIFY(!router.availableAudioModes().contains(AudioModeBluetooth));
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-earpiece"));
+}
+
+void AudioRouterTest::testBluetoothA2dpHeadset()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+
+    // headsets also supporting a2dp are switched to hsp for the call...
+    router.cardAdded(backend.plugBluetooth(true));
+    QCOMPARE(router.audioMode(), AudioModeBluetooth);
+    QCOMPARE(backend.activeProfile(FAKE_BLUETOOTH_CARD), std::string("headset_head_unit"));
+
+    // ...and back to a2dp once it ends
+    router.setCallMode(CallEnded, AudioModeSpeaker);
+    QCOMPARE(backend.activeProfile(FAKE_BLUETOOTH_CARD), std::string("a2dp_sink"));
+}
+
+void AudioRouterTest::testPreparedRoute()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallRinging, AudioModeWiredOrSpeaker);
+    router.prepareCall(AudioModeBtOrWiredOrEarpiece);
+
+    // preparing must not touch the ringing route
+    QCOMPARE(router.audioMode(), AudioModeWiredOrSpeaker);
+    QCOMPARE(router.callStatus(), CallRinging);
+    backend.clearOperations();
+
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+    QCOMPARE(router.preparedRouteHits(), 1);
+    QCOMPARE(router.audioMode(), AudioModeEarpiece);
+    QCOMPARE(backend.activeProfile(FAKE_VOICECALL_CARD), std::string("voicecall"));
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-earpiece"));
+    QCOMPARE(backend.source(FAKE_SOURCE).activePort, std::string("input-builtin_mic"));
+    QCOMPARE(backend.batches(), 1);
+}
+
+void AudioRouterTest::testPreparedRouteInvalidated()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallRinging, AudioModeWiredOrSpeaker);
+    router.prepareCall(AudioModeBtOrWiredOrEarpiece);
+
+    // plugged after the route got prepared, the headset has to be used anyway
+    backend.setWiredHeadsetPlugged(true);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+    QCOMPARE(router.preparedRouteHits(), 0);
+    QCOMPARE(router.audioMode(), AudioModeWiredHeadset);
+    QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-wired_headset"));
+}
+
+void AudioRouterTest::testPlugStorm()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+
+    for (int i = 0; i < 50; i++) {
+        router.cardChanged(backend.setWiredHeadsetPlugged(true));
+        QCOMPARE(router.audioMode(), AudioModeWiredHeadset);
+        QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-wired_headset"));
+
+        router.cardAdded(backend.plugBluetooth(i % 2));
+        QCOMPARE(router.audioMode(), AudioModeBluetooth);
+        QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-bluetooth_sco"));
+
+        router.cardChanged(backend.setWiredHeadsetPlugged(false));
+        QCOMPARE(router.audioMode(), AudioModeBluetooth);
+        QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-bluetooth_sco"));
+
+        backend.unplugBluetooth();
+        router.cardRemoved();
+        QCOMPARE(router.audioMode(), AudioModeEarpiece);
+        QCOMPARE(backend.sink(FAKE_SINK).activePort, std::string("output-earpiece"));
+        QCOMPARE(backend.source(FAKE_SOURCE).activePort, std::string("input-builtin_mic"));
+    }
+
+    QCOMPARE(router.availableAudioModes(), AudioModes() << AudioModeEarpiece << AudioModeSpeaker);
+    QCOMPARE(backend.activeProfile(FAKE_VOICECALL_CARD), std::string("voicecall"));
+}
+
+void AudioRouterTest::benchmarkRouteDecision()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+
+    bool speaker = false;
+    QBENCHMARK {
+        speaker = !speaker;
+        router.setCallMode(CallActive, speaker ? AudioModeSpeaker : AudioModeEarpiece);
+    }
+}
+
+void AudioRouterTest::benchmarkPlugStorm()
+{
+    FakeAudioBackend backend;
+    AudioRouter router(&backend);
+    router.setCallMode(CallActive, AudioModeBtOrWiredOrEarpiece);
+
+    QBENCHMARK {
+        router.cardChanged(backend.setWiredHeadsetPlugged(true));
+        router.cardAdded(backend.plugBluetooth(true));
+        router.cardChanged(backend.setWiredHeadsetPlugged(false));
+        backend.unplugBluetooth();
+        router.cardRemoved();
+    }
+    QCOMPARE(router.audioMode(), AudioModeEarpiece);
+}
+
+QTEST_MAIN(AudioRouterTest)
+#include "AudioRouterTest.moc"
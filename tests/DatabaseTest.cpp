@@ -0,0 +1,144 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+
+#include "sqlitedatabase.h"
+
+class DatabaseTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testCreateDatabase();
+    void testMigrateLegacyDatabase();
+    void testStartupCurrentDatabase();
+    void benchmarkComparePhoneNumbersScan_data();
+    void benchmarkComparePhoneNumbersScan();
+
+private:
+    int schemaVersion();
+    int queryInt(const QString &statement);
+    QTemporaryDir mTempDir;
+};
+
+void DatabaseTest::initTestCase()
+{
+    QVERIFY(mTempDir.isValid());
+    // use a real file: the in-memory database is recreated on every reopen
+    qputenv("TP_OFONO_SQLITE_DBPATH", mTempDir.path().append("/telepathy-ofono.sqlite").toUtf8());
+    QVERIFY(SQLiteDatabase::instance()->database().isOpen());
+}
+
+void DatabaseTest::testCreateDatabase()
+{
+    QCOMPARE(queryInt("PRAGMA user_version"), schemaVersion());
+    QCOMPARE(queryInt("SELECT version FROM schema_version"), schemaVersion());
+    QCOMPARE(queryInt("SELECT count(*) FROM sqlite_master WHERE type='table' AND name='mms_group_members'"), 1);
+}
+
+void DatabaseTest::testMigrateLegacyDatabase()
+{
+    // turn the database into a version 1 database created before user_version was used
+    QSqlQuery query(SQLiteDatabase::instance()->database());
+    QVERIFY(query.exec("DROP TABLE mms_group_members"));
+    QVERIFY(query.exec("DROP TABLE mms_groups"));
+    QVERIFY(query.exec("UPDATE schema_version SET version=1"));
+    QVERIFY(query.exec("PRAGMA user_version = 0"));
+
+    QVERIFY(SQLiteDatabase::instance()->reopen());
+
+    QCOMPARE(queryInt("PRAGMA user_version"), schemaVersion());
+    QCOMPARE(queryInt("SELECT version FROM schema_version"), schemaVersion());
+    QCOMPARE(queryInt("SELECT count(*) FROM sqlite_master WHERE type='table' AND name='mms_group_members'"), 1);
+}
+
+void DatabaseTest::testStartupCurrentDatabase()
+{
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        QVERIFY(SQLiteDatabase::instance()->reopen());
+    }
+    qDebug() << "Opening an up-to-date database took" << timer.nsecsElapsed() / 1000 << "us in total";
+    QCOMPARE(queryInt("PRAGMA user_version"), schemaVersion());
+}
+
+void DatabaseTest::benchmarkComparePhoneNumbersScan_data()
+{
+    QTest::addColumn<int>("rows");
+
+    QTest::newRow("10k rows") << 10000;
+    // filling and scanning 100k rows can take longer than the ctest timeout
+    if (qEnvironmentVariableIsSet("TP_OFONO_LARGE_BENCHMARKS")) {
+        QTest::newRow("100k rows") << 100000;
+    }
+}
+
+void DatabaseTest::benchmarkComparePhoneNumbersScan()
+{
+    QFETCH(int, rows);
+
+    QSqlQuery query(SQLiteDatabase::instance()->database());
+    QVERIFY(SQLiteDatabase::instance()->beginTransation());
+    QVERIFY(query.prepare("INSERT INTO mms_group_members(groupId, memberId) VALUES(:groupId, :memberId)"));
+    for (int i = 0; i < rows; ++i) {
+        // members repeat across groups, as they do in real life
+        query.bindValue(":groupId", QString("mms:%1").arg(i / 4));
+        query.bindValue(":memberId", QString("+1 (555) 2%1").arg(i % 1000, 6, 10, QChar('0')));
+        QVERIFY(query.exec());
+    }
+    QVERIFY(SQLiteDatabase::instance()->finishTransaction());
+
+    int matches = 0;
+    QBENCHMARK {
+        matches = 0;
+        QVERIFY(query.prepare("SELECT groupId FROM mms_group_members WHERE comparePhoneNumbers(memberId, :memberId)"));
+        query.bindValue(":memberId", "5552000042");
+        QVERIFY(query.exec());
+        while (query.next()) {
+            matches++;
+        }
+    }
+    QCOMPARE(matches, rows / 1000);
+
+    QVERIFY(query.exec("DELETE FROM mms_group_members"));
+}
+
+int DatabaseTest::schemaVersion()
+{
+    QFile versionFile(":/database/schema/version.info");
+    if (!versionFile.open(QFile::ReadOnly)) {
+        return -1;
+    }
+    return QString(versionFile.readAll()).trimmed().toInt();
+}
+
+int DatabaseTest::queryInt(const QString &statement)
+{
+    QSqlQuery query(SQLiteDatabase::instance()->database());
+    if (!query.exec(statement) || !query.next()) {
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+QTEST_MAIN(DatabaseTest)
+#include "DatabaseTest.moc"
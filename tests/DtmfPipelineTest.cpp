@@ -0,0 +1,181 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "dtmfpipeline.h"
+#include "metrics.h"
+
+class DtmfPipelineTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testSendRightAway();
+    void testMergeWhileSending();
+    void testSplitLongSequences();
+    void testRetryWithBackoff();
+    void testDropAfterRetries();
+    void testClear();
+    void testIgnoreUnexpectedReplies();
+};
+
+void DtmfPipelineTest::testSendRightAway()
+{
+    DtmfPipeline pipeline;
+    QSignalSpy spy(&pipeline, SIGNAL(sendTones(QString)));
+
+    pipeline.appendTones("1");
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first()[0].toString(), QString("1"));
+    QVERIFY(pipeline.isSending());
+
+    pipeline.onSendTonesComplete(true);
+    QVERIFY(!pipeline.isSending());
+    QVERIFY(pipeline.pendingTones().isEmpty());
+    QCOMPARE(pipeline.statistics().sent, quint64(1));
+    QCOMPARE(pipeline.statistics().requests, quint64(1));
+}
+
+void DtmfPipelineTest::testMergeWhileSending()
+{
+    DtmfPipeline pipeline;
+    QSignalSpy spy(&pipeline, SIGNAL(sendTones(QString)));
+
+    pipeline.appendTones("1");
+    pipeline.appendTones("2");
+    pipeline.appendTones("*");
+    pipeline.appendTones("#");
+    QCOMPARE(spy.count(), 1);
+
+    // everything queued meanwhile goes out in a single request
+    pipeline.onSendTonesComplete(true);
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(spy.last()[0].toString(), QString("2*#"));
+
+    pipeline.onSendTonesComplete(true);
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(pipeline.statistics().sent, quint64(4));
+    QCOMPARE(pipeline.statistics().requests, quint64(2));
+}
+
+void DtmfPipelineTest::testSplitLongSequences()
+{
+    DtmfPipeline pipeline;
+    pipeline.setMaxTones(4);
+    QSignalSpy spy(&pipeline, SIGNAL(sendTones(QString)));
+
+    pipeline.appendTones("0123456789");
+    QCOMPARE(spy.last()[0].toString(), QString("0123"));
+    pipeline.onSendTonesComplete(true);
+    QCOMPARE(spy.last()[0].toString(), QString("4567"));
+    pipeline.onSendTonesComplete(true);
+    QCOMPARE(spy.last()[0].toString(), QString("89"));
+    pipeline.onSendTonesComplete(true);
+    QCOMPARE(spy.count(), 3);
+    QCOMPARE(pipeline.statistics().sent, quint64(10));
+}
+
+void DtmfPipelineTest::testRetryWithBackoff()
+{
+    DtmfPipeline pipeline;
+    pipeline.setRetryDelays(20, 40);
+    QSignalSpy spy(&pipeline, SIGNAL(sendTones(QString)));
+    Metrics::instance()->reset();
+
+    pipeline.appendTones("1");
+    pipeline.onSendTonesComplete(false);
+    QVERIFY(pipeline.isRetryPending());
+    QVERIFY(!pipeline.isSending());
+
+    // tones queued while waiting are merged with the failed ones
+    pipeline.appendTones("2");
+    QCOMPARE(spy.count(), 1);
+    QTRY_COMPARE(spy.count(), 2);
+    QCOMPARE(spy.last()[0].toString(), QString("12"));
+
+    // the delay doubles on consecutive failures, up to the maximum
+    QElapsedTimer timer;
+    timer.start();
+    pipeline.onSendTonesComplete(false);
+    QTRY_COMPARE(spy.count(), 3);
+    // coarse timers may fire slightly early
+    QVERIFY(timer.elapsed() >= 35);
+
+    pipeline.onSendTonesComplete(true);
+    QVERIFY(pipeline.pendingTones().isEmpty());
+    QCOMPARE(pipeline.statistics().retries, quint64(2));
+    QCOMPARE(pipeline.statistics().sent, quint64(2));
+    QVERIFY(pipeline.statistics().maxLatency >= 50);
+    QCOMPARE(Metrics::instance()->samples("dtmf.latency"), quint64(2));
+}
+
+void DtmfPipelineTest::testDropAfterRetries()
+{
+    DtmfPipeline pipeline;
+    pipeline.setRetryDelays(0, 0);
+    pipeline.setMaxRetries(2);
+    pipeline.setMaxTones(2);
+    QSignalSpy sendSpy(&pipeline, SIGNAL(sendTones(QString)));
+    QSignalSpy droppedSpy(&pipeline, SIGNAL(tonesDropped(QString)));
+    Metrics::instance()->reset();
+
+    pipeline.appendTones("123");
+    pipeline.onSendTonesComplete(false);
+    QTRY_COMPARE(sendSpy.count(), 2);
+    pipeline.onSendTonesComplete(false);
+    QTRY_COMPARE(sendSpy.count(), 3);
+    pipeline.onSendTonesComplete(false);
+
+    // the failing tones are given up, and the next ones get sent
+    QCOMPARE(droppedSpy.count(), 1);
+    QCOMPARE(droppedSpy.first()[0].toString(), QString("12"));
+    QCOMPARE(sendSpy.count(), 4);
+    QCOMPARE(sendSpy.last()[0].toString(), QString("3"));
+    QCOMPARE(pipeline.statistics().dropped, quint64(2));
+    QCOMPARE(Metrics::instance()->counter("dtmf.dropped"), quint64(2));
+}
+
+void DtmfPipelineTest::testClear()
+{
+    DtmfPipeline pipeline;
+    pipeline.setRetryDelays(10, 10);
+    QSignalSpy spy(&pipeline, SIGNAL(sendTones(QString)));
+
+    pipeline.appendTones("1");
+    pipeline.onSendTonesComplete(false);
+    pipeline.clear();
+    QVERIFY(!pipeline.isRetryPending());
+    QVERIFY(pipeline.pendingTones().isEmpty());
+    QTest::qWait(30);
+    QCOMPARE(spy.count(), 1);
+}
+
+void DtmfPipelineTest::testIgnoreUnexpectedReplies()
+{
+    DtmfPipeline pipeline;
+    QSignalSpy spy(&pipeline, SIGNAL(sendTones(QString)));
+
+    pipeline.onSendTonesComplete(true);
+    pipeline.onSendTonesComplete(false);
+    QVERIFY(!pipeline.isRetryPending());
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(pipeline.statistics().requests, quint64(0));
+}
+
+QTEST_MAIN(DtmfPipelineTest)
+#include "DtmfPipelineTest.moc"
@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "logging.h"
+
+// mimics the logging done for each incoming message: the message properties
+// and the inspected handles
+static void logIncomingMessage(const QVariantMap &properties, bool useCategory)
+{
+    QStringList identifiers = QStringList() << properties["Sender"].toString();
+    if (useCategory) {
+        qCDebug(lcText) << "onOfonoIncomingMessage" << properties;
+        qCDebug(lcConnection) << "oFonoConnection::inspectHandles contact" << identifiers;
+        qCDebug(lcConnection) << "oFonoConnection::inspectHandles " << identifiers;
+    } else {
+        qDebug() << "onOfonoIncomingMessage" << properties;
+        qDebug() << "oFonoConnection::inspectHandles contact" << identifiers;
+        qDebug() << "oFonoConnection::inspectHandles " << identifiers;
+    }
+}
+
+static void discardMessage(QtMsgType, const QMessageLogContext &, const QString &)
+{
+}
+
+class LoggingTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testDefaultLevels();
+    void benchmarkIncomingMessageLogging_data();
+    void benchmarkIncomingMessageLogging();
+
+private:
+    QVariantMap mProperties;
+};
+
+void LoggingTest::initTestCase()
+{
+    mProperties["Sender"] = "+5511987654321";
+    mProperties["SentTime"] = "2016-01-21T10:00:00-0200";
+    mProperties["LocalSentTime"] = "2016-01-21T10:00:01-0200";
+    mProperties["Text"] = QString("Hello world, this is an incoming message").repeated(3);
+    mProperties["Class"] = "default";
+    mProperties["ReceivedTime"] = QDateTime::currentDateTime();
+}
+
+void LoggingTest::testDefaultLevels()
+{
+    QList<const QLoggingCategory*> categories;
+    categories << &lcConnection() << &lcText() << &lcCall() << &lcMms()
+               << &lcAudio() << &lcDb() << &lcPhoneUtils() << &lcWatchdog();
+    Q_FOREACH(const QLoggingCategory *category, categories) {
+        QVERIFY2(!category->isDebugEnabled(), category->categoryName());
+        QVERIFY2(category->isWarningEnabled(), category->categoryName());
+        QVERIFY2(QByteArray(category->categoryName()).startsWith("telepathy.ofono."), category->categoryName());
+    }
+}
+
+void LoggingTest::benchmarkIncomingMessageLogging_data()
+{
+    QTest::addColumn<bool>("useCategory");
+    QTest::newRow("unconditional qDebug") << false;
+    QTest::newRow("disabled category") << true;
+}
+
+void LoggingTest::benchmarkIncomingMessageLogging()
+{
+    QFETCH(bool, useCategory);
+    // measure the formatting only, not the terminal output
+    qInstallMessageHandler(discardMessage);
+    QBENCHMARK {
+        logIncomingMessage(mProperties, useCategory);
+    }
+    qInstallMessageHandler(0);
+}
+
+QTEST_MAIN(LoggingTest)
+#include "LoggingTest.moc"
@@ -0,0 +1,322 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+#include <functional>
+#include <unistd.h>
+#include <gio/gio.h>
+
+#include "mcp-account-manager-ofono.h"
+
+#define ACCOUNTS_SERVICE_PHONE_IFACE "com.ubuntu.touch.AccountsService.Phone"
+
+// ril properties as seen on a dual sim device
+static int stubPropertyGet(const char *key, char *value, const char *default_value)
+{
+    const char *result = default_value;
+    if (!strcmp(key, "rild.libpath")) {
+        result = "/vendor/lib/libril.so";
+    } else if (!strcmp(key, "ril.num_slots")) {
+        result = "2";
+    }
+    strcpy(value, result ? result : "");
+    return strlen(value);
+}
+
+// the keys looked up in process, in order
+static QStringList queriedProperties;
+
+static int countingPropertyGet(const char *key, char *value, const char *default_value)
+{
+    queriedProperties << key;
+    return stubPropertyGet(key, value, default_value);
+}
+
+static int noRilPropertyGet(const char *key, char *value, const char *default_value)
+{
+    Q_UNUSED(key);
+    strcpy(value, default_value ? default_value : "");
+    return strlen(value);
+}
+
+// the SimNames served by the fake AccountsService
+static QMap<QString, QString> simNames;
+
+static GVariant *accountsServiceGetProperty(GDBusConnection *connection, const gchar *sender,
+                                            const gchar *objectPath, const gchar *interfaceName,
+                                            const gchar *propertyName, GError **error, gpointer userData)
+{
+    Q_UNUSED(connection); Q_UNUSED(sender); Q_UNUSED(objectPath);
+    Q_UNUSED(interfaceName); Q_UNUSED(error); Q_UNUSED(userData);
+    if (strcmp(propertyName, "SimNames")) {
+        return NULL;
+    }
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{ss}"));
+    QMap<QString, QString>::const_iterator it;
+    for (it = simNames.constBegin(); it != simNames.constEnd(); ++it) {
+        g_variant_builder_add(&builder, "{ss}", it.key().toUtf8().constData(), it.value().toUtf8().constData());
+    }
+    return g_variant_builder_end(&builder);
+}
+
+static const GDBusInterfaceVTable accountsServiceVTable = { NULL, accountsServiceGetProperty, NULL };
+
+// values the plugin hands to Mission Control, by "account/key"
+static QMap<QString, QString> storedValues;
+
+static void fakeSetValue(const McpAccountManager *manager, const gchar *account, const gchar *key, const gchar *value)
+{
+    Q_UNUSED(manager);
+    storedValues[QString("%1/%2").arg(account, key)] = QString::fromUtf8(value);
+}
+
+typedef struct { GObject parent; } FakeAccountManager;
+typedef struct { GObjectClass parent_class; } FakeAccountManagerClass;
+
+static void fake_account_manager_iface_init(McpAccountManagerIface *iface)
+{
+    iface->set_value = fakeSetValue;
+}
+
+G_DEFINE_TYPE_WITH_CODE(FakeAccountManager, fake_account_manager, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(MCP_TYPE_ACCOUNT_MANAGER, fake_account_manager_iface_init))
+
+static void fake_account_manager_init(FakeAccountManager *self)
+{
+    Q_UNUSED(self);
+}
+
+static void fake_account_manager_class_init(FakeAccountManagerClass *klass)
+{
+    Q_UNUSED(klass);
+}
+
+static void onAlteredOne(McpAccountStorage *storage, const gchar *account, const gchar *key, gpointer userData)
+{
+    Q_UNUSED(storage);
+    static_cast<QStringList*>(userData)->append(QString("%1/%2").arg(account, key));
+}
+
+static void onNameAcquired(GDBusConnection *connection, const gchar *name, gpointer userData)
+{
+    Q_UNUSED(connection); Q_UNUSED(name);
+    *static_cast<bool*>(userData) = true;
+}
+
+class MCPluginTest : public QObject
+{
+    Q_OBJECT
+public:
+    MCPluginTest() : mBus(0), mServiceConnection(0), mObjectId(0), mNameId(0) {}
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void cleanup();
+    void testAccountsFromProperties();
+    void testNoRil();
+    void testSimNamesApplied();
+    void testDestroyWithPendingSimNames();
+    void testAccountEnumerationDoesNotSpawn();
+    void benchmarkAccountEnumeration();
+
+private:
+    QStringList accounts(McpAccountManagerOfono *plugin);
+    QString value(McpAccountManagerOfono *plugin, const QString &account, const QString &key);
+    bool waitFor(const std::function<bool()> &condition, int timeoutMsecs = 5000);
+
+    GTestDBus *mBus;
+    GDBusConnection *mServiceConnection;
+    guint mObjectId;
+    guint mNameId;
+};
+
+void MCPluginTest::initTestCase()
+{
+    qunsetenv("FORCE_RIL_NUM_MODEMS");
+
+    // the plugin looks up the SimNames on the system bus, so serve a fake
+    // AccountsService on a private bus standing in for it
+    mBus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(mBus);
+    const gchar *address = g_test_dbus_get_bus_address(mBus);
+    qputenv("DBUS_SYSTEM_BUS_ADDRESS", address);
+
+    GError *error = NULL;
+    mServiceConnection = g_dbus_connection_new_for_address_sync(address,
+            (GDBusConnectionFlags)(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                   G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+            NULL, NULL, &error);
+    QVERIFY2(mServiceConnection, error ? error->message : "");
+
+    GDBusNodeInfo *node = g_dbus_node_info_new_for_xml(
+            "<node><interface name='" ACCOUNTS_SERVICE_PHONE_IFACE "'>"
+            "<property name='SimNames' type='a{ss}' access='read'/>"
+            "</interface></node>", NULL);
+    QVERIFY(node);
+    QString path = QString("/org/freedesktop/Accounts/User%1").arg(getuid());
+    mObjectId = g_dbus_connection_register_object(mServiceConnection, path.toUtf8().constData(),
+                                                  node->interfaces[0], &accountsServiceVTable,
+                                                  NULL, NULL, &error);
+    g_dbus_node_info_unref(node);
+    QVERIFY2(mObjectId, error ? error->message : "");
+
+    bool acquired = false;
+    mNameId = g_bus_own_name_on_connection(mServiceConnection, "org.freedesktop.Accounts",
+                                           G_BUS_NAME_OWNER_FLAGS_NONE, onNameAcquired, NULL,
+                                           &acquired, NULL);
+    QVERIFY(waitFor([&]() { return acquired; }));
+}
+
+void MCPluginTest::cleanupTestCase()
+{
+    if (mNameId) {
+        g_bus_unown_name(mNameId);
+    }
+    if (mObjectId) {
+        g_dbus_connection_unregister_object(mServiceConnection, mObjectId);
+    }
+    g_clear_object(&mServiceConnection);
+    if (mBus) {
+        g_test_dbus_down(mBus);
+        g_object_unref(mBus);
+    }
+}
+
+bool MCPluginTest::waitFor(const std::function<bool()> &condition, int timeoutMsecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!condition()) {
+        if (timer.elapsed() > timeoutMsecs) {
+            return false;
+        }
+        // the GDBus callbacks are dispatched from the default GLib context
+        while (g_main_context_iteration(NULL, FALSE));
+        QTest::qWait(10);
+    }
+    return true;
+}
+
+void MCPluginTest::cleanup()
+{
+    mcp_account_manager_ofono_set_property_getter(NULL);
+}
+
+QStringList MCPluginTest::accounts(McpAccountManagerOfono *plugin)
+{
+    McpAccountStorage *storage = MCP_ACCOUNT_STORAGE(plugin);
+    GList *names = MCP_ACCOUNT_STORAGE_GET_IFACE(storage)->list(storage, NULL);
+    QStringList result;
+    for (GList *l = names; l != NULL; l = l->next) {
+        result << QString((const char*)l->data);
+    }
+    g_list_free_full(names, g_free);
+    result.sort();
+    return result;
+}
+
+QString MCPluginTest::value(McpAccountManagerOfono *plugin, const QString &account, const QString &key)
+{
+    McpAccountStorage *storage = MCP_ACCOUNT_STORAGE(plugin);
+    McpAccountManager *manager = MCP_ACCOUNT_MANAGER(g_object_new(fake_account_manager_get_type(), NULL));
+    storedValues.clear();
+    MCP_ACCOUNT_STORAGE_GET_IFACE(storage)->get(storage, manager, account.toUtf8().constData(),
+                                                key.toUtf8().constData());
+    g_object_unref(manager);
+    return storedValues.value(QString("%1/%2").arg(account, key));
+}
+
+void MCPluginTest::testAccountsFromProperties()
+{
+    mcp_account_manager_ofono_set_property_getter(stubPropertyGet);
+    McpAccountManagerOfono *plugin = mcp_account_manager_ofono_new();
+    QCOMPARE(accounts(plugin), QStringList() << "ofono/ofono/account0" << "ofono/ofono/account1");
+    g_object_unref(plugin);
+}
+
+void MCPluginTest::testNoRil()
+{
+    // without a getprop binary there is no fallback to try
+    if (QFile::exists("/usr/bin/getprop")) {
+        QSKIP("getprop is available, the plugin would fall back to it");
+    }
+    mcp_account_manager_ofono_set_property_getter(noRilPropertyGet);
+    McpAccountManagerOfono *plugin = mcp_account_manager_ofono_new();
+    QVERIFY(accounts(plugin).isEmpty());
+    g_object_unref(plugin);
+}
+
+void MCPluginTest::testSimNamesApplied()
+{
+    simNames.clear();
+    simNames["/ril_0"] = "Work";
+    simNames["/ril_1"] = "Home";
+    mcp_account_manager_ofono_set_property_getter(stubPropertyGet);
+    McpAccountManagerOfono *plugin = mcp_account_manager_ofono_new();
+    QStringList altered;
+    g_signal_connect(plugin, "altered-one", G_CALLBACK(onAlteredOne), &altered);
+
+    // the accounts are available before AccountsService answered
+    QCOMPARE(accounts(plugin).size(), 2);
+    QVERIFY(value(plugin, "ofono/ofono/account0", "DisplayName").isEmpty());
+
+    QVERIFY(waitFor([&]() { return altered.size() == 2; }));
+    altered.sort();
+    QCOMPARE(altered, QStringList() << "ofono/ofono/account0/DisplayName" << "ofono/ofono/account1/DisplayName");
+    QCOMPARE(value(plugin, "ofono/ofono/account0", "DisplayName"), QString("Work"));
+    QCOMPARE(value(plugin, "ofono/ofono/account1", "DisplayName"), QString("Home"));
+    g_object_unref(plugin);
+}
+
+void MCPluginTest::testDestroyWithPendingSimNames()
+{
+    mcp_account_manager_ofono_set_property_getter(stubPropertyGet);
+    McpAccountManagerOfono *plugin = mcp_account_manager_ofono_new();
+    g_object_unref(plugin);
+
+    // the SimNames lookup gets cancelled and must not touch the plugin anymore
+    QTest::qWait(100);
+}
+
+void MCPluginTest::testAccountEnumerationDoesNotSpawn()
+{
+    queriedProperties.clear();
+    mcp_account_manager_ofono_set_property_getter(countingPropertyGet);
+    McpAccountManagerOfono *plugin = mcp_account_manager_ofono_new();
+    QStringList names = accounts(plugin);
+    g_object_unref(plugin);
+
+    QCOMPARE(names.size(), 2);
+    // the slot count is only read in process when rild.libpath was found
+    // there, otherwise getprop gets spawned instead
+    QCOMPARE(queriedProperties, QStringList() << "rild.libpath" << "ril.num_slots");
+}
+
+void MCPluginTest::benchmarkAccountEnumeration()
+{
+    mcp_account_manager_ofono_set_property_getter(stubPropertyGet);
+    QBENCHMARK {
+        McpAccountManagerOfono *plugin = mcp_account_manager_ofono_new();
+        accounts(plugin);
+        g_object_unref(plugin);
+    }
+}
+
+QTEST_MAIN(MCPluginTest)
+#include "MCPluginTest.moc"
@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+#include <QtConcurrent>
+
+#include "metrics.h"
+
+class MetricsTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void testCounters();
+    void testHistogramBuckets();
+    void testTimer();
+    void testUpdateRateLimit();
+    void testConcurrentUpdates();
+};
+
+void MetricsTest::init()
+{
+    Metrics::instance()->reset();
+    Metrics::instance()->setUpdateInterval(100);
+}
+
+void MetricsTest::testCounters()
+{
+    Metrics::instance()->increment("sms.in");
+    Metrics::instance()->increment("sms.in");
+    Metrics::instance()->increment("sms.out", 3);
+    QCOMPARE(Metrics::instance()->counter("sms.in"), quint64(2));
+    QCOMPARE(Metrics::instance()->counter("sms.out"), quint64(3));
+    QCOMPARE(Metrics::instance()->counter("mms.in"), quint64(0));
+
+    QVariantMap snapshot = Metrics::instance()->snapshot();
+    QCOMPARE(snapshot["sms.in"].toULongLong(), quint64(2));
+    QCOMPARE(snapshot["sms.out"].toULongLong(), quint64(3));
+    QVERIFY(!snapshot.contains("mms.in"));
+}
+
+void MetricsTest::testHistogramBuckets()
+{
+    Metrics::instance()->record("sqlite.query", 50);
+    Metrics::instance()->record("sqlite.query", 100);
+    Metrics::instance()->record("sqlite.query", 101);
+    Metrics::instance()->record("sqlite.query", 5000000);
+    QCOMPARE(Metrics::instance()->samples("sqlite.query"), quint64(4));
+
+    QVariantMap histogram = Metrics::instance()->snapshot()["sqlite.query"].toMap();
+    QCOMPARE(histogram["count"].toULongLong(), quint64(4));
+    QCOMPARE(histogram["sum"].toLongLong(), qint64(5000251));
+    QCOMPARE(histogram["min"].toLongLong(), qint64(50));
+    QCOMPARE(histogram["max"].toLongLong(), qint64(5000000));
+
+    QVariantList bounds = histogram["bounds"].toList();
+    QVariantList buckets = histogram["buckets"].toList();
+    QCOMPARE(buckets.size(), bounds.size() + 1);
+    // bounds are inclusive and the last bucket takes everything above them
+    QCOMPARE(buckets.first().toULongLong(), quint64(2));
+    QCOMPARE(buckets[1].toULongLong(), quint64(1));
+    QCOMPARE(buckets.last().toULongLong(), quint64(1));
+}
+
+void MetricsTest::testTimer()
+{
+    {
+        MetricsTimer timer("dbus.blocking");
+        QTest::qSleep(10);
+    }
+    QCOMPARE(Metrics::instance()->samples("dbus.blocking"), quint64(1));
+    QVariantMap histogram = Metrics::instance()->snapshot()["dbus.blocking"].toMap();
+    QVERIFY(histogram["min"].toLongLong() >= 10000);
+}
+
+void MetricsTest::testUpdateRateLimit()
+{
+    // let any update scheduled by the previous tests go out first
+    QTest::qWait(200);
+
+    QSignalSpy spy(Metrics::instance(), SIGNAL(updated()));
+    for (int i = 0; i < 1000; i++) {
+        Metrics::instance()->increment("sms.in");
+    }
+    QTRY_COMPARE(spy.count(), 1);
+    QTest::qWait(300);
+    QCOMPARE(spy.count(), 1);
+
+    // changes after an update schedule the next one
+    Metrics::instance()->increment("sms.in");
+    QTRY_COMPARE(spy.count(), 2);
+}
+
+void MetricsTest::testConcurrentUpdates()
+{
+    QList<int> threads;
+    for (int i = 0; i < 8; i++) {
+        threads << i;
+    }
+    QtConcurrent::blockingMap(threads, [](int) {
+        for (int i = 0; i < 1000; i++) {
+            Metrics::instance()->increment("sms.in");
+            Metrics::instance()->record("sqlite.query", i);
+        }
+    });
+    QCOMPARE(Metrics::instance()->counter("sms.in"), quint64(8000));
+    QCOMPARE(Metrics::instance()->samples("sqlite.query"), quint64(8000));
+}
+
+QTEST_MAIN(MetricsTest)
+#include "MetricsTest.moc"
@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "modemrequestscheduler.h"
+
+class ModemRequestSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testPriorityOrder();
+    void testBulkDispatchLimit();
+    void testCallControlAheadOfBulk();
+    void testStatistics();
+};
+
+void ModemRequestSchedulerTest::testPriorityOrder()
+{
+    ModemRequestScheduler scheduler;
+    QStringList order;
+
+    scheduler.submit(ModemRequestScheduler::PriorityBulkMessage, [&]() { order << "bulk"; });
+    scheduler.submit(ModemRequestScheduler::PriorityUssd, [&]() { order << "ussd"; });
+    scheduler.submit(ModemRequestScheduler::PriorityCallControl, [&]() { order << "hangup"; });
+    QVERIFY(order.isEmpty());
+    QCOMPARE(scheduler.queueDepth(), 3);
+
+    QTRY_COMPARE(scheduler.queueDepth(), 0);
+    QCOMPARE(order, QStringList() << "hangup" << "ussd" << "bulk");
+}
+
+void ModemRequestSchedulerTest::testBulkDispatchLimit()
+{
+    ModemRequestScheduler scheduler;
+    QCOMPARE(scheduler.dispatchLimit(ModemRequestScheduler::PriorityBulkMessage), 1);
+    scheduler.setDispatchLimit(ModemRequestScheduler::PriorityBulkMessage, 2);
+    QStringList order;
+
+    for (int i = 0; i < 5; i++) {
+        scheduler.submit(ModemRequestScheduler::PriorityBulkMessage, [&, i]() {
+            order << QString("bulk%1").arg(i);
+            if (i == 0) {
+                scheduler.submit(ModemRequestScheduler::PriorityCallControl, [&]() { order << "answer"; });
+            }
+        });
+    }
+
+    // the answer gets in after the two messages of the first pass
+    QTRY_COMPARE(scheduler.queueDepth(), 0);
+    QCOMPARE(order, QStringList() << "bulk0" << "bulk1" << "answer" << "bulk2" << "bulk3" << "bulk4");
+}
+
+void ModemRequestSchedulerTest::testCallControlAheadOfBulk()
+{
+    ModemRequestScheduler scheduler;
+    QStringList order;
+
+    for (int i = 0; i < 3; i++) {
+        scheduler.submit(ModemRequestScheduler::PriorityBulkMessage, [&, i]() {
+            order << QString("bulk%1").arg(i);
+            // a hangup arriving while the broadcast is being sent
+            if (i == 0) {
+                scheduler.submit(ModemRequestScheduler::PriorityCallControl, [&]() { order << "hangup"; });
+            }
+        });
+    }
+
+    QTRY_COMPARE(scheduler.queueDepth(), 0);
+    QCOMPARE(order, QStringList() << "bulk0" << "hangup" << "bulk1" << "bulk2");
+}
+
+void ModemRequestSchedulerTest::testStatistics()
+{
+    ModemRequestScheduler scheduler;
+
+    for (int i = 0; i < 3; i++) {
+        scheduler.submit(ModemRequestScheduler::PriorityBulkMessage, []() {});
+    }
+    ModemRequestScheduler::Statistics statistics = scheduler.statistics(ModemRequestScheduler::PriorityBulkMessage);
+    QCOMPARE(statistics.queued, 3);
+    QCOMPARE(statistics.maxQueued, 3);
+
+    QTest::qWait(20);
+    QTRY_COMPARE(scheduler.queueDepth(), 0);
+    statistics = scheduler.statistics(ModemRequestScheduler::PriorityBulkMessage);
+    QCOMPARE(statistics.queued, 0);
+    QCOMPARE(statistics.maxQueued, 3);
+    QCOMPARE(statistics.executed, quint64(3));
+    QVERIFY(statistics.maxWait >= statistics.totalWait / 3);
+}
+
+QTEST_MAIN(ModemRequestSchedulerTest)
+#include "ModemRequestSchedulerTest.moc"
@@ -32,6 +32,14 @@ private Q_SLOTS:
     void testIsPhoneNumber();
     void testComparePhoneNumbers_data();
     void testComparePhoneNumbers();
+    void testPhoneNumberMatcher_data();
+    void testPhoneNumberMatcher();
+    void testCountryCodeForMCC_data();
+    void testCountryCodeForMCC();
+    void testNumberingContext();
+    void testNormalizePhoneNumbers();
+    void benchmarkGroupMMSRecipients_data();
+    void benchmarkGroupMMSRecipients();
 };
 
 void PhoneUtilsTest::testIsPhoneNumber_data()
@@ -92,5 +100,162 @@ void PhoneUtilsTest::testComparePhoneNumbers()
     QCOMPARE(result, expectedResult);
 }
 
+void PhoneUtilsTest::testPhoneNumberMatcher_data()
+{
+    testComparePhoneNumbers_data();
+}
+
+void PhoneUtilsTest::testPhoneNumberMatcher()
+{
+    QFETCH(QString, number1);
+    QFETCH(QString, number2);
+    QFETCH(bool, expectedResult);
+
+    PhoneNumberMatcher matcher(number2);
+    QCOMPARE(matcher.matches(number1), expectedResult);
+    // the second time the cached result is used
+    QCOMPARE(matcher.matches(number1), expectedResult);
+}
+
+void PhoneUtilsTest::testCountryCodeForMCC_data()
+{
+    QTest::addColumn<QString>("mcc");
+    QTest::addColumn<bool>("useFallback");
+    QTest::addColumn<QString>("expectedResult");
+
+    QTest::newRow("first entry") << "202" << false << "GR";
+    QTest::newRow("brazil") << "724" << false << "BR";
+    QTest::newRow("last entry") << "750" << false << "FK";
+    QTest::newRow("unknown mcc") << "999" << false << "";
+    QTest::newRow("invalid mcc") << "abc" << false << "";
+    QTest::newRow("empty mcc") << "" << false << "";
+}
+
+void PhoneUtilsTest::testCountryCodeForMCC()
+{
+    QFETCH(QString, mcc);
+    QFETCH(bool, useFallback);
+    QFETCH(QString, expectedResult);
+
+    QCOMPARE(PhoneUtils::countryCodeForMCC(mcc, useFallback), expectedResult);
+}
+
+void PhoneUtilsTest::testNumberingContext()
+{
+    NumberingContext brazil("724");
+    NumberingContext netherlands("204");
+    QCOMPARE(brazil.countryCode(), QString("BR"));
+    QCOMPARE(netherlands.countryCode(), QString("NL"));
+
+    // each context normalizes with its own region and cache
+    QCOMPARE(PhoneUtils::comparePhoneNumbers("12345678", "1234-5678", &brazil), true);
+    QCOMPARE(PhoneUtils::isPhoneNumber("abcdefg", &netherlands), false);
+    QCOMPARE(brazil.statistics().lookups, quint64(2));
+    QCOMPARE(brazil.statistics().hits, quint64(0));
+    QCOMPARE(PhoneUtils::normalizePhoneNumber("1234-5678", &brazil), QString("12345678"));
+    QCOMPARE(brazil.statistics().hits, quint64(1));
+    QCOMPARE(netherlands.statistics().lookups, quint64(1));
+
+    // changing the region drops the cache
+    brazil.setMcc("204");
+    QCOMPARE(brazil.countryCode(), QString("NL"));
+    QCOMPARE(brazil.statistics().regionChanges, quint64(1));
+    PhoneUtils::normalizePhoneNumber("1234-5678", &brazil);
+    QCOMPARE(brazil.statistics().hits, quint64(1));
+}
+
+void PhoneUtilsTest::testNormalizePhoneNumbers()
+{
+    NumberingContext context("310");
+    QStringList numbers;
+    numbers << "+1 (555) 200-0042" << "555 200 0043" << "abcdefg" << "5552000044#12";
+    // big enough to be parsed in parallel
+    for (int i = 0; i < 100; ++i) {
+        numbers << QString("555300%1").arg(i, 4, 10, QChar('0'));
+    }
+
+    NormalizedPhoneNumbers result = PhoneUtils::normalizePhoneNumbers(numbers, &context);
+    QCOMPARE(result.size(), numbers.size());
+    QCOMPARE(result[0].normalized, QString("+15552000042"));
+    QCOMPARE(result[0].key, QString("+15552000042"));
+    QCOMPARE(result[1].normalized, QString("5552000043"));
+    QCOMPARE(result[1].key, QString("+15552000043"));
+    QCOMPARE(result[0].nationalNumber, QString("5552000042"));
+    QVERIFY(result[0].hasCountryCode);
+    QCOMPARE(result[1].nationalNumber, QString("5552000043"));
+    QVERIFY(!result[1].hasCountryCode);
+    QCOMPARE(result[2].isPhoneNumber, false);
+    QCOMPARE(result[2].key, QString("abcdefg"));
+    QVERIFY(result[3].key.startsWith("+15552000044"));
+    for (int i = 0; i < result.size(); ++i) {
+        QCOMPARE(result[i].phoneNumber, numbers[i]);
+        QCOMPARE(result[i].normalized, PhoneUtils::normalizePhoneNumber(numbers[i], &context));
+    }
+
+    result = PhoneUtils::removePhoneNumbers(result, QStringList() << "5552000042" << "+15552000043", &context);
+    QCOMPARE(result.size(), numbers.size() - 2);
+    QCOMPARE(result[0].phoneNumber, QString("abcdefg"));
+
+    // when roaming, our own national number gets the country code of the
+    // visited network, but it still has to be removed
+    NumberingContext roamingContext("262");
+    result = PhoneUtils::normalizePhoneNumbers(QStringList() << "+15552000042" << "+15552000043", &roamingContext);
+    result = PhoneUtils::removePhoneNumbers(result, QStringList() << "5552000042", &roamingContext);
+    QCOMPARE(result.size(), 1);
+    QCOMPARE(result[0].phoneNumber, QString("+15552000043"));
+
+    // our number missing its area code is still a short match
+    result = PhoneUtils::normalizePhoneNumbers(QStringList() << "+15552000042" << "+15552000043", &roamingContext);
+    result = PhoneUtils::removePhoneNumbers(result, QStringList() << "2000042", &roamingContext);
+    QCOMPARE(result.size(), 1);
+    QCOMPARE(result[0].phoneNumber, QString("+15552000043"));
+}
+
+void PhoneUtilsTest::benchmarkGroupMMSRecipients_data()
+{
+    QTest::addColumn<bool>("bulk");
+
+    QTest::newRow("one by one") << false;
+    QTest::newRow("bulk") << true;
+}
+
+void PhoneUtilsTest::benchmarkGroupMMSRecipients()
+{
+    QFETCH(bool, bulk);
+
+    QStringList recipients;
+    for (int i = 0; i < 100; ++i) {
+        recipients << QString("+1 555 300-%1").arg(i, 4, 10, QChar('0'));
+    }
+    QStringList myNumbers;
+    myNumbers << "5553000050";
+
+    QBENCHMARK {
+        // use a new context every time, so nothing is cached between iterations
+        NumberingContext context("310");
+        QSet<QString> normalized;
+        if (bulk) {
+            NormalizedPhoneNumbers numbers = PhoneUtils::normalizePhoneNumbers(recipients, &context);
+            Q_FOREACH(const NormalizedPhoneNumber &number, PhoneUtils::removePhoneNumbers(numbers, myNumbers, &context)) {
+                normalized << number.normalized;
+            }
+        } else {
+            QStringList recipientList = recipients;
+            Q_FOREACH(const QString &myNumber, myNumbers) {
+                Q_FOREACH(const QString &remoteNumber, recipientList) {
+                    if (PhoneUtils::comparePhoneNumbers(remoteNumber, myNumber, &context)) {
+                        recipientList.removeAll(remoteNumber);
+                        break;
+                    }
+                }
+            }
+            Q_FOREACH(const QString &recipient, recipientList) {
+                normalized << PhoneUtils::normalizePhoneNumber(recipient, &context);
+            }
+        }
+        QCOMPARE(normalized.size(), 99);
+    }
+}
+
 QTEST_MAIN(PhoneUtilsTest)
 #include "PhoneUtilsTest.moc"
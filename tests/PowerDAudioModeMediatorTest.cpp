@@ -0,0 +1,95 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "powerd.h"
+#include "powerdaudiomodemediator.h"
+
+class FakePowerD : public PowerD
+{
+public:
+    FakePowerD() : enableCalls(0), disableCalls(0) {}
+    void enableProximityHandling() override { enableCalls++; }
+    void disableProximityHandling() override { disableCalls++; }
+    int enableCalls;
+    int disableCalls;
+};
+
+class PowerDAudioModeMediatorTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testBurstIsCoalesced();
+    void testFlipBackSendsNothing();
+    void testPendingApplyCancelledOnDestruction();
+};
+
+void PowerDAudioModeMediatorTest::testBurstIsCoalesced()
+{
+    FakePowerD powerd;
+    PowerDAudioModeMediator mediator(powerd);
+
+    mediator.audioModeChanged("earpiece");
+    mediator.audioModeChanged("speaker");
+    mediator.audioModeChanged("earpiece");
+    // applied asynchronously
+    QCOMPARE(powerd.enableCalls, 0);
+    QTRY_COMPARE(powerd.enableCalls, 1);
+    QCOMPARE(powerd.disableCalls, 0);
+
+    mediator.audioModeChanged("speaker");
+    mediator.audioModeChanged("earpiece");
+    mediator.audioModeChanged("bluetooth");
+    QTRY_COMPARE(powerd.disableCalls, 1);
+    QCOMPARE(powerd.enableCalls, 1);
+}
+
+void PowerDAudioModeMediatorTest::testFlipBackSendsNothing()
+{
+    FakePowerD powerd;
+    PowerDAudioModeMediator mediator(powerd);
+
+    mediator.audioModeChanged("earpiece");
+    mediator.audioModeChanged("speaker");
+    QTest::qWait(100);
+    QCOMPARE(powerd.enableCalls, 0);
+    QCOMPARE(powerd.disableCalls, 0);
+
+    // same when the output gets closed before the update went out
+    mediator.audioModeChanged("earpiece");
+    mediator.audioOutputClosed();
+    QTest::qWait(100);
+    QCOMPARE(powerd.enableCalls, 0);
+    QCOMPARE(powerd.disableCalls, 0);
+}
+
+void PowerDAudioModeMediatorTest::testPendingApplyCancelledOnDestruction()
+{
+    FakePowerD powerd;
+    PowerDAudioModeMediator *mediator = new PowerDAudioModeMediator(powerd);
+
+    mediator->audioModeChanged("earpiece");
+    delete mediator;
+    QTest::qWait(100);
+    QCOMPARE(powerd.enableCalls, 0);
+    QCOMPARE(powerd.disableCalls, 0);
+}
+
+QTEST_MAIN(PowerDAudioModeMediatorTest)
+#include "PowerDAudioModeMediatorTest.moc"
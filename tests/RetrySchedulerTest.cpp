@@ -0,0 +1,168 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "metrics.h"
+#include "retryscheduler.h"
+
+class Operation : public QObject
+{
+    Q_OBJECT
+public:
+    Operation() : calls(0) {}
+    int calls;
+    QElapsedTimer lastCall;
+public Q_SLOTS:
+    void run() { calls++; lastCall.start(); }
+};
+
+class RetrySchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testFirstRetryIsImmediate();
+    void testExponentialBackoff();
+    void testRetriesExhausted();
+    void testUnlimitedRetries();
+    void testCancel();
+    void testReceiverDestroyed();
+    void testOperationsAreIndependent();
+};
+
+void RetrySchedulerTest::testFirstRetryIsImmediate()
+{
+    RetryScheduler scheduler;
+    Operation operation;
+
+    QVERIFY(scheduler.retry("hangup", &operation, "run"));
+    // never invoked synchronously
+    QCOMPARE(operation.calls, 0);
+    QVERIFY(scheduler.isRetryPending("hangup"));
+    QTRY_COMPARE(operation.calls, 1);
+    QCOMPARE(scheduler.attempts("hangup"), 1);
+    QCOMPARE(scheduler.retryCount("hangup"), quint64(1));
+}
+
+void RetrySchedulerTest::testExponentialBackoff()
+{
+    RetryScheduler scheduler;
+    scheduler.setPolicy("answer", RetryPolicy(5, 20, 50));
+    Operation operation;
+    QElapsedTimer timer;
+
+    // immediate, then 20, 40 and 50ms
+    int expected[] = { 0, 20, 40, 50 };
+    for (int i = 0; i < 4; i++) {
+        timer.start();
+        QVERIFY(scheduler.retry("answer", &operation, "run"));
+        QTRY_COMPARE(operation.calls, i + 1);
+        // coarse timers may fire slightly early
+        QVERIFY(timer.elapsed() >= expected[i] * 9 / 10);
+    }
+    QCOMPARE(scheduler.attempts("answer"), 4);
+}
+
+void RetrySchedulerTest::testRetriesExhausted()
+{
+    RetryScheduler scheduler;
+    scheduler.setPolicy("swapCalls", RetryPolicy(2, 0, 0));
+    Operation operation;
+    QSignalSpy spy(&scheduler, SIGNAL(retriesExhausted(QString)));
+    Metrics::instance()->reset();
+
+    QVERIFY(scheduler.retry("swapCalls", &operation, "run"));
+    QTRY_COMPARE(operation.calls, 1);
+    QVERIFY(scheduler.retry("swapCalls", &operation, "run"));
+    QTRY_COMPARE(operation.calls, 2);
+    QVERIFY(!scheduler.retry("swapCalls", &operation, "run"));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first()[0].toString(), QString("swapCalls"));
+    QCOMPARE(scheduler.exhaustedCount("swapCalls"), quint64(1));
+    QCOMPARE(scheduler.retryCount("swapCalls"), quint64(2));
+    QCOMPARE(Metrics::instance()->counter("call.retries.swapCalls"), quint64(2));
+    QCOMPARE(Metrics::instance()->counter("call.retries_exhausted.swapCalls"), quint64(1));
+
+    // a new failure starts over
+    QVERIFY(scheduler.retry("swapCalls", &operation, "run"));
+    QCOMPARE(scheduler.attempts("swapCalls"), 1);
+}
+
+void RetrySchedulerTest::testUnlimitedRetries()
+{
+    RetryScheduler scheduler;
+    scheduler.setPolicy("hangup", RetryPolicy(-1, 0, 0));
+    Operation operation;
+    QSignalSpy spy(&scheduler, SIGNAL(retriesExhausted(QString)));
+
+    for (int i = 0; i < 20; i++) {
+        QVERIFY(scheduler.retry("hangup", &operation, "run"));
+        QTRY_COMPARE(operation.calls, i + 1);
+    }
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(scheduler.exhaustedCount("hangup"), quint64(0));
+    QCOMPARE(scheduler.attempts("hangup"), 20);
+}
+
+void RetrySchedulerTest::testCancel()
+{
+    RetryScheduler scheduler;
+    scheduler.setPolicy("answer", RetryPolicy(5, 10, 10, false));
+    Operation operation;
+
+    QVERIFY(scheduler.retry("answer", &operation, "run"));
+    scheduler.cancel("answer");
+    QVERIFY(!scheduler.isRetryPending("answer"));
+    QCOMPARE(scheduler.attempts("answer"), 0);
+
+    QVERIFY(scheduler.retry("answer", &operation, "run"));
+    scheduler.cancelAll();
+    QTest::qWait(30);
+    QCOMPARE(operation.calls, 0);
+    QCOMPARE(scheduler.retryCount("answer"), quint64(2));
+}
+
+void RetrySchedulerTest::testReceiverDestroyed()
+{
+    RetryScheduler scheduler;
+    Operation *operation = new Operation;
+
+    QVERIFY(scheduler.retry("hangup", operation, "run"));
+    delete operation;
+    QTest::qWait(10);
+    QVERIFY(!scheduler.isRetryPending("hangup"));
+}
+
+void RetrySchedulerTest::testOperationsAreIndependent()
+{
+    RetryScheduler scheduler;
+    scheduler.setPolicy("hangup", RetryPolicy(1));
+    Operation hangup;
+    Operation answer;
+
+    QVERIFY(scheduler.retry("hangup", &hangup, "run"));
+    QVERIFY(scheduler.retry("answer", &answer, "run"));
+    scheduler.cancel("hangup");
+    QTRY_COMPARE(answer.calls, 1);
+    QCOMPARE(hangup.calls, 0);
+    QCOMPARE(scheduler.policy("hangup").maxRetries, 1);
+    QCOMPARE(scheduler.policy("answer").maxRetries, 5);
+}
+
+QTEST_MAIN(RetrySchedulerTest)
+#include "RetrySchedulerTest.moc"
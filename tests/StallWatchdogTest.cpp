@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+#include <QtConcurrent>
+
+#include "stallwatchdog.h"
+#include "metrics.h"
+
+class StallWatchdogTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testOperations();
+    void testOperationsFromOtherThreads();
+    void testStallDetected();
+    void testStop();
+};
+
+void StallWatchdogTest::initTestCase()
+{
+    StallWatchdog::instance()->start(50);
+    QVERIFY(StallWatchdog::instance()->isRunning());
+    QCOMPARE(StallWatchdog::instance()->threshold(), 50);
+}
+
+void StallWatchdogTest::cleanupTestCase()
+{
+    StallWatchdog::instance()->stop();
+}
+
+void StallWatchdogTest::testOperations()
+{
+    QCOMPARE(StallWatchdog::instance()->currentOperation(), QString());
+    {
+        StallScope outer("mmsd.GetMessages");
+        QCOMPARE(StallWatchdog::instance()->currentOperation(), QString("mmsd.GetMessages"));
+        {
+            StallScope inner("sqlite.query");
+            QCOMPARE(StallWatchdog::instance()->currentOperation(), QString("sqlite.query/mmsd.GetMessages"));
+        }
+        QCOMPARE(StallWatchdog::instance()->currentOperation(), QString("mmsd.GetMessages"));
+    }
+    QCOMPARE(StallWatchdog::instance()->currentOperation(), QString());
+}
+
+void StallWatchdogTest::testOperationsFromOtherThreads()
+{
+    // only the main loop is monitored
+    QString operation = QtConcurrent::run([]() {
+        StallScope scope("sqlite.query");
+        return StallWatchdog::instance()->currentOperation();
+    }).result();
+    QCOMPARE(operation, QString());
+}
+
+void StallWatchdogTest::testStallDetected()
+{
+    Metrics::instance()->reset();
+    QSignalSpy spy(StallWatchdog::instance(), SIGNAL(stalled(QString,qint64)));
+    {
+        StallScope scope("call.closeDelay");
+        QTest::qSleep(400);
+    }
+    QTRY_VERIFY(spy.count() > 0);
+
+    QCOMPARE(spy.first()[0].toString(), QString("call.closeDelay"));
+    // the ping is sent at most one check interval after the stall started
+    QVERIFY(spy.first()[1].toLongLong() >= 350000);
+    QVERIFY(Metrics::instance()->counter("mainloop.stalls") > 0);
+    QVERIFY(Metrics::instance()->counter("mainloop.stalls.call.closeDelay") > 0);
+    QVERIFY(Metrics::instance()->samples("mainloop.stall") > 0);
+}
+
+void StallWatchdogTest::testStop()
+{
+    StallWatchdog::instance()->stop();
+    QVERIFY(!StallWatchdog::instance()->isRunning());
+
+    QSignalSpy spy(StallWatchdog::instance(), SIGNAL(stalled(QString,qint64)));
+    QTest::qSleep(200);
+    QTest::qWait(100);
+    QCOMPARE(spy.count(), 0);
+
+    StallWatchdog::instance()->start(50);
+    QVERIFY(StallWatchdog::instance()->isRunning());
+}
+
+QTEST_MAIN(StallWatchdogTest)
+#include "StallWatchdogTest.moc"
@@ -0,0 +1,105 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "telepathyhelper.h"
+
+// maximum time in ms for each startup step, can be overridden with TP_OFONO_STARTUP_THRESHOLD
+#define DEFAULT_STARTUP_THRESHOLD 1000
+
+class StartupTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testConnectionManagerStartup();
+    void testConnectionStartup();
+
+private:
+    qint64 phaseDuration(const QString &name);
+    qint64 mThreshold;
+    QJsonObject mTrace;
+};
+
+void StartupTest::initTestCase()
+{
+    QString tracePath = qgetenv("TP_OFONO_STARTUP_TRACE");
+    QVERIFY(!tracePath.isEmpty());
+
+    bool ok = false;
+    mThreshold = qgetenv("TP_OFONO_STARTUP_THRESHOLD").toLongLong(&ok);
+    if (!ok) {
+        mThreshold = DEFAULT_STARTUP_THRESHOLD;
+    }
+
+    TelepathyHelper::instance();
+    QSignalSpy spy(TelepathyHelper::instance(),
+                   SIGNAL(accountReady()));
+    QTRY_COMPARE(spy.count(), 1);
+    QTRY_VERIFY(TelepathyHelper::instance()->account()->connectionStatus() == Tp::ConnectionStatusConnected);
+
+    // the trace is written once the connection is connected, make sure it
+    // comes from the running telepathy-ofono and not from a previous run
+    QFile file(tracePath);
+    QTRY_VERIFY(file.exists());
+    QTRY_VERIFY(file.size() > 0);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll());
+    QVERIFY(document.isObject());
+    mTrace = document.object();
+    QVERIFY(QFile::exists(QString("/proc/%1").arg(mTrace["pid"].toVariant().toLongLong())));
+}
+
+qint64 StartupTest::phaseDuration(const QString &name)
+{
+    Q_FOREACH(const QJsonValue &value, mTrace["phases"].toArray()) {
+        QJsonObject phase = value.toObject();
+        if (phase["name"].toString() == name) {
+            return phase["duration"].toVariant().toLongLong() / 1000;
+        }
+    }
+    return -1;
+}
+
+void StartupTest::testConnectionManagerStartup()
+{
+    // from main() to the connection manager being registered on the bus
+    qint64 duration = 0;
+    Q_FOREACH(const QString &name, QStringList() << "main.registerTypes" << "main.protocol" << "main.connectionManager") {
+        qint64 phase = phaseDuration(name);
+        QVERIFY2(phase >= 0, qPrintable(name));
+        duration += phase;
+    }
+    qDebug() << "connection manager startup took" << duration << "ms";
+    QVERIFY2(duration < mThreshold, qPrintable(QString("%1ms > %2ms").arg(duration).arg(mThreshold)));
+}
+
+void StartupTest::testConnectionStartup()
+{
+    // from the connection creation to its connected status
+    qint64 duration = phaseDuration("connection");
+    QVERIFY(duration >= 0);
+    qDebug() << "connection startup took" << duration << "ms";
+    QVERIFY2(duration < mThreshold, qPrintable(QString("%1ms > %2ms").arg(duration).arg(mThreshold)));
+}
+
+QTEST_MAIN(StartupTest)
+#include "StartupTest.moc"
@@ -0,0 +1,148 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+#include <QtConcurrent>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+
+#include "tracing.h"
+
+static QJsonArray traceEvents()
+{
+    QJsonDocument document = QJsonDocument::fromJson(Tracer::instance()->toJson());
+    return document.object()["traceEvents"].toArray();
+}
+
+class TracingTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void cleanup();
+    void testDisabled();
+    void testScope();
+    void testFlow();
+    void testRingBuffer();
+    void testConcurrentEvents();
+    void testFlush();
+};
+
+void TracingTest::cleanup()
+{
+    Tracer::instance()->setEnabled(false);
+    Tracer::instance()->setOutput(QString());
+}
+
+void TracingTest::testDisabled()
+{
+    QVERIFY(!Tracer::instance()->isEnabled());
+    {
+        TraceScope trace("text", "ensureTextChannel");
+        Tracer::instance()->flow('s', "text", "message", "+1234567");
+    }
+    QCOMPARE(Tracer::instance()->size(), 0);
+    QVERIFY(!Tracer::instance()->flush());
+}
+
+void TracingTest::testScope()
+{
+    Tracer::instance()->setEnabled(true, 10);
+    {
+        TraceScope trace("sqlite", "query");
+        QTest::qSleep(5);
+    }
+    QCOMPARE(Tracer::instance()->size(), 1);
+
+    QJsonObject event = traceEvents().first().toObject();
+    QCOMPARE(event["name"].toString(), QString("query"));
+    QCOMPARE(event["cat"].toString(), QString("sqlite"));
+    QCOMPARE(event["ph"].toString(), QString("X"));
+    QVERIFY(event["dur"].toDouble() >= 5000);
+    QCOMPARE(qint64(event["pid"].toDouble()), QCoreApplication::applicationPid());
+}
+
+void TracingTest::testFlow()
+{
+    Tracer::instance()->setEnabled(true, 10);
+    Tracer::instance()->flow('s', "call", "call", "/ril_0/voicecall01");
+    Tracer::instance()->flow('f', "call", "call", "/ril_0/voicecall01");
+    Tracer::instance()->flow('s', "call", "call", "/ril_0/voicecall02");
+
+    QJsonArray events = traceEvents();
+    QCOMPARE(events.size(), 3);
+    QCOMPARE(events[0].toObject()["ph"].toString(), QString("s"));
+    QCOMPARE(events[1].toObject()["ph"].toString(), QString("f"));
+    QCOMPARE(events[1].toObject()["bp"].toString(), QString("e"));
+    QCOMPARE(events[0].toObject()["id"], events[1].toObject()["id"]);
+    QVERIFY(events[0].toObject()["id"] != events[2].toObject()["id"]);
+}
+
+void TracingTest::testRingBuffer()
+{
+    Tracer::instance()->setEnabled(true, 4);
+    const char *names[] = { "a", "b", "c", "d", "e", "f" };
+    for (int i = 0; i < 6; i++) {
+        TraceScope trace("test", names[i]);
+    }
+    QCOMPARE(Tracer::instance()->size(), 4);
+
+    // only the latest events are kept, oldest first
+    QJsonArray events = traceEvents();
+    QCOMPARE(events.size(), 4);
+    QCOMPARE(events.first().toObject()["name"].toString(), QString("c"));
+    QCOMPARE(events.last().toObject()["name"].toString(), QString("f"));
+}
+
+void TracingTest::testConcurrentEvents()
+{
+    Tracer::instance()->setEnabled(true, 100000);
+    QList<int> threads;
+    for (int i = 0; i < 8; i++) {
+        threads << i;
+    }
+    QtConcurrent::blockingMap(threads, [](int) {
+        for (int i = 0; i < 1000; i++) {
+            TraceScope trace("audio", "applyRouteTarget");
+        }
+    });
+    QCOMPARE(Tracer::instance()->size(), 8000);
+}
+
+void TracingTest::testFlush()
+{
+    QTemporaryDir dir;
+    QString path = dir.path() + "/trace.json";
+    Tracer::instance()->setEnabled(true, 10);
+    Tracer::instance()->setOutput(path);
+    {
+        TraceScope trace("text", "messageReceived");
+    }
+    QVERIFY(Tracer::instance()->flush());
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll());
+    QCOMPARE(document.object()["traceEvents"].toArray().size(), 1);
+    // the buffer is kept after flushing
+    QCOMPARE(Tracer::instance()->size(), 1);
+}
+
+QTEST_MAIN(TracingTest)
+#include "TracingTest.moc"
@@ -0,0 +1,292 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QThread>
+
+#include "fakeaudiobackend.h"
+
+static AudioPort port(const std::string &name, int available = AudioPortAvailableUnknown)
+{
+    AudioPort port;
+    port.name = name;
+    port.available = available;
+    return port;
+}
+
+static AudioProfile profile(const std::string &name, uint32_t priority)
+{
+    AudioProfile profile;
+    profile.name = name;
+    profile.priority = priority;
+    profile.available = 1;
+    return profile;
+}
+
+FakeAudioBackend::FakeAudioBackend()
+    : mDefaultSink(FAKE_SINK),
+      mDefaultSource(FAKE_SOURCE),
+      mNextIndex(0),
+      mGeneration(0),
+      mLatency(0),
+      mBatches(0)
+{
+    AudioCard card;
+    card.index = mNextIndex++;
+    card.name = FAKE_VOICECALL_CARD;
+    card.profiles << profile("default", 100) << profile("voicecall", 50);
+    card.ports << port("output-earpiece") << port("output-speaker")
+               << port("output-wired_headset", AudioPortAvailableNo)
+               << port("output-wired_headphone", AudioPortAvailableNo)
+               << port("input-builtin_mic")
+               << port("input-wired_headset", AudioPortAvailableNo);
+    mCards[card.index] = card;
+    mActiveProfiles[card.name] = "default";
+
+    AudioDevice sink;
+    sink.index = mNextIndex++;
+    sink.name = FAKE_SINK;
+    sink.isMonitor = false;
+    sink.activePort = "output-speaker";
+    sink.ports << port("output-earpiece") << port("output-speaker")
+               << port("output-wired_headset", AudioPortAvailableNo)
+               << port("output-wired_headphone", AudioPortAvailableNo)
+               << port("output-speaker+wired_headphone", AudioPortAvailableNo)
+               << port("output-bluetooth_sco");
+    mSinks[sink.index] = sink;
+
+    AudioDevice monitor;
+    monitor.index = mNextIndex++;
+    monitor.name = FAKE_SINK ".monitor";
+    monitor.isMonitor = true;
+    mSources[monitor.index] = monitor;
+
+    AudioDevice source;
+    source.index = mNextIndex++;
+    source.name = FAKE_SOURCE;
+    source.isMonitor = false;
+    source.activePort = "input-builtin_mic";
+    source.ports << port("input-builtin_mic")
+                 << port("input-wired_headset", AudioPortAvailableNo)
+                 << port("input-bluetooth_sco_headset");
+    mSources[source.index] = source;
+}
+
+void FakeAudioBackend::setLatency(int usecs)
+{
+    mLatency = usecs;
+}
+
+void FakeAudioBackend::setPortAvailable(QList<AudioPort> &ports, const std::string &name, int available)
+{
+    for (int i = 0; i < ports.size(); i++) {
+        if (ports[i].name == name) {
+            ports[i].available = available;
+        }
+    }
+}
+
+void FakeAudioBackend::setActivePort(QMap<uint32_t, AudioDevice> &devices, const std::string &name, const std::string &port)
+{
+    QMap<uint32_t, AudioDevice>::iterator it;
+    for (it = devices.begin(); it != devices.end(); ++it) {
+        if (it->name == name) {
+            it->activePort = port;
+        }
+    }
+}
+
+AudioCard FakeAudioBackend::setWiredHeadsetPlugged(bool plugged)
+{
+    int available = plugged ? AudioPortAvailableYes : AudioPortAvailableNo;
+    QMap<uint32_t, AudioCard>::iterator it;
+    for (it = mCards.begin(); it != mCards.end(); ++it) {
+        setPortAvailable(it->ports, "output-wired_headset", available);
+        setPortAvailable(it->ports, "input-wired_headset", available);
+    }
+    QMap<uint32_t, AudioDevice>::iterator device;
+    for (device = mSinks.begin(); device != mSinks.end(); ++device) {
+        setPortAvailable(device->ports, "output-wired_headset", available);
+    }
+    for (device = mSources.begin(); device != mSources.end(); ++device) {
+        setPortAvailable(device->ports, "input-wired_headset", available);
+    }
+    mGeneration++;
+    return card(FAKE_VOICECALL_CARD);
+}
+
+AudioCard FakeAudioBackend::plugBluetooth(bool a2dp)
+{
+    unplugBluetooth();
+
+    AudioCard card;
+    card.index = mNextIndex++;
+    card.name = FAKE_BLUETOOTH_CARD;
+    card.profiles << profile("headset_head_unit", 20);
+    if (a2dp) {
+        card.profiles << profile("a2dp_sink", 40);
+    }
+    card.profiles << profile("off", 0);
+    mCards[card.index] = card;
+    mActiveProfiles[card.name] = a2dp ? "a2dp_sink" : "headset_head_unit";
+    mGeneration++;
+    return card;
+}
+
+void FakeAudioBackend::unplugBluetooth()
+{
+    Q_FOREACH(const AudioCard &card, mCards) {
+        if (card.name == FAKE_BLUETOOTH_CARD) {
+            mCards.remove(card.index);
+            mActiveProfiles.remove(card.name);
+            mGeneration++;
+        }
+    }
+}
+
+AudioCard FakeAudioBackend::card(const std::string &name) const
+{
+    Q_FOREACH(const AudioCard &card, mCards) {
+        if (card.name == name) {
+            return card;
+        }
+    }
+    return AudioCard();
+}
+
+AudioDevice FakeAudioBackend::sink(const std::string &name) const
+{
+    Q_FOREACH(const AudioDevice &sink, mSinks) {
+        if (sink.name == name) {
+            return sink;
+        }
+    }
+    return AudioDevice();
+}
+
+AudioDevice FakeAudioBackend::source(const std::string &name) const
+{
+    Q_FOREACH(const AudioDevice &source, mSources) {
+        if (source.name == name) {
+            return source;
+        }
+    }
+    return AudioDevice();
+}
+
+std::string FakeAudioBackend::activeProfile(const std::string &card) const
+{
+    return mActiveProfiles.value(card);
+}
+
+bool FakeAudioBackend::isSourceMuted(const std::string &source) const
+{
+    return mMuted.value(source, false);
+}
+
+int FakeAudioBackend::batches() const
+{
+    return mBatches;
+}
+
+AudioOperations FakeAudioBackend::operations() const
+{
+    return mOperations;
+}
+
+void FakeAudioBackend::clearOperations()
+{
+    mOperations.clear();
+    mBatches = 0;
+}
+
+QList<AudioCard> FakeAudioBackend::cards()
+{
+    return mCards.values();
+}
+
+QList<AudioDevice> FakeAudioBackend::sinks()
+{
+    return mSinks.values();
+}
+
+QList<AudioDevice> FakeAudioBackend::sources()
+{
+    return mSources.values();
+}
+
+std::string FakeAudioBackend::defaultSink()
+{
+    return mDefaultSink;
+}
+
+std::string FakeAudioBackend::defaultSource()
+{
+    return mDefaultSource;
+}
+
+quint64 FakeAudioBackend::generation()
+{
+    return mGeneration;
+}
+
+bool FakeAudioBackend::sync()
+{
+    return true;
+}
+
+bool FakeAudioBackend::apply(const AudioOperations &operations)
+{
+    if (operations.isEmpty()) {
+        return true;
+    }
+
+    // a batch costs a single round trip
+    mBatches++;
+    mOperations << operations;
+    if (mLatency > 0) {
+        QThread::usleep(mLatency);
+    }
+
+    Q_FOREACH(const AudioOperation &operation, operations) {
+        switch (operation.type) {
+        case AudioOperation::SetCardProfile:
+            mActiveProfiles[operation.object] = operation.value;
+            if (operation.object == FAKE_VOICECALL_CARD) {
+                // like droid, switching profiles parks the ports
+                setActivePort(mSinks, FAKE_SINK, "output-parking");
+                setActivePort(mSources, FAKE_SOURCE, "input-parking");
+                mGeneration++;
+            }
+            break;
+        case AudioOperation::SetDefaultSink:
+            mDefaultSink = operation.object;
+            break;
+        case AudioOperation::SetDefaultSource:
+            mDefaultSource = operation.object;
+            break;
+        case AudioOperation::SetSinkPort:
+            setActivePort(mSinks, operation.object, operation.value);
+            break;
+        case AudioOperation::SetSourcePort:
+            setActivePort(mSources, operation.object, operation.value);
+            break;
+        case AudioOperation::SetSourceMute:
+            mMuted[operation.object] = operation.mute;
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAKEAUDIOBACKEND_H
+#define FAKEAUDIOBACKEND_H
+
+#include <QtCore/QMap>
+
+#include "audiorouting.h"
+
+#define FAKE_VOICECALL_CARD "droid_card.primary"
+#define FAKE_BLUETOOTH_CARD "bluez_card.00_11_22_33_44_55"
+#define FAKE_SINK "sink.primary"
+#define FAKE_SOURCE "source.primary"
+
+// In-process AudioBackend simulating a droid based phone: a voice call
+// capable card with earpiece, speaker and wired headset ports, plus an
+// optional bluetooth headset. Operations are applied to the simulated
+// objects, and each batch of operations takes the configured latency.
+class FakeAudioBackend : public AudioBackend
+{
+public:
+    FakeAudioBackend();
+
+    void setLatency(int usecs);
+
+    // the returned card is the one a card event would carry
+    AudioCard setWiredHeadsetPlugged(bool plugged);
+    AudioCard plugBluetooth(bool a2dp);
+    void unplugBluetooth();
+
+    AudioCard card(const std::string &name) const;
+    AudioDevice sink(const std::string &name) const;
+    AudioDevice source(const std::string &name) const;
+    std::string activeProfile(const std::string &card) const;
+    bool isSourceMuted(const std::string &source) const;
+
+    int batches() const;
+    AudioOperations operations() const;
+    void clearOperations();
+
+    QList<AudioCard> cards() override;
+    QList<AudioDevice> sinks() override;
+    QList<AudioDevice> sources() override;
+    std::string defaultSink() override;
+    std::string defaultSource() override;
+    quint64 generation() override;
+    bool sync() override;
+    bool apply(const AudioOperations &operations) override;
+
+private:
+    void setPortAvailable(QList<AudioPort> &ports, const std::string &name, int available);
+    void setActivePort(QMap<uint32_t, AudioDevice> &devices, const std::string &name, const std::string &port);
+
+    QMap<uint32_t, AudioCard> mCards;
+    QMap<uint32_t, AudioDevice> mSinks;
+    QMap<uint32_t, AudioDevice> mSources;
+    QMap<std::string, std::string> mActiveProfiles;
+    QMap<std::string, bool> mMuted;
+    std::string mDefaultSink;
+    std::string mDefaultSource;
+    uint32_t mNextIndex;
+    quint64 mGeneration;
+    int mLatency;
+    int mBatches;
+    AudioOperations mOperations;
+};
+
+#endif
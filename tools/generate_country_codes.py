@@ -1,23 +1,72 @@
 # originally available at https://github.com/musalbas/mcc-mnc-table/blob/master/get-mcc-mnc-table-csv.py
+#
+# Usage:
+#   generate_country_codes.py > countrycodes.txt
+#       fetch the MCC table from mcc-mnc.com and print it as <mcc>:<region> lines
+#   generate_country_codes.py --header countrycodes.h countrycodes.txt
+#       generate the C++ lookup table used by PhoneUtils from countrycodes.txt
 import re
-import urllib2
-
-html = urllib2.urlopen('http://mcc-mnc.com/').read()
-td_re = re.compile('<td>([^<]*)</td>'*6)
-codes = {}
-tbody_start = False
-for line in html.split('\n'):
-    if '<tbody>' in line:
-        tbody_start = True
-    elif '</tbody>' in line:
-        break
-    elif tbody_start:
-        td_search = td_re.search(line)
-        mcc = int(td_search.group(1))
-        isoCountryCode = td_search.group(3).upper()
-        if (len(isoCountryCode) != 2):
-            continue
-        codes[mcc] = isoCountryCode
-
-for mcc in codes:
-    print str(mcc) + ":" + codes[mcc]
+import sys
+
+
+def fetch_codes():
+    import urllib2
+    html = urllib2.urlopen('http://mcc-mnc.com/').read()
+    td_re = re.compile('<td>([^<]*)</td>'*6)
+    codes = {}
+    tbody_start = False
+    for line in html.split('\n'):
+        if '<tbody>' in line:
+            tbody_start = True
+        elif '</tbody>' in line:
+            break
+        elif tbody_start:
+            td_search = td_re.search(line)
+            mcc = int(td_search.group(1))
+            isoCountryCode = td_search.group(3).upper()
+            if (len(isoCountryCode) != 2):
+                continue
+            codes[mcc] = isoCountryCode
+    return codes
+
+
+def read_codes(fileName):
+    codes = {}
+    with open(fileName) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            mcc, isoCountryCode = line.split(':')
+            if len(isoCountryCode) != 2:
+                raise ValueError('Invalid country code in line: ' + line)
+            codes[int(mcc)] = isoCountryCode
+    return codes
+
+
+def write_header(codes, out):
+    out.write('/*\n')
+    out.write(' * This file is generated by tools/generate_country_codes.py from\n')
+    out.write(' * countrycodes.txt. Do not edit it manually.\n')
+    out.write(' */\n\n')
+    out.write('#ifndef TELEPHONY_COUNTRYCODES_H\n')
+    out.write('#define TELEPHONY_COUNTRYCODES_H\n\n')
+    out.write('struct MccCountryCode {\n')
+    out.write('    unsigned short mcc;\n')
+    out.write('    char countryCode[3];\n')
+    out.write('};\n\n')
+    out.write('// sorted by mcc, so it can be binary searched\n')
+    out.write('static constexpr MccCountryCode mccCountryCodes[] = {\n')
+    for mcc in sorted(codes):
+        out.write('    { %d, "%s" },\n' % (mcc, codes[mcc]))
+    out.write('};\n\n')
+    out.write('#endif\n')
+
+
+if len(sys.argv) == 4 and sys.argv[1] == '--header':
+    with open(sys.argv[2], 'w') as header:
+        write_header(read_codes(sys.argv[3]), header)
+else:
+    codes = fetch_codes()
+    for mcc in codes:
+        print(str(mcc) + ":" + codes[mcc])
@@ -0,0 +1,265 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSocketNotifier>
+#include <QThread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "tracing.h"
+#include "logging.h"
+
+// events kept in the ring buffer when TP_OFONO_TRACE_EVENTS is not set
+#define DEFAULT_CAPACITY 20000
+
+// written by the SIGUSR1 handler, read by the notifier on the main thread
+static int flushSignalFds[2] = { -1, -1 };
+
+static void handleFlushSignal(int)
+{
+    char byte = 1;
+    ssize_t written = ::write(flushSignalFds[0], &byte, sizeof(byte));
+    Q_UNUSED(written);
+}
+
+Tracer::Tracer(QObject *parent)
+    : QObject(parent),
+      mEnabled(0),
+      mSignalNotifier(0),
+      mNext(0),
+      mSize(0)
+{
+    mClock.start();
+    if (QCoreApplication::instance()) {
+        moveToThread(QCoreApplication::instance()->thread());
+    }
+}
+
+Tracer *Tracer::instance()
+{
+    static Tracer *self = new Tracer();
+    return self;
+}
+
+void Tracer::initFromEnvironment()
+{
+    QByteArray output = qgetenv("TP_OFONO_TRACE");
+    if (output.isEmpty()) {
+        return;
+    }
+
+    bool ok = false;
+    int capacity = qgetenv("TP_OFONO_TRACE_EVENTS").toInt(&ok);
+    setOutput(QString::fromLocal8Bit(output));
+    setEnabled(true, ok ? capacity : DEFAULT_CAPACITY);
+    installSignalHandler();
+}
+
+void Tracer::installSignalHandler()
+{
+    if (mSignalNotifier) {
+        return;
+    }
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, flushSignalFds) != 0) {
+        qCWarning(lcConnection) << "Failed to create the trace flush socket pair";
+        return;
+    }
+    // the signal handler must never block, a full socket means a flush is pending anyway
+    ::fcntl(flushSignalFds[0], F_SETFL, ::fcntl(flushSignalFds[0], F_GETFL) | O_NONBLOCK);
+    mSignalNotifier = new QSocketNotifier(flushSignalFds[1], QSocketNotifier::Read, this);
+    connect(mSignalNotifier, SIGNAL(activated(int)), SLOT(onFlushSignal()));
+
+    struct sigaction action;
+    action.sa_handler = handleFlushSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, 0);
+}
+
+void Tracer::onFlushSignal()
+{
+    char byte;
+    ssize_t bytes = ::read(flushSignalFds[1], &byte, sizeof(byte));
+    Q_UNUSED(bytes);
+    flush();
+}
+
+bool Tracer::isEnabled() const
+{
+    return mEnabled.load() != 0;
+}
+
+void Tracer::setEnabled(bool enabled, int capacity)
+{
+    QMutexLocker locker(&mMutex);
+    mEvents.clear();
+    mEvents.resize(enabled ? (capacity > 0 ? capacity : DEFAULT_CAPACITY) : 0);
+    mNext = 0;
+    mSize = 0;
+    mEnabled.store(enabled ? 1 : 0);
+}
+
+int Tracer::capacity() const
+{
+    QMutexLocker locker(&mMutex);
+    return mEvents.size();
+}
+
+int Tracer::size() const
+{
+    QMutexLocker locker(&mMutex);
+    return mSize;
+}
+
+void Tracer::setOutput(const QString &output)
+{
+    QMutexLocker locker(&mMutex);
+    mOutput = output;
+}
+
+QString Tracer::output() const
+{
+    QMutexLocker locker(&mMutex);
+    return mOutput;
+}
+
+qint64 Tracer::now() const
+{
+    return mClock.nsecsElapsed() / 1000;
+}
+
+void Tracer::complete(const char *category, const char *name, qint64 start)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    Event event;
+    event.category = category;
+    event.name = name;
+    event.phase = 'X';
+    event.timestamp = start;
+    event.duration = now() - start;
+    event.id = 0;
+    append(event);
+}
+
+void Tracer::flow(char phase, const char *category, const char *name, const QString &key)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    Event event;
+    event.category = category;
+    event.name = name;
+    event.phase = phase;
+    event.timestamp = now();
+    event.duration = 0;
+    event.id = qHash(key);
+    append(event);
+}
+
+void Tracer::append(const Event &event)
+{
+    Event stored = event;
+    stored.thread = reinterpret_cast<quintptr>(QThread::currentThreadId());
+
+    QMutexLocker locker(&mMutex);
+    if (mEvents.isEmpty()) {
+        return;
+    }
+    mEvents[mNext] = stored;
+    mNext = (mNext + 1) % mEvents.size();
+    mSize = qMin(mSize + 1, mEvents.size());
+}
+
+QByteArray Tracer::toJson() const
+{
+    QMutexLocker locker(&mMutex);
+    qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+    // oldest first
+    int first = (mNext - mSize + mEvents.size()) % qMax(mEvents.size(), 1);
+    for (int i = 0; i < mSize; i++) {
+        const Event &event = mEvents[(first + i) % mEvents.size()];
+        QJsonObject object;
+        object["name"] = QString::fromLatin1(event.name);
+        object["cat"] = QString::fromLatin1(event.category);
+        object["ph"] = QString(QLatin1Char(event.phase));
+        object["ts"] = event.timestamp;
+        object["pid"] = pid;
+        object["tid"] = qint64(event.thread);
+        if (event.phase == 'X') {
+            object["dur"] = event.duration;
+        } else {
+            object["id"] = qint64(event.id);
+            if (event.phase == 'f') {
+                // bind the end of the flow to the enclosing slice
+                object["bp"] = QString("e");
+            }
+        }
+        events << object;
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = QString("ms");
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+bool Tracer::flush()
+{
+    QString path = output();
+    if (!isEnabled() || path.isEmpty()) {
+        return false;
+    }
+
+    QByteArray json = toJson();
+    if (path == "-") {
+        fprintf(stderr, "%s\n", json.constData());
+        return true;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcConnection) << "Failed to write the trace to" << path;
+        return false;
+    }
+    file.write(json);
+    return true;
+}
+
+TraceScope::TraceScope(const char *category, const char *name)
+    : mCategory(category),
+      mName(name),
+      mStart(Tracer::instance()->isEnabled() ? Tracer::instance()->now() : -1)
+{
+}
+
+TraceScope::~TraceScope()
+{
+    if (mStart >= 0) {
+        Tracer::instance()->complete(mCategory, mName, mStart);
+    }
+}
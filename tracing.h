@@ -0,0 +1,106 @@
+/**
+ * Copyright (C) 2016 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+class QSocketNotifier;
+
+// Opt-in event tracing in the Chrome Trace Event format, which can be loaded in
+// chrome://tracing or Perfetto. Tracing is enabled by setting TP_OFONO_TRACE to
+// the output file ("-" means stderr). The latest TP_OFONO_TRACE_EVENTS events
+// are kept in a ring buffer, which is only written out by flush(): on SIGUSR1
+// or through the FlushTrace() D-Bus method. Categories and names must be
+// string literals, as only the pointers are stored.
+class Tracer : public QObject
+{
+    Q_OBJECT
+public:
+    static Tracer *instance();
+
+    // enables tracing and installs the SIGUSR1 handler if TP_OFONO_TRACE is set
+    void initFromEnvironment();
+
+    bool isEnabled() const;
+    // (re)starts tracing with an empty buffer of the given size
+    void setEnabled(bool enabled, int capacity = 0);
+    int capacity() const;
+    int size() const;
+    void setOutput(const QString &output);
+    QString output() const;
+
+    // usecs since the tracer was created
+    qint64 now() const;
+    // a slice that started at the given time and ends now
+    void complete(const char *category, const char *name, qint64 start);
+    // flow events link slices: 's' starts a flow, 't' is a step and 'f' ends it.
+    // Events with the same key belong to the same flow.
+    void flow(char phase, const char *category, const char *name, const QString &key);
+
+    QByteArray toJson() const;
+    // writes the buffer to the output, the buffer is kept
+    bool flush();
+
+private Q_SLOTS:
+    void onFlushSignal();
+
+private:
+    explicit Tracer(QObject *parent = 0);
+    void installSignalHandler();
+
+    struct Event {
+        const char *category;
+        const char *name;
+        char phase;
+        qint64 timestamp;
+        qint64 duration;
+        quint64 id;
+        quint64 thread;
+    };
+    void append(const Event &event);
+
+    QElapsedTimer mClock;
+    QAtomicInt mEnabled;
+    QString mOutput;
+    QSocketNotifier *mSignalNotifier;
+
+    // ring buffer, protected by mMutex
+    mutable QMutex mMutex;
+    QVector<Event> mEvents;
+    int mNext;
+    int mSize;
+};
+
+// Records a slice from its creation to its destruction when tracing is enabled
+class TraceScope
+{
+public:
+    TraceScope(const char *category, const char *name);
+    ~TraceScope();
+
+private:
+    const char *mCategory;
+    const char *mName;
+    qint64 mStart;
+};
+
+#endif